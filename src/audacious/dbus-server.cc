@@ -17,9 +17,12 @@
  * the use of this software.
  */
 
+#include <string.h>
+
 #include <libaudcore/audstrings.h>
 #include <libaudcore/drct.h>
 #include <libaudcore/equalizer.h>
+#include <libaudcore/hook.h>
 #include <libaudcore/interface.h>
 #include <libaudcore/playlist.h>
 #include <libaudcore/plugins.h>
@@ -38,6 +41,14 @@ typedef GDBusMethodInvocation Invoc;
 #define FINISH2(name, ...) \
  obj_audacious_complete_##name (obj, invoc, __VA_ARGS__)
 
+/* limits the size of a single SongTuples reply */
+#define MAX_SONG_TUPLES 10000
+
+/* pseudo-fields for SongTuples, giving the filename of an entry and whether
+ * it has been scanned yet */
+#define URI_FIELD ((Tuple::Field) -2)
+#define SCANNED_FIELD ((Tuple::Field) -3)
+
 static bool prefer_playing = true;
 
 static Playlist current_playlist ()
@@ -91,6 +102,13 @@ static gboolean do_advance (Obj * obj, Invoc * invoc)
     return true;
 }
 
+static gboolean do_analyze_replay_gain (Obj * obj, Invoc * invoc, unsigned pos, unsigned count)
+{
+    CURRENT.analyze_replay_gain (pos, count ? (int) count : -1);
+    FINISH (analyze_replay_gain);
+    return true;
+}
+
 static gboolean do_auto_advance (Obj * obj, Invoc * invoc)
 {
     FINISH2 (auto_advance, ! aud_get_bool (nullptr, "no_playlist_advance"));
@@ -103,6 +121,13 @@ static gboolean do_balance (Obj * obj, Invoc * invoc)
     return true;
 }
 
+static gboolean do_cancel_replay_gain_analysis (Obj * obj, Invoc * invoc)
+{
+    Playlist::cancel_gain_analysis ();
+    FINISH (cancel_replay_gain_analysis);
+    return true;
+}
+
 static gboolean do_clear (Obj * obj, Invoc * invoc)
 {
     CURRENT.remove_all_entries ();
@@ -445,6 +470,12 @@ static gboolean do_repeat (Obj * obj, Invoc * invoc)
     return true;
 }
 
+static gboolean do_replay_gain_analysis_active (Obj * obj, Invoc * invoc)
+{
+    FINISH2 (replay_gain_analysis_active, Playlist::gain_analysis_in_progress ());
+    return true;
+}
+
 static gboolean do_reverse (Obj * obj, Invoc * invoc)
 {
     CURRENT.prev_song ();
@@ -632,34 +663,93 @@ static gboolean do_song_title (Obj * obj, Invoc * invoc, unsigned pos)
     return true;
 }
 
+static GVariant * tuple_value (const Tuple & tuple, Tuple::Field field)
+{
+    switch (tuple.get_value_type (field))
+    {
+    case Tuple::String:
+        return g_variant_new_string (tuple.get_str (field));
+
+    case Tuple::Int:
+        return g_variant_new_int32 (tuple.get_int (field));
+
+    default:
+        return g_variant_new_string ("");
+    }
+}
+
 static gboolean do_song_tuple (Obj * obj, Invoc * invoc, unsigned pos, const char * key)
 {
     Tuple::Field field = Tuple::field_by_name (key);
-    GVariant * var = nullptr;
+    GVariant * var;
 
     if (field >= 0)
+        var = tuple_value (CURRENT.entry_tuple (pos), field);
+    else
+        var = g_variant_new_string ("");
+
+    FINISH2 (song_tuple, g_variant_new_variant (var));
+    return true;
+}
+
+static gboolean do_song_tuples (Obj * obj, Invoc * invoc, unsigned pos,
+ unsigned count, const char * const * keys)
+{
+    Playlist list = CURRENT;
+    int entries = list.n_entries ();
+
+    Index<Tuple::Field> fields;
+    for (; * keys; keys ++)
     {
-        Tuple tuple = CURRENT.entry_tuple (pos);
+        if (! strcmp (* keys, "uri"))
+            fields.append (URI_FIELD);
+        else if (! strcmp (* keys, "scanned"))
+            fields.append (SCANNED_FIELD);
+        else
+            fields.append (Tuple::field_by_name (* keys));
+    }
 
-        switch (tuple.get_value_type (field))
-        {
-        case Tuple::String:
-            var = g_variant_new_string (tuple.get_str (field));
-            break;
+    int number = 0;
+    if (pos < (unsigned) entries)
+        number = aud::min (entries - (int) pos, (count && count < MAX_SONG_TUPLES) ?
+         (int) count : MAX_SONG_TUPLES);
+
+    /* don't hold up the caller (or the main loop) until the songs have been
+     * scanned; PlaylistChanged is sent as their metadata comes in */
+    auto rows = list.snapshot (pos, number, Playlist::NoWait);
 
-        case Tuple::Int:
-            var = g_variant_new_int32 (tuple.get_int (field));
-            break;
+    GVariantBuilder builder;
+    g_variant_builder_init (& builder, G_VARIANT_TYPE ("a(uav)"));
 
-        default:
-            break;
+    for (int i = 0; i < rows.len (); i ++)
+    {
+        auto & row = rows[i];
+
+        g_variant_builder_open (& builder, G_VARIANT_TYPE ("(uav)"));
+        g_variant_builder_add (& builder, "u", (unsigned) (rows.first () + i));
+        g_variant_builder_open (& builder, G_VARIANT_TYPE ("av"));
+
+        for (Tuple::Field field : fields)
+        {
+            GVariant * var;
+
+            if (field == URI_FIELD)
+                var = g_variant_new_string (row.filename);
+            else if (field == SCANNED_FIELD)
+                var = g_variant_new_boolean (row.tuple.state () != Tuple::Initial);
+            else if (field >= 0)
+                var = tuple_value (row.tuple, field);
+            else
+                var = g_variant_new_string ("");
+
+            g_variant_builder_add (& builder, "v", var);
         }
-    }
 
-    if (! var)
-        var = g_variant_new_string ("");
+        g_variant_builder_close (& builder);
+        g_variant_builder_close (& builder);
+    }
 
-    FINISH2 (song_tuple, g_variant_new_variant (var));
+    FINISH2 (song_tuples, g_variant_builder_end (& builder), entries);
     return true;
 }
 
@@ -757,8 +847,10 @@ handlers[] =
     {"handle-add-list", (GCallback) do_add_list},
     {"handle-add-url", (GCallback) do_add_url},
     {"handle-advance", (GCallback) do_advance},
+    {"handle-analyze-replay-gain", (GCallback) do_analyze_replay_gain},
     {"handle-auto-advance", (GCallback) do_auto_advance},
     {"handle-balance", (GCallback) do_balance},
+    {"handle-cancel-replay-gain-analysis", (GCallback) do_cancel_replay_gain_analysis},
     {"handle-clear", (GCallback) do_clear},
     {"handle-config-get", (GCallback) do_config_get},
     {"handle-config-set", (GCallback) do_config_set},
@@ -804,6 +896,7 @@ handlers[] =
     {"handle-recording", (GCallback) do_recording},
     {"handle-record", (GCallback) do_record},
     {"handle-repeat", (GCallback) do_repeat},
+    {"handle-replay-gain-analysis-active", (GCallback) do_replay_gain_analysis_active},
     {"handle-reverse", (GCallback) do_reverse},
     {"handle-seek", (GCallback) do_seek},
     {"handle-select-displayed-playlist", (GCallback) do_select_displayed_playlist},
@@ -825,6 +918,7 @@ handlers[] =
     {"handle-song-length", (GCallback) do_song_length},
     {"handle-song-title", (GCallback) do_song_title},
     {"handle-song-tuple", (GCallback) do_song_tuple},
+    {"handle-song-tuples", (GCallback) do_song_tuples},
     {"handle-startup-notify", (GCallback) do_startup_notify},
     {"handle-status", (GCallback) do_status},
     {"handle-stop", (GCallback) do_stop},
@@ -844,6 +938,28 @@ static unsigned owner_id = 0;
 
 static GDBusInterfaceSkeleton * skeleton = nullptr;
 
+static void playlist_update_cb (void *, void *)
+{
+    int playlists = Playlist::n_playlists ();
+
+    for (int p = 0; p < playlists; p ++)
+    {
+        auto ranges = Playlist::by_index (p).update_ranges ();
+        if (! ranges.len ())
+            continue;
+
+        GVariantBuilder builder;
+        g_variant_builder_init (& builder, G_VARIANT_TYPE ("a(iiii)"));
+
+        for (auto & range : ranges)
+            g_variant_builder_add (& builder, "(iiii)", range.at, range.count,
+             range.old_count, (int) range.level);
+
+        obj_audacious_emit_playlist_changed ((Obj *) skeleton, p,
+         g_variant_builder_end (& builder));
+    }
+}
+
 static void name_acquired (GDBusConnection *, const char * name, void *)
 {
     AUDINFO ("Owned D-Bus name (%s) on session bus.\n", name);
@@ -899,7 +1015,10 @@ StartupType dbus_server_init ()
     mainloop = nullptr;
 
     if (owner_id)
+    {
         startup = StartupType::Server;
+        hook_associate ("playlist update", playlist_update_cb, nullptr);
+    }
     else
         startup = StartupType::Client;
 
@@ -921,6 +1040,8 @@ ERROR:
 
 void dbus_server_cleanup ()
 {
+    hook_dissociate ("playlist update", playlist_update_cb);
+
     if (owner_id)
     {
         g_bus_unown_name (owner_id);
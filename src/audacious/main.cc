@@ -50,6 +50,7 @@ static struct {
     int mainwin, show_jump_box;
     int headless, quit_after_play;
     int verbose;
+    int startup_profile;
     int qt;
 } options;
 
@@ -77,6 +78,7 @@ static const struct {
     {"headless", 'H', & options.headless, N_("Start without a graphical interface")},
     {"quit-after-play", 'q', & options.quit_after_play, N_("Quit on playback stop")},
     {"verbose", 'V', & options.verbose, N_("Print debugging messages (may be used twice)")},
+    {"startup-profile", 'S', & options.startup_profile, N_("Print the time taken by each phase of startup")},
 #if defined(USE_QT) && defined(USE_GTK)
     {"qt", 'Q', & options.qt, N_("Run in Qt mode")},
 #endif
@@ -165,6 +167,7 @@ static bool parse_options (int argc, char * * argv)
     }
 
     aud_set_headless_mode (options.headless);
+    aud_set_startup_profile (options.startup_profile);
 
     if (options.verbose >= 2)
         audlog::set_stderr_level (audlog::Debug);
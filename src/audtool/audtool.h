@@ -78,6 +78,9 @@ void playlist_jump (int, char * *);
 void playlist_add_url_string (int, char * *);
 void playlist_delete (int, char * *);
 void playlist_clear (int, char * *);
+void playlist_analyze_gain (int, char * *);
+void playlist_analyze_gain_status (int, char * *);
+void playlist_analyze_gain_cancel (int, char * *);
 void playlist_repeat_status (int, char * *);
 void playlist_repeat_toggle (int, char * *);
 void playlist_shuffle_status (int, char * *);
@@ -234,40 +234,95 @@ void playlist_song_length_frames (int argc, char * * argv)
     audtool_report ("%d", length);
 }
 
+static void display_entry (int entry, const char * title, int length)
+{
+    /* adjust width for multi byte characters */
+    int column = 60;
+
+    for (const char * p = title; * p; p = g_utf8_next_char (p))
+    {
+        int stride = g_utf8_next_char (p) - p;
+
+        if (g_unichar_iswide (g_utf8_get_char (p)) ||
+         g_unichar_iswide_cjk (g_utf8_get_char (p)))
+            column += (stride - 2);
+        else
+            column += (stride - 1);
+    }
+
+    char * fmt = g_strdup_printf ("%%4d | %%-%ds | %%d:%%.2d", column);
+    audtool_report (fmt, entry + 1, title, length / 60, length % 60);
+
+    g_free (fmt);
+}
+
 void playlist_display (int argc, char * * argv)
 {
+    static const char * const fields[] = {"formatted-title", "length", "scanned", NULL};
+
     int entries = get_playlist_length ();
 
     audtool_report ("%d track%s.", entries, entries != 1 ? "s" : "");
 
     int total = 0;
 
-    for (int entry = 0; entry < entries; entry ++)
+    /* the entries are fetched in batches, rather than one call per field and
+     * entry; stop early if the playlist has become shorter in the meantime.
+     * The batches are returned without waiting for the entries to be scanned,
+     * so any entry not scanned yet is requested again by itself, which does
+     * wait. */
+    for (int first = 0; first < entries; )
     {
-        char * title = get_entry_title (entry);
-        int length = get_entry_length (entry) / 1000;
-
-        total += length;
+        GVariant * songs = get_entry_fields (first, fields);
+        int n_songs = g_variant_n_children (songs);
 
-        /* adjust width for multi byte characters */
-        int column = 60;
-
-        for (const char * p = title; * p; p = g_utf8_next_char (p))
+        if (! n_songs)
         {
-            int stride = g_utf8_next_char (p) - p;
+            g_variant_unref (songs);
+            break;
+        }
 
-            if (g_unichar_iswide (g_utf8_get_char (p)) ||
-             g_unichar_iswide_cjk (g_utf8_get_char (p)))
-                column += (stride - 2);
+        for (int i = 0; i < n_songs; i ++)
+        {
+            unsigned entry;
+            GVariant * values, * title, * length, * scanned;
+
+            g_variant_get_child (songs, i, "(u@av)", & entry, & values);
+            g_variant_get_child (values, 0, "v", & title);
+            g_variant_get_child (values, 1, "v", & length);
+            g_variant_get_child (values, 2, "v", & scanned);
+
+            /* older versions do not know "scanned", but always wait */
+            if (g_variant_is_of_type (scanned, G_VARIANT_TYPE_BOOLEAN) &&
+             ! g_variant_get_boolean (scanned))
+            {
+                char * title2 = get_entry_title (entry);
+                int seconds = MAX (0, get_entry_length (entry)) / 1000;
+
+                total += seconds;
+                display_entry (entry, title2, seconds);
+
+                g_free (title2);
+            }
             else
-                column += (stride - 1);
-        }
+            {
+                int seconds = g_variant_is_of_type (length, G_VARIANT_TYPE_INT32) ?
+                 MAX (0, g_variant_get_int32 (length)) / 1000 : 0;
+
+                total += seconds;
 
-        char * fmt = g_strdup_printf ("%%4d | %%-%ds | %%d:%%.2d", column);
-        audtool_report (fmt, entry + 1, title, length / 60, length % 60);
+                display_entry (entry, g_variant_is_of_type (title, G_VARIANT_TYPE_STRING) ?
+                 g_variant_get_string (title, NULL) : "", seconds);
+            }
+
+            g_variant_unref (title);
+            g_variant_unref (length);
+            g_variant_unref (scanned);
+            g_variant_unref (values);
+        }
 
-        g_free (fmt);
-        g_free (title);
+        first += n_songs;
+        g_variant_unref (songs);
     }
 
     audtool_report ("Total length: %d:%.2d", total / 60, total % 60);
@@ -297,6 +352,23 @@ void playlist_clear (int argc, char * * argv)
     obj_audacious_call_clear_sync (dbus_proxy, NULL, NULL);
 }
 
+void playlist_analyze_gain (int argc, char * * argv)
+{
+    obj_audacious_call_analyze_replay_gain_sync (dbus_proxy, 0, 0, NULL, NULL);
+}
+
+void playlist_analyze_gain_status (int argc, char * * argv)
+{
+    gboolean active = FALSE;
+    obj_audacious_call_replay_gain_analysis_active_sync (dbus_proxy, & active, NULL, NULL);
+    audtool_report (active ? "on" : "off");
+}
+
+void playlist_analyze_gain_cancel (int argc, char * * argv)
+{
+    obj_audacious_call_cancel_replay_gain_analysis_sync (dbus_proxy, NULL, NULL);
+}
+
 void playlist_repeat_status (int argc, char * * argv)
 {
     gboolean repeat = FALSE;
@@ -78,6 +78,9 @@ const struct commandhandler handlers[] =
     {"playlist-position", playlist_position, "print position of current song", 0},
     {"playlist-jump", playlist_jump, "skip to given song", 1},
     {"playlist-clear", playlist_clear, "clear playlist", 0},
+    {"playlist-analyze-gain", playlist_analyze_gain, "write ReplayGain tags for all songs in playlist", 0},
+    {"playlist-analyze-gain-status", playlist_analyze_gain_status, "query if ReplayGain analysis is in progress", 0},
+    {"playlist-analyze-gain-cancel", playlist_analyze_gain_cancel, "stop ReplayGain analysis", 0},
     {"playlist-auto-advance-status", playlist_auto_advance_status, "query playlist auto-advance", 0},
     {"playlist-auto-advance-toggle", playlist_auto_advance_toggle, "toggle playlist auto-advance", 0},
     {"playlist-repeat-status", playlist_repeat_status, "query playlist repeat", 0},
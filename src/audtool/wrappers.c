@@ -165,6 +165,19 @@ char * get_entry_field (int entry, const char * field)
     return str;
 }
 
+GVariant * get_entry_fields (int first, const char * const * fields)
+{
+    GVariant * songs = NULL;
+    int length = -1;
+    obj_audacious_call_song_tuples_sync (dbus_proxy, first, 0, fields,
+     & songs, & length, NULL, NULL);
+
+    if (! songs || length < 0)
+        exit (1);
+
+    return songs;
+}
+
 int get_current_time (void)
 {
     unsigned time = -1;
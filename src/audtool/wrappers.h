@@ -37,6 +37,10 @@ char * get_entry_title (int entry);
 int get_entry_length (int entry);
 char * get_entry_field (int entry, const char * field);
 
+/* Returns, as an "a(uav)" array, the given fields of the entries starting at
+ * <first> (as many as the server returns at once, possibly none). */
+GVariant * get_entry_fields (int first, const char * const * fields);
+
 int get_current_time (void);
 void get_current_info (int * bitrate, int * samplerate, int * channels);
 
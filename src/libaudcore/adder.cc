@@ -77,62 +77,16 @@ static bool add_thread_started = false;
 static bool add_thread_exited = false;
 static pthread_t add_thread;
 static QueuedFunc queued_add;
-static QueuedFunc status_timer;
 
-static char status_path[512];
-static int status_count;
-static bool status_shown = false;
+static Progress progress ("Searching");
 
-static void status_cb (void * unused)
+static void status_update (const char * filename, int found)
 {
-    pthread_mutex_lock (& mutex);
-
     char scratch[128];
     snprintf (scratch, sizeof scratch, dngettext (PACKAGE, "%d file found",
-     "%d files found", status_count), status_count);
-
-    if (aud_get_headless_mode ())
-    {
-        printf ("Searching, %s ...\r", scratch);
-        fflush (stdout);
-    }
-    else
-    {
-        hook_call ("ui show progress", status_path);
-        hook_call ("ui show progress 2", scratch);
-    }
-
-    status_shown = true;
-
-    pthread_mutex_unlock (& mutex);
-}
-
-static void status_update (const char * filename, int found)
-{
-    pthread_mutex_lock (& mutex);
-
-    snprintf (status_path, sizeof status_path, "%s", filename);
-    status_count = found;
-
-    if (! status_timer.running ())
-        status_timer.start (250, status_cb, nullptr);
-
-    pthread_mutex_unlock (& mutex);
-}
-
-static void status_done_locked ()
-{
-    status_timer.stop ();
+     "%d files found", found), found);
 
-    if (status_shown)
-    {
-        if (aud_get_headless_mode ())
-            printf ("\n");
-        else
-            hook_call ("ui hide progress", nullptr);
-
-        status_shown = false;
-    }
+    progress.update (filename, scratch);
 }
 
 static void add_file (PlaylistAddItem && item, Playlist::FilterFunc filter,
@@ -491,7 +445,7 @@ static void add_finish (void * unused)
     if (add_thread_exited)
     {
         stop_thread_locked ();
-        status_done_locked ();
+        progress.done ();
     }
 
     pthread_mutex_unlock (& mutex);
@@ -547,7 +501,7 @@ void adder_cleanup ()
     add_tasks.clear ();
 
     stop_thread_locked ();
-    status_done_locked ();
+    progress.done ();
 
     add_results.clear ();
 
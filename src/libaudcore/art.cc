@@ -36,6 +36,7 @@
 #include "runtime.h"
 #include "scanner.h"
 #include "vfs.h"
+#include "vfs_async.h"
 
 #define FLAG_DONE 1
 #define FLAG_SENT 2
@@ -51,6 +52,9 @@ struct AudArtItem {
     /* album art as (possibly a temporary) file */
     String art_file;
     bool is_temp;
+
+    /* external image file being read in the background */
+    bool loading;
 };
 
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
@@ -89,14 +93,40 @@ static void send_requests (void *)
     }
 }
 
+static void art_file_loaded (const char * filename, const Index<char> & buf, void * user)
+{
+    pthread_mutex_lock (& mutex);
+
+    auto item = (AudArtItem *) user;
+
+    item->data.insert (buf.begin (), 0, buf.len ());
+    item->loading = false;
+    item->flag = FLAG_DONE;
+
+    queued_requests.queue (send_requests, nullptr);
+
+    pthread_mutex_unlock (& mutex);
+}
+
 static void finish_item_locked (AudArtItem * item, Index<char> && data, String && art_file)
 {
-    /* already finished? */
-    if (item->flag)
+    /* already finished (or finishing)? */
+    if (item->flag || item->loading)
         return;
 
     item->data = std::move (data);
     item->art_file = std::move (art_file);
+
+    /* an external image file is read before the item is sent, so that
+     * aud_art_request() never has to read it in the main thread */
+    if (! item->data.len () && item->art_file)
+    {
+        item->loading = true;
+        vfs_async_file_get_contents (item->art_file, art_file_loaded, item,
+         VFSPriority::Background);
+        return;
+    }
+
     item->flag = FLAG_DONE;
 
     queued_requests.queue (send_requests, nullptr);
@@ -203,6 +233,27 @@ void art_clear_current ()
 
 void art_cleanup ()
 {
+    Index<AudArtItem *> loading;
+
+    pthread_mutex_lock (& mutex);
+
+    art_items.iterate ([&] (const String &, AudArtItem & item)
+    {
+        if (item.loading)
+        {
+            loading.append (& item);
+            item.loading = false;
+        }
+    });
+
+    pthread_mutex_unlock (& mutex);
+
+    for (AudArtItem * item : loading)
+    {
+        vfs_async_cancel (art_file_loaded, item);
+        aud_art_unref (item); /* release temporary reference */
+    }
+
     auto queued = get_queued ();
     for (AudArtItem * item : queued)
         aud_art_unref (item); /* release temporary reference */
@@ -225,19 +276,9 @@ EXPORT AudArtPtr aud_art_request (const char * file, int format, bool * queued)
     if (! item)
         goto UNLOCK;
 
-    if (format & AUD_ART_DATA)
-    {
-        /* load data from external image file */
-        if (! item->data.len () && item->art_file)
-        {
-            VFSFile file (item->art_file, "r");
-            if (file)
-                item->data = file.read_all ();
-        }
-
-        if (! item->data.len ())
-            good = false;
-    }
+    /* data from an external image file has already been read */
+    if ((format & AUD_ART_DATA) && ! item->data.len ())
+        good = false;
 
     if (format & AUD_ART_FILE)
     {
@@ -23,6 +23,7 @@
 
 #define WANT_AUD_BSWAP
 #include "audio.h"
+#include "internal.h"
 #include "objects.h"
 
 #define SW_VOLUME_RANGE 40 /* decibels */
@@ -390,3 +391,48 @@ EXPORT void audio_soft_clip (float * data, int samples)
         * data ++ = (x > 0) ? y : -y;
     }
 }
+
+/* Converts interleaved audio from one number of channels to another.  Mono is
+ * copied to the front left and right channels, and anything is mixed down to
+ * mono by averaging.  5.1 (in the order FL, FR, FC, LFE, RL, RR) is mixed down
+ * to stereo with the usual weights; otherwise channels are matched by
+ * position, and any extra are dropped or left silent. */
+void audio_remap_channels (const Index<float> & in, int in_chans,
+ Index<float> & out, int out_chans)
+{
+    int frames = in.len () / in_chans;
+
+    out.resize (0);
+    out.insert (0, frames * out_chans);
+
+    const float * get = in.begin ();
+    float * set = out.begin ();
+
+    for (int f = 0; f < frames; f ++, get += in_chans, set += out_chans)
+    {
+        if (in_chans == 1)
+        {
+            for (int c = 0; c < aud::min (out_chans, 2); c ++)
+                set[c] = get[0];
+        }
+        else if (out_chans == 1)
+        {
+            float sum = 0;
+            for (int c = 0; c < in_chans; c ++)
+                sum += get[c];
+
+            set[0] = sum / in_chans;
+        }
+        else if (in_chans == 6 && out_chans == 2)
+        {
+            float center = get[2] * 0.7071f;
+            set[0] = (get[0] + center + get[4] * 0.7071f) * 0.4142f;
+            set[1] = (get[1] + center + get[5] * 0.7071f) * 0.4142f;
+        }
+        else
+        {
+            for (int c = 0; c < aud::min (in_chans, out_chans); c ++)
+                set[c] = get[c];
+        }
+    }
+}
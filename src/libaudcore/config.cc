@@ -72,10 +72,13 @@ static const char * const core_defaults[] = {
  "enable_clipping_prevention", "TRUE",
  "output_bit_depth", "-1",
  "output_buffer_size", "500",
+ "output_keep_open", aud::numeric_string<(int) OutputKeepOpen::Never>::str,
+ "output_sample_rate", "0",
  "record", "FALSE",
  "record_stream", aud::numeric_string<(int) OutputStream::AfterReplayGain>::str,
  "replay_gain_mode", aud::numeric_string<(int) ReplayGainMode::Track>::str,
  "replay_gain_preamp", "0",
+ "resample_quality", "1",
  "soft_clipping", "FALSE",
  "software_volume_control", "FALSE",
  "sw_volume_left", "100",
@@ -89,6 +92,7 @@ static const char * const core_defaults[] = {
  "stop_after_current_song", "FALSE",
 
  /* playlist */
+ "background_sort", "TRUE",
  "chardet_fallback", "ISO-8859-1",
 #ifdef _WIN32
  "convert_backslash", "TRUE",
@@ -105,6 +109,9 @@ static const char * const core_defaults[] = {
  "show_numbers_in_pl", "FALSE",
  "slow_probe", "FALSE",
 
+ /* visualization */
+ "vis_update_rate", "30",  /* Hz */
+
  nullptr};
 
 enum OpType {
@@ -260,24 +267,13 @@ void config_load ()
     }
 }
 
-void config_save ()
+/* runs in the background; the list is sorted here as well, since that is the
+ * most expensive part for a large configuration */
+static void config_write (void * data)
 {
-    if (! s_modified)
-        return;
-
-    Index<ConfigItem> list;
+    auto list = (Index<ConfigItem> *) data;
 
-    auto add_to_list = [&] (ConfigNode * node) {
-        list.append (* node);
-        return false;
-    };
-    auto finish = [] () {
-        s_modified = false;  // must be inside MultiHash lock
-    };
-
-    s_config.iterate (add_to_list, finish);
-
-    list.sort ([] (const ConfigItem & a, const ConfigItem & b) {
+    list->sort ([] (const ConfigItem & a, const ConfigItem & b) {
         if (a.section == b.section)
             return strcmp (a.key, b.key);
         else
@@ -290,7 +286,7 @@ void config_save ()
     if (! file)
         goto FAILED;
 
-    for (const ConfigItem & item : list)
+    for (const ConfigItem & item : * list)
     {
         if (item.section != current_heading)
         {
@@ -307,10 +303,41 @@ void config_save ()
     if (file.fflush () < 0)
         goto FAILED;
 
+    delete list;
     return;
 
 FAILED:
     AUDWARN ("Error saving configuration.\n");
+
+    /* try again next time; as in config_save(), the flag is only changed
+     * inside the MultiHash lock, lest a concurrent save clear it */
+    auto skip = [] (ConfigNode *) { return false; };
+    auto retry = [] () { s_modified = true; };
+    s_config.iterate (skip, retry);
+
+    delete list;
+}
+
+/* takes a snapshot of the configuration and queues it to be written; call
+ * persist_wait() to be sure that it has been written */
+void config_save ()
+{
+    if (! s_modified)
+        return;
+
+    auto list = new Index<ConfigItem>;
+
+    auto add_to_list = [&] (ConfigNode * node) {
+        list->append (* node);
+        return false;
+    };
+    auto finish = [] () {
+        s_modified = false;  // must be inside MultiHash lock
+    };
+
+    s_config.iterate (add_to_list, finish);
+
+    persist_queue (config_write, list);
 }
 
 EXPORT void aud_config_set_defaults (const char * section, const char * const * entries)
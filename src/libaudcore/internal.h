@@ -20,6 +20,7 @@
 #ifndef LIBAUDCORE_INTERNAL_H
 #define LIBAUDCORE_INTERNAL_H
 
+#include <pthread.h>
 #include <stdint.h>
 #include <sys/types.h>
 
@@ -45,6 +46,10 @@ void art_cleanup ();
 /* art-search.cc */
 String art_search (const char * filename);
 
+/* audio.cc */
+void audio_remap_channels (const Index<float> & in, int in_chans,
+ Index<float> & out, int out_chans);
+
 /* charset.cc */
 void chardet_init ();
 void chardet_cleanup ();
@@ -90,6 +95,10 @@ bool iface_plugin_set_current (PluginHandle * plugin);
 
 void interface_run ();
 
+/* mixer.cc */
+void mixer_mix (Index<float> & data, int channels, int rate);
+void mixer_cleanup ();
+
 /* playback.cc */
 /* do not call these; use aud_drct_play/stop() instead */
 void playback_play (int seek_time, bool pause);
@@ -98,6 +107,31 @@ void playback_stop (bool exiting = false);
 bool playback_check_serial (int serial);
 void playback_set_info (int entry, Tuple && tuple);
 
+/* Receives the decoded audio when an input plugin is run outside of normal
+ * playback (for example, to analyze a file).  The sink is installed for the
+ * calling thread only; pass nullptr to remove it again. */
+class DecodeSink
+{
+public:
+    virtual void open_audio (int format, int rate, int channels) = 0;
+    virtual void write_audio (const void * data, int length) = 0;
+    virtual bool check_stop () = 0;
+    virtual Tuple get_tuple () = 0;
+};
+
+void playback_set_decode_sink (DecodeSink * sink);
+
+/* Decoding outside of playback with a plugin that is not reentrant must be
+ * bracketed by these, so that the plugin is not run for playback or by another
+ * thread at the same time.  While decoding, check playback_decoder_wanted() in
+ * DecodeSink::check_stop(). */
+bool playback_borrow_decoder (InputPlugin * ip, bool (* cancelled) (void *), void * data);
+bool playback_return_decoder (InputPlugin * ip);
+bool playback_decoder_wanted (InputPlugin * ip);
+
+/* replaygain.cc */
+void replaygain_cleanup ();
+
 /* probe.cc */
 bool open_input_file (const char * filename, const char * mode,
  InputPlugin * ip, VFSFile & file, String * error = nullptr);
@@ -107,9 +141,53 @@ InputPlugin * load_input_plugin (PluginHandle * decoder, String * error = nullpt
 #define PROBE_FLAG_MIGHT_HAVE_SUBTUNES (1 << 1)
 int probe_by_filename (const char * filename);
 
+/* progress.cc */
+
+/* Shows the progress of a background task to the user, starting a moment
+ * after the first update.  If several tasks report progress at once, the
+ * one that reported last is shown until it is done; the display is hidden
+ * once all of them are done.  update() may be called from any thread. */
+class Progress
+{
+public:
+    /* <verb> begins the line printed in headless mode, e.g. "Searching" */
+    Progress (const char * verb) :
+        m_verb (verb) {}
+
+    /* <path> may be null to keep showing the previous one */
+    void update (const char * path, const char * status);
+    void done ();
+
+private:
+    static void show (void *);
+
+    const char * const m_verb;
+    char m_path[512] = "";
+    char m_status[128] = "";
+    bool m_active = false;
+};
+
+/* resampler.cc */
+bool resampler_set_format (int channels, int in_rate, int out_rate);
+bool resampler_active ();
+int resampler_get_delay ();
+Index<float> & resampler_process (Index<float> & data, bool finish = false);
+void resampler_flush ();
+void resampler_cleanup ();
+
 /* runtime.cc */
 extern size_t misc_bytes_allocated;
 
+/* reports a startup phase that began at <start> (from g_get_monotonic_time),
+ * if profiling was requested with aud_set_startup_profile() */
+void startup_profile_report (const char * phase, int64_t start);
+
+/* queues <func> to be run in the background thread that writes settings and
+ * playlists to disk; jobs are run one at a time, in the order queued */
+void persist_queue (void (* func) (void * data), void * data);
+/* waits for all queued jobs to finish */
+void persist_wait ();
+
 /* strpool.cc */
 void string_leak_check ();
 
@@ -129,6 +207,25 @@ bool is_cuesheet_entry (const char * filename);
 bool is_subtune (const char * filename);
 StringBuf strip_subtune (const char * filename);
 
+/* runs func on each element of tasks, in parallel if there is more than one */
+template<class T>
+void run_parallel (Index<T> & tasks, void * (* func) (void *))
+{
+    if (tasks.len () == 1)
+    {
+        func (& tasks[0]);
+        return;
+    }
+
+    Index<pthread_t> threads;
+    threads.insert (0, tasks.len ());
+
+    for (int i = 0; i < tasks.len (); i ++)
+        pthread_create (& threads[i], nullptr, func, & tasks[i]);
+    for (int i = 0; i < tasks.len (); i ++)
+        pthread_join (threads[i], nullptr);
+}
+
 unsigned int32_hash (unsigned val);
 unsigned ptr_hash (const void * ptr);
 
@@ -144,11 +241,14 @@ struct IntHashKey
         { return int32_hash (val); }
 };
 
+/* vfs_async.cc */
+void vfs_async_cleanup ();
+
 /* vis-runner.cc */
 void vis_runner_start_stop (bool playing, bool paused);
 void vis_runner_pass_audio (int time, const Index<float> & data, int channels, int rate);
 void vis_runner_flush ();
-void vis_runner_enable (bool enable);
+void vis_runner_enable (int type_mask); /* 0 = disabled */
 
 /* visualization.cc */
 void vis_activate (bool activate);
@@ -19,10 +19,32 @@
 
 #include "audstrings.h"
 #include "index.h"
+#include "list.h"
 #include "runtime.h"
 #include "tinylock.h"
 
+#include <pthread.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* Debug and Info messages are written out by a background thread, so that
+ * threads calling audlog::log() never block on terminal or file I/O (or on a
+ * slow handler).  Each thread gets its own single-producer ring of records,
+ * and the message is formatted directly into a ring slot without taking any
+ * lock.  These messages are rate-limited per thread; messages lost to the rate
+ * limit or to a full ring are counted and reported in their place.
+ *
+ * Warnings and errors are rare, and must not be delayed or lost (an error may
+ * well be followed by a crash), so they are written out synchronously, as are
+ * all messages before the background thread is started and after it is
+ * stopped (at exit).  A warning may therefore appear ahead of Debug or Info
+ * messages logged just before it by the same thread. */
+
+#define RING_SIZE 256      /* records per thread, must be a power of two */
+#define INLINE_LEN 232     /* longer messages are allocated separately */
+#define RATE_LIMIT 1000    /* Debug/Info messages per second per thread */
+#define DRAIN_INTERVAL 50  /* milliseconds */
 
 namespace audlog {
 
@@ -31,11 +53,44 @@ struct HandlerData {
     Level level;
 };
 
+struct Record {
+    Level level;
+    const char * file;  /* __FILE__ and __FUNCTION__ are static strings */
+    int line;
+    const char * func;
+    char * long_message;
+    char message[INLINE_LEN];
+};
+
+struct Ring : public ListNode {
+    Record records[RING_SIZE];
+    unsigned head = 0;  /* written only by the owning thread */
+    unsigned tail = 0;  /* written only by the drain thread */
+    int dropped = 0, limited = 0;
+    time_t window = 0;
+    int window_count = 0;
+    bool orphaned = false;  /* owning thread has exited */
+};
+
 static TinyRWLock lock;
 static Index<HandlerData> handlers;
 static Level stderr_level = Warning;
 static Level min_level = Warning;
 
+static pthread_once_t once = PTHREAD_ONCE_INIT;
+static pthread_key_t ring_key;
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_t drain_thread;
+
+/* the ring list has its own lock, which is never held while handlers are
+ * called, so that registering a new thread does not wait for I/O */
+static pthread_mutex_t rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static List<Ring> rings;
+static Index<Ring *> drain_list;  /* used only by the drain thread */
+static bool running, quit;
+static int idle;
+
 EXPORT void set_stderr_level (Level level)
 {
     tiny_lock_write (& lock);
@@ -96,30 +151,255 @@ EXPORT const char * get_level_name (Level level)
     return nullptr;
 }
 
-EXPORT void log (Level level, const char * file, int line, const char * func,
- const char * format, ...)
+/* assumes lock held for reading */
+static void dispatch (Level level, const char * file, int line,
+ const char * func, const char * message)
+{
+    if (level >= stderr_level)
+        fprintf (stderr, "%s %s:%d [%s]: %s", get_level_name (level), file,
+         line, func, message);
+
+    for (const HandlerData & h : handlers)
+    {
+        if (level >= h.level)
+            h.handler (level, file, line, func, message);
+    }
+}
+
+/* assumes lock held for reading */
+static void drain_ring (Ring * ring)
+{
+    unsigned tail = ring->tail;
+    unsigned head = __sync_fetch_and_add (& ring->head, 0);
+
+    for (; tail != head; tail ++)
+    {
+        Record & rec = ring->records[tail & (RING_SIZE - 1)];
+
+        dispatch (rec.level, rec.file, rec.line, rec.func,
+         rec.long_message ? rec.long_message : rec.message);
+
+        free (rec.long_message);
+
+        /* release the slot only after we are done reading it */
+        __sync_synchronize ();
+        ring->tail = tail + 1;
+    }
+
+    int dropped = __sync_fetch_and_and (& ring->dropped, 0);
+    int limited = __sync_fetch_and_and (& ring->limited, 0);
+
+    if (dropped || limited)
+    {
+        StringBuf message = str_printf ("%d messages dropped (%d over rate limit).\n",
+         dropped + limited, limited);
+        dispatch (Warning, __FILE__, __LINE__, __FUNCTION__, message);
+    }
+}
+
+/* called only from the drain thread, which is the only one to delete rings */
+static void drain_all ()
 {
+    /* read the orphaned flags before draining, so that nothing is left
+     * behind; orphaned rings are marked with a null entry after them */
+    pthread_mutex_lock (& rings_mutex);
+
+    for (Ring * ring = rings.head (); ring; ring = rings.next (ring))
+    {
+        drain_list.append (ring);
+        if (ring->orphaned)
+            drain_list.append (nullptr);
+    }
+
+    pthread_mutex_unlock (& rings_mutex);
+
     tiny_lock_read (& lock);
 
-    if (level >= min_level)
+    for (Ring * ring : drain_list)
     {
-        va_list args;
-        va_start (args, format);
-        StringBuf message = str_vprintf (format, args);
-        va_end (args);
+        if (ring)
+            drain_ring (ring);
+    }
+
+    tiny_unlock_read (& lock);
 
-        if (level >= stderr_level)
-            fprintf (stderr, "%s %s:%d [%s]: %s", get_level_name (level), file,
-             line, func, (const char *) message);
+    pthread_mutex_lock (& rings_mutex);
 
-        for (const HandlerData & h : handlers)
+    for (int i = 1; i < drain_list.len (); i ++)
+    {
+        if (! drain_list[i])
         {
-            if (level >= h.level)
-                h.handler (level, file, line, func, message);
+            rings.remove (drain_list[i - 1]);
+            delete drain_list[i - 1];
         }
     }
 
-    tiny_unlock_read (& lock);
+    pthread_mutex_unlock (& rings_mutex);
+
+    drain_list.remove (0, -1);
+}
+
+static void * drain_worker (void *)
+{
+    pthread_mutex_lock (& mutex);
+
+    while (! quit)
+    {
+        timespec until;
+        clock_gettime (CLOCK_REALTIME, & until);
+        until.tv_nsec += DRAIN_INTERVAL * 1000000;
+        until.tv_sec += until.tv_nsec / 1000000000;
+        until.tv_nsec %= 1000000000;
+
+        /* a wakeup may occasionally be lost here; the timeout bounds the delay */
+        idle = 1;
+        pthread_cond_timedwait (& cond, & mutex, & until);
+        idle = 0;
+
+        pthread_mutex_unlock (& mutex);
+        drain_all ();
+        pthread_mutex_lock (& mutex);
+    }
+
+    pthread_mutex_unlock (& mutex);
+
+    drain_all ();
+    return nullptr;
+}
+
+static void orphan_ring (void * ring)
+{
+    pthread_mutex_lock (& rings_mutex);
+    ((Ring *) ring)->orphaned = true;
+    pthread_mutex_unlock (& rings_mutex);
+}
+
+/* Called at exit.  Messages queued by other threads while the drain thread is
+ * finishing up may be lost; anything logged afterward is written directly. */
+static void stop_drain ()
+{
+    pthread_mutex_lock (& mutex);
+    running = false;
+    quit = true;
+    pthread_cond_signal (& cond);
+    pthread_mutex_unlock (& mutex);
+
+    pthread_join (drain_thread, nullptr);
+}
+
+static void start_drain ()
+{
+    if (pthread_key_create (& ring_key, orphan_ring) ||
+        pthread_create (& drain_thread, nullptr, drain_worker, nullptr))
+        return;
+
+    running = true;
+    atexit (stop_drain);
+}
+
+static Ring * get_ring ()
+{
+    pthread_once (& once, start_drain);
+
+    if (! running)
+        return nullptr;
+
+    auto ring = (Ring *) pthread_getspecific (ring_key);
+
+    if (! ring)
+    {
+        ring = new Ring;
+
+        pthread_mutex_lock (& rings_mutex);
+        rings.append (ring);
+        pthread_mutex_unlock (& rings_mutex);
+
+        pthread_setspecific (ring_key, ring);
+    }
+
+    return ring;
+}
+
+/* for Debug and Info messages only */
+static void queue_record (Ring * ring, Level level, const char * file, int line,
+ const char * func, const char * format, va_list args)
+{
+    time_t now = time (nullptr);
+
+    if (now != ring->window)
+    {
+        ring->window = now;
+        ring->window_count = 0;
+    }
+
+    if (ring->window_count ++ >= RATE_LIMIT)
+    {
+        __sync_fetch_and_add (& ring->limited, 1);
+        return;
+    }
+
+    unsigned head = ring->head;
+
+    if (head - __sync_fetch_and_add (& ring->tail, 0) >= RING_SIZE)
+    {
+        __sync_fetch_and_add (& ring->dropped, 1);
+        return;
+    }
+
+    Record & rec = ring->records[head & (RING_SIZE - 1)];
+
+    rec.level = level;
+    rec.file = file;
+    rec.line = line;
+    rec.func = func;
+    rec.long_message = nullptr;
+
+    va_list args2;
+    va_copy (args2, args);
+
+    int len = vsnprintf (rec.message, INLINE_LEN, format, args);
+
+    if (len >= INLINE_LEN)
+    {
+        rec.long_message = (char *) malloc (len + 1);
+        vsnprintf (rec.long_message, len + 1, format, args2);
+    }
+
+    va_end (args2);
+
+    /* publish the record only after it is completely written */
+    __sync_synchronize ();
+    ring->head = head + 1;
+
+    if (__sync_bool_compare_and_swap (& idle, 1, 0))
+        pthread_cond_signal (& cond);
+}
+
+EXPORT void log (Level level, const char * file, int line, const char * func,
+ const char * format, ...)
+{
+    /* unlocked read; a stale value costs at most one message */
+    if (level < min_level)
+        return;
+
+    va_list args;
+    va_start (args, format);
+
+    Ring * ring = (level < Warning) ? get_ring () : nullptr;
+
+    if (ring)
+        queue_record (ring, level, file, line, func, format, args);
+    else
+    {
+        tiny_lock_read (& lock);
+
+        StringBuf message = str_vprintf (format, args);
+        dispatch (level, file, line, func, message);
+
+        tiny_unlock_read (& lock);
+    }
+
+    va_end (args);
 }
 
 } // namespace audlog
@@ -0,0 +1,297 @@
+/*
+ * mixer.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "mixer.h"
+#include "internal.h"
+
+#include <pthread.h>
+
+#include "audio.h"
+#include "ringbuf.h"
+#include "runtime.h"
+
+/* each stream buffers up to this much audio */
+#define BUFFER_SECS 2
+
+/* ducking fades the song in or out over this time */
+#define DUCK_RAMP_MS 50
+
+/*
+ * Audio is stored in each stream's own rate and channel layout, converted to
+ * floating point as it is written.  It is converted to the format of the song
+ * only when mixed, so that a stream can span several songs of different
+ * formats.  A stream with the same format as the song is mixed directly from
+ * its buffer; otherwise it is resampled by linear interpolation, which is
+ * adequate for speech and other incidental audio.  The mixing loops are kept
+ * simple enough for the compiler to vectorize.
+ */
+struct MixStream
+{
+    int format, rate, channels;
+    float gain, duck;
+    bool draining;
+
+    RingBuf<float> buffer;  // interleaved
+    double offset;          // resampling position, in frames from the head
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static Index<MixStream *> streams;
+static Index<float> convert_buf;
+static float duck_level = 1;  // current attenuation of the song
+
+EXPORT MixStream * aud_mix_open (int format, int rate, int channels, float gain, float duck)
+{
+    if (format < FMT_FLOAT || format > FMT_U24_3BE || rate < 1 || channels < 1 ||
+     channels > AUD_MAX_CHANNELS)
+        return nullptr;
+
+    auto stream = new MixStream ();
+    stream->format = format;
+    stream->rate = rate;
+    stream->channels = channels;
+    stream->gain = gain;
+    stream->duck = aud::clamp (duck, 0.0f, 1.0f);
+    stream->draining = false;
+    stream->offset = 0;
+
+    stream->buffer.alloc (rate * channels * BUFFER_SECS);
+
+    pthread_mutex_lock (& mutex);
+    streams.append (stream);
+    pthread_mutex_unlock (& mutex);
+
+    return stream;
+}
+
+EXPORT int aud_mix_write (MixStream * stream, const void * data, int size)
+{
+    pthread_mutex_lock (& mutex);
+
+    int samples = size / FMT_SIZEOF (stream->format);
+    samples = aud::min (samples, stream->buffer.space ());
+    samples -= samples % stream->channels;
+
+    if (stream->format == FMT_FLOAT)
+        stream->buffer.copy_in ((const float *) data, samples);
+    else
+    {
+        convert_buf.resize (samples);
+        audio_from_int (data, stream->format, convert_buf.begin (), samples);
+        stream->buffer.copy_in (convert_buf.begin (), samples);
+    }
+
+    pthread_mutex_unlock (& mutex);
+    return samples * FMT_SIZEOF (stream->format);
+}
+
+EXPORT int aud_mix_get_delay (MixStream * stream)
+{
+    pthread_mutex_lock (& mutex);
+    int frames = stream->buffer.len () / stream->channels;
+    int delay = aud::rescale (frames, stream->rate, 1000);
+    pthread_mutex_unlock (& mutex);
+    return delay;
+}
+
+EXPORT void aud_mix_set_gain (MixStream * stream, float gain, float duck)
+{
+    pthread_mutex_lock (& mutex);
+    stream->gain = gain;
+    stream->duck = aud::clamp (duck, 0.0f, 1.0f);
+    pthread_mutex_unlock (& mutex);
+}
+
+/* assumes mutex */
+static void remove_stream (MixStream * stream)
+{
+    for (int i = 0; i < streams.len (); i ++)
+    {
+        if (streams[i] == stream)
+        {
+            streams.remove (i, 1);
+            break;
+        }
+    }
+
+    delete stream;
+}
+
+EXPORT void aud_mix_close (MixStream * stream, bool drain)
+{
+    pthread_mutex_lock (& mutex);
+
+    if (drain && stream->buffer.len ())
+        stream->draining = true;
+    else
+        remove_stream (stream);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+static void mix_add (float * out, const float * in, int samples, float gain)
+{
+    for (int i = 0; i < samples; i ++)
+        out[i] += in[i] * gain;
+}
+
+/* stream has the same rate and channels as the song */
+static void mix_direct (MixStream * stream, float * data, int samples)
+{
+    samples = aud::min (samples, stream->buffer.len ());
+
+    int first = aud::min (samples, stream->buffer.linear ());
+    mix_add (data, & stream->buffer[0], first, stream->gain);
+
+    if (samples > first)
+        mix_add (data + first, & stream->buffer[first], samples - first, stream->gain);
+
+    stream->buffer.discard (samples);
+    stream->offset = 0;
+}
+
+/* returns channel <c> of the given frame, mapped to a song with <channels>
+ * channels: mono is copied to all channels, and mixed down from all channels;
+ * otherwise, channels are matched by position and any extra are dropped */
+static float get_sample (const MixStream * stream, int frame, int c, int channels)
+{
+    int sc = stream->channels;
+    int base = frame * sc;
+
+    if (sc == channels)
+        return stream->buffer[base + c];
+    if (sc == 1)
+        return stream->buffer[base];
+
+    if (channels == 1)
+    {
+        float sum = 0;
+        for (int i = 0; i < sc; i ++)
+            sum += stream->buffer[base + i];
+
+        return sum / sc;
+    }
+
+    return (c < sc) ? stream->buffer[base + c] : 0;
+}
+
+static void mix_resampled (MixStream * stream, float * data, int channels,
+ int rate, int frames)
+{
+    int avail = stream->buffer.len () / stream->channels;
+    double step = (double) stream->rate / rate;
+    double pos = stream->offset;
+
+    for (int i = 0; i < frames; i ++, pos += step)
+    {
+        int a = (int) pos;
+        if (a + 1 >= avail)
+            break;
+
+        float frac = pos - a;
+
+        for (int c = 0; c < channels; c ++)
+        {
+            float x = get_sample (stream, a, c, channels);
+            float y = get_sample (stream, a + 1, c, channels);
+            data[i * channels + c] += (x + (y - x) * frac) * stream->gain;
+        }
+    }
+
+    int used = aud::min ((int) pos, avail);
+    stream->buffer.discard (used * stream->channels);
+    stream->offset = pos - used;
+}
+
+static void apply_duck (float * data, int channels, int rate, int frames, float target)
+{
+    if (duck_level == 1 && target == 1)
+        return;
+
+    float step = 1000.0f / (DUCK_RAMP_MS * rate);
+
+    for (int i = 0; i < frames; i ++)
+    {
+        if (duck_level > target)
+            duck_level = aud::max (duck_level - step, target);
+        else if (duck_level < target)
+            duck_level = aud::min (duck_level + step, target);
+
+        for (int c = 0; c < channels; c ++)
+            data[i * channels + c] *= duck_level;
+    }
+}
+
+/* called from the output thread with the decoded (and replay gain adjusted)
+ * audio of the song, before it is passed to the effect plugins */
+void mixer_mix (Index<float> & data, int channels, int rate)
+{
+    pthread_mutex_lock (& mutex);
+
+    int frames = data.len () / channels;
+    float target = 1;
+
+    for (MixStream * stream : streams)
+    {
+        if (stream->buffer.len ())
+            target = aud::min (target, stream->duck);
+    }
+
+    apply_duck (data.begin (), channels, rate, frames, target);
+
+    for (int i = 0; i < streams.len ();)
+    {
+        MixStream * stream = streams[i];
+        bool direct = (stream->rate == rate && stream->channels == channels);
+
+        if (direct)
+            mix_direct (stream, data.begin (), data.len ());
+        else
+            mix_resampled (stream, data.begin (), channels, rate, frames);
+
+        /* a resampled stream always holds back its last frame */
+        int left = stream->buffer.len () / stream->channels;
+
+        if (stream->draining && left <= (direct ? 0 : 1))
+            remove_stream (stream);
+        else
+            i ++;
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void mixer_cleanup ()
+{
+    pthread_mutex_lock (& mutex);
+
+    for (MixStream * stream : streams)
+    {
+        if (! stream->draining)
+            AUDWARN ("A mix stream was not closed.\n");
+
+        delete stream;
+    }
+
+    streams.clear ();
+    convert_buf.clear ();
+    duck_level = 1;
+
+    pthread_mutex_unlock (& mutex);
+}
@@ -0,0 +1,64 @@
+/*
+ * mixer.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_MIXER_H
+#define LIBAUDCORE_MIXER_H
+
+/*
+ * Additional audio streams (announcements, jingles, etc.) can be mixed into
+ * the song being played.  Each stream is converted on the fly to the format of
+ * the song and mixed in before the effect plugins, so the effects, equalizer,
+ * and volume control apply to the mix as a whole.  Optionally, a stream can
+ * "duck" (lower the volume of) the song while it is playing.
+ *
+ * The song drives the output, so mix streams are only heard while a song is
+ * playing; otherwise, audio written to them is held until playback resumes.
+ *
+ * Limitations: this is not a crossfade (a stream cannot carry the end of one
+ * song over the start of the next), and it does not let several decoders run
+ * at once; the audio of a stream must be decoded by the caller.  With no song
+ * playing, streams are silent.
+ *
+ * These functions are thread-safe.
+ */
+
+struct MixStream;
+
+/* Opens a new stream.  <gain> is applied to the stream; while the stream has
+ * audio buffered, the song is attenuated by <duck> (1 = not at all).  Returns
+ * nullptr if the format is not valid. */
+MixStream * aud_mix_open (int format, int rate, int channels, float gain = 1,
+ float duck = 1);
+
+/* Adds audio to the stream without blocking.  Returns the number of bytes
+ * accepted, which may be fewer than <size> (or zero) if the stream's buffer
+ * is full; the caller should then retry later. */
+int aud_mix_write (MixStream * stream, const void * data, int size);
+
+/* Returns the amount of audio buffered in the stream, in milliseconds. */
+int aud_mix_get_delay (MixStream * stream);
+
+void aud_mix_set_gain (MixStream * stream, float gain, float duck);
+
+/* Closes the stream.  If <drain> is true, any audio still buffered is played
+ * first (the stream is freed automatically afterward); otherwise it is
+ * discarded.  The stream may not be used after this call in either case. */
+void aud_mix_close (MixStream * stream, bool drain);
+
+#endif /* LIBAUDCORE_MIXER_H */
@@ -24,6 +24,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <glib.h>
+
 #include "equalizer.h"
 #include "hook.h"
 #include "i18n.h"
@@ -91,12 +93,49 @@ static int in_format, in_channels, in_rate;
 static int effect_channels, effect_rate;
 static int sec_channels, sec_rate;
 static int out_format, out_channels, out_rate;
+static int req_format;  // format requested, before any fallback
 static int out_bytes_per_sec, out_bytes_held;
 static int64_t in_frames, out_bytes_written;
 static ReplayGainInfo gain_info;
 
 static Index<float> buffer1;
 static Index<char> buffer2;
+static Index<float> buffer3;
+
+/*
+ * The playback position is published by the output thread (and by any other
+ * thread that changes the output state) so that it can be read without taking
+ * any lock.  This is a sequence lock: <clock_seq> is odd while the snapshot is
+ * being written, and a reader retries if it was odd or changed while reading.
+ *
+ * Between updates, readers extrapolate from the time at which the snapshot was
+ * taken.  The device may run slightly faster or slower than the system clock,
+ * so the extrapolation is scaled by the rate at which the position actually
+ * advanced over recent updates (averaged to smooth out jitter in the delay
+ * reported by the output plugin).  The position is never extrapolated past
+ * the end of the audio written so far.
+ */
+struct PlaybackClock {
+    bool valid;         // input connected
+    bool running;       // output connected, not paused or flushed
+    int64_t stamp;      // g_get_monotonic_time() at the snapshot
+    int time;           // song position (ms) at the snapshot
+    int time_max;       // song position (ms) of the audio written so far
+    int raw_time;       // as returned by output_get_raw_time()
+    int raw_time_max;
+    float drift;        // device clock / system clock
+};
+
+static unsigned clock_seq;
+static PlaybackClock clock_snap;
+
+/* used only while publishing, under LOCK_MINOR */
+static int64_t drift_stamp;
+static int drift_time;
+static float drift_avg = 1;
+
+#define DRIFT_MIN_INTERVAL 200000  // microseconds
+#define DRIFT_SMOOTHING 0.1f
 
 static inline int get_format (bool & automatic)
 {
@@ -114,6 +153,14 @@ static inline int get_format (bool & automatic)
     }
 }
 
+/* if a fixed rate is set, the output device stays at that rate and the
+ * resampler converts to it; otherwise it follows the effects chain */
+static inline int get_rate ()
+{
+    int rate = aud_get_int (0, "output_sample_rate");
+    return (rate > 0) ? rate : effect_rate;
+}
+
 /* assumes LOCK_ALL, s_input */
 static void setup_effects ()
 {
@@ -121,7 +168,6 @@ static void setup_effects ()
     effect_rate = in_rate;
 
     effect_start (effect_channels, effect_rate);
-    eq_set_format (effect_channels, effect_rate);
 }
 
 /* assumes LOCK_ALL */
@@ -141,6 +187,8 @@ static void cleanup_output ()
 
     buffer1.clear ();
     buffer2.clear ();
+    buffer3.clear ();
+    resampler_flush ();
 
     cop->close_audio ();
     vis_runner_start_stop (false, false);
@@ -171,18 +219,52 @@ static void setup_output (bool new_input)
 
     bool automatic;
     int format = get_format (automatic);
+    int rate = get_rate ();
+    int channels = effect_channels;
+
+    /* rather than reopening the device, convert to the format already open,
+     * as far as allowed */
+    if (s_output && format == req_format && ! (new_input && cop->force_reopen))
+    {
+        auto keep_open = (OutputKeepOpen) aud_get_int (0, "output_keep_open");
+
+        /* a song needing more channels or a higher rate than the device is
+         * open with still reopens it, since converting the song down to fit
+         * would lose part of it */
+        if (keep_open == OutputKeepOpen::ConvertAll)
+        {
+            if (channels <= out_channels && rate <= out_rate)
+            {
+                channels = out_channels;
+                rate = out_rate;
+            }
+        }
+        else if (keep_open == OutputKeepOpen::ConvertRate && channels == out_channels)
+            rate = out_rate;
+    }
+
+    if (! resampler_set_format (channels, effect_rate, rate))
+    {
+        rate = effect_rate;
+        resampler_set_format (channels, effect_rate, rate);
+    }
 
-    AUDINFO ("Setup output, format %d, %d channels, %d Hz.\n", format, effect_channels, effect_rate);
+    /* the equalizer runs after the resampler */
+    eq_set_format (channels, rate);
 
-    if (s_output && format == out_format && effect_channels == out_channels &&
-     effect_rate == out_rate && ! (new_input && cop->force_reopen))
+    AUDINFO ("Setup output, format %d, %d channels, %d Hz.\n", format, channels, rate);
+
+    if (s_output && format == req_format && channels == out_channels &&
+     rate == out_rate && ! (new_input && cop->force_reopen))
         return;
 
     cleanup_output ();
     cop->set_info (in_filename, in_tuple);
 
+    req_format = format;
+
     String error;
-    while (! cop->open_audio (format, effect_rate, effect_channels, error))
+    while (! cop->open_audio (format, rate, channels, error))
     {
         if (automatic && format == FMT_FLOAT)
             format = FMT_S32_NE;
@@ -202,8 +284,8 @@ static void setup_output (bool new_input)
     s_output = true;
 
     out_format = format;
-    out_channels = effect_channels;
-    out_rate = effect_rate;
+    out_channels = channels;
+    out_rate = rate;
 
     out_bytes_per_sec = FMT_SIZEOF (format) * out_channels * out_rate;
     out_bytes_held = 0;
@@ -229,11 +311,17 @@ static void setup_secondary (bool new_input)
         rate = in_rate;
         channels = in_channels;
     }
-    else
+    else if (record_stream == OutputStream::AfterEffects || ! s_output)
     {
         rate = effect_rate;
         channels = effect_channels;
     }
+    else
+    {
+        /* after the resampler */
+        rate = out_rate;
+        channels = out_channels;
+    }
 
     if (s_secondary && channels == sec_channels && rate == sec_rate &&
      ! (new_input && sop->force_reopen))
@@ -255,12 +343,100 @@ static void setup_secondary (bool new_input)
     sec_rate = rate;
 }
 
+/* assumes LOCK_MINOR */
+static void publish_clock ()
+{
+    PlaybackClock snap = PlaybackClock ();
+    snap.stamp = g_get_monotonic_time ();
+    snap.drift = 1;
+
+    snap.running = s_output && ! s_paused && ! s_flushed && ! s_resetting;
+
+    int delay = 0;
+
+    if (s_output)
+    {
+        int device_delay = cop->get_delay ();
+
+        snap.raw_time_max = aud::rescale<int64_t> (out_bytes_written, out_bytes_per_sec, 1000);
+        snap.raw_time = aud::max (snap.raw_time_max - device_delay, 0);
+
+        delay = device_delay + aud::rescale<int64_t> (out_bytes_held, out_bytes_per_sec, 1000);
+        delay += resampler_get_delay ();
+    }
+
+    if (s_input)
+    {
+        int written = aud::rescale<int64_t> (in_frames, in_rate, 1000);
+        delay = effect_adjust_delay (delay);
+
+        snap.valid = true;
+        snap.time = seek_time + aud::max (written - delay, 0);
+        snap.time_max = seek_time + written;
+    }
+
+    /* estimate drift over intervals long enough for the device's reported
+     * delay to be meaningful; start over whenever the clock stops */
+    if (! snap.valid || ! snap.running || snap.time < drift_time)
+    {
+        drift_stamp = 0;
+        drift_avg = 1;
+    }
+    else if (! drift_stamp)
+    {
+        drift_stamp = snap.stamp;
+        drift_time = snap.time;
+    }
+    else if (snap.stamp - drift_stamp >= DRIFT_MIN_INTERVAL)
+    {
+        float ratio = (snap.time - drift_time) * 1000.0f / (snap.stamp - drift_stamp);
+        ratio = aud::clamp (ratio, 0.9f, 1.1f);
+
+        drift_avg += (ratio - drift_avg) * DRIFT_SMOOTHING;
+        drift_stamp = snap.stamp;
+        drift_time = snap.time;
+    }
+
+    snap.drift = drift_avg;
+
+    __sync_fetch_and_add (& clock_seq, 1);
+    clock_snap = snap;
+    __sync_fetch_and_add (& clock_seq, 1);
+}
+
+static PlaybackClock read_clock ()
+{
+    PlaybackClock snap;
+    unsigned seq;
+
+    do
+    {
+        seq = __sync_fetch_and_add (& clock_seq, 0);
+        snap = clock_snap;
+        __sync_synchronize ();
+    }
+    while ((seq & 1) || seq != __sync_fetch_and_add (& clock_seq, 0));
+
+    return snap;
+}
+
+/* milliseconds elapsed since the snapshot, as measured by the device */
+static int clock_elapsed (const PlaybackClock & snap)
+{
+    if (! snap.running)
+        return 0;
+
+    int64_t elapsed = g_get_monotonic_time () - snap.stamp;
+    return (int) (elapsed * snap.drift / 1000);
+}
+
 /* assumes LOCK_MINOR, s_output */
 static void flush_output ()
 {
     out_bytes_held = 0;
     out_bytes_written = 0;
 
+    resampler_flush ();
     cop->flush ();
     vis_runner_flush ();
 }
@@ -311,14 +487,25 @@ static void write_secondary (const Index<float> & data)
 }
 
 /* assumes LOCK_ALL, s_output */
-static void write_output (Index<float> & data)
+static void write_output (Index<float> & in, bool finish = false)
 {
+    if (s_secondary && record_stream == OutputStream::AfterEffects)
+        write_secondary (in);
+
+    Index<float> * converted = & in;
+
+    if (out_channels != effect_channels)
+    {
+        audio_remap_channels (in, effect_channels, buffer3, out_channels);
+        converted = & buffer3;
+    }
+
+    Index<float> & data = resampler_active () ?
+     resampler_process (* converted, finish) : * converted;
+
     if (! data.len ())
         return;
 
-    if (s_secondary && record_stream == OutputStream::AfterEffects)
-        write_secondary (data);
-
     int out_time = aud::rescale<int64_t> (out_bytes_written, out_bytes_per_sec, 1000);
     vis_runner_pass_audio (out_time, data, out_channels, out_rate);
 
@@ -355,6 +542,8 @@ static void write_output (Index<float> & data)
         out_bytes_held -= written;
         out_bytes_written += written;
 
+        publish_clock ();
+
         if (! out_bytes_held)
             break;
 
@@ -399,6 +588,8 @@ static bool process_audio (const void * data, int size, int stop_time)
     if (s_secondary && record_stream == OutputStream::AfterReplayGain)
         write_secondary (buffer1);
 
+    mixer_mix (buffer1, in_channels, in_rate);
+
     write_output (effect_process (buffer1));
 
     return ! stopped;
@@ -408,7 +599,7 @@ static bool process_audio (const void * data, int size, int stop_time)
 static void finish_effects (bool end_of_playlist)
 {
     buffer1.resize (0);
-    write_output (effect_finish (buffer1, end_of_playlist));
+    write_output (effect_finish (buffer1, end_of_playlist), end_of_playlist);
 }
 
 bool output_open_audio (const String & filename, const Tuple & tuple,
@@ -443,6 +634,8 @@ bool output_open_audio (const String & filename, const Tuple & tuple,
     if (aud_get_bool (0, "record"))
         setup_secondary (true);
 
+    publish_clock ();
+
     UNLOCK_ALL;
     return true;
 }
@@ -531,6 +724,8 @@ void output_flush (int time, bool force)
         in_frames = 0;
     }
 
+    publish_clock ();
+
     UNLOCK_MINOR;
 }
 
@@ -541,6 +736,8 @@ void output_resume ()
     if (s_input)
         s_flushed = false;
 
+    publish_clock ();
+
     UNLOCK_ALL;
 }
 
@@ -560,44 +757,26 @@ void output_pause (bool pause)
         }
     }
 
+    publish_clock ();
+
     UNLOCK_MINOR;
 }
 
+/* lock-free; see publish_clock() */
 int output_get_time ()
 {
-    LOCK_MINOR;
-    int time = 0, delay = 0;
-
-    if (s_input)
-    {
-        if (s_output)
-        {
-            delay = cop->get_delay ();
-            delay += aud::rescale<int64_t> (out_bytes_held, out_bytes_per_sec, 1000);
-        }
-
-        delay = effect_adjust_delay (delay);
-        time = aud::rescale<int64_t> (in_frames, in_rate, 1000);
-        time = seek_time + aud::max (time - delay, 0);
-    }
+    PlaybackClock snap = read_clock ();
+    if (! snap.valid)
+        return 0;
 
-    UNLOCK_MINOR;
-    return time;
+    return aud::min (snap.time + clock_elapsed (snap), snap.time_max);
 }
 
+/* lock-free; see publish_clock() */
 int output_get_raw_time ()
 {
-    LOCK_MINOR;
-    int time = 0;
-
-    if (s_output)
-    {
-        time = aud::rescale<int64_t> (out_bytes_written, out_bytes_per_sec, 1000);
-        time = aud::max (time - cop->get_delay (), 0);
-    }
-
-    UNLOCK_MINOR;
-    return time;
+    PlaybackClock snap = read_clock ();
+    return aud::min (snap.raw_time + clock_elapsed (snap), snap.raw_time_max);
 }
 
 void output_close_audio ()
@@ -614,6 +793,8 @@ void output_close_audio ()
             finish_effects (false); /* first time for end of song */
     }
 
+    publish_clock ();
+
     UNLOCK_ALL;
 }
 
@@ -630,6 +811,8 @@ void output_drain ()
         cleanup_secondary ();
     }
 
+    publish_clock ();
+
     UNLOCK_ALL;
 }
 
@@ -685,6 +868,8 @@ static void output_reset (OutputReset type, OutputPlugin * op)
     if (s_output && ! s_paused && ! s_flushed)
         SIGNAL_MINOR;
 
+    publish_clock ();
+
     UNLOCK_ALL;
 }
 
@@ -781,6 +966,8 @@ void output_init ()
 
 void output_cleanup ()
 {
+    resampler_cleanup ();
+
     hook_dissociate ("set record", record_settings_changed);
     hook_dissociate ("set record_stream", record_settings_changed);
 }
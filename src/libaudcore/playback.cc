@@ -39,6 +39,7 @@
 
 #include <assert.h>
 #include <pthread.h>
+#include <time.h>
 
 #include "audstrings.h"
 #include "hook.h"
@@ -102,6 +103,9 @@ static QueuedFunc end_queue;
 static bool song_finished = false;
 static int failed_entries = 0;
 
+static pthread_once_t sink_once = PTHREAD_ONCE_INIT;
+static pthread_key_t sink_key;
+
 static void lock ()
     { pthread_mutex_lock (& mutex); }
 static void unlock ()
@@ -137,6 +141,127 @@ bool playback_check_serial (int serial)
     return okay;
 }
 
+static void create_sink_key ()
+    { pthread_key_create (& sink_key, nullptr); }
+
+// any thread: redirects input plugin calls made from the calling thread
+void playback_set_decode_sink (DecodeSink * sink)
+{
+    pthread_once (& sink_once, create_sink_key);
+    pthread_setspecific (sink_key, sink);
+}
+
+static DecodeSink * get_decode_sink ()
+{
+    pthread_once (& sink_once, create_sink_key);
+    return (DecodeSink *) pthread_getspecific (sink_key);
+}
+
+// Input plugins are not required to be reentrant.  Unless a plugin sets
+// FlagReentrant, it is never run by more than one thread at once, whether for
+// playback or for decoding outside of playback.  Playback takes priority: when
+// it needs the plugin, the other user is asked to stop through check_stop(),
+// and playback waits until it has done so.
+static pthread_mutex_t decoder_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t decoder_cond = PTHREAD_COND_INITIALIZER;
+static InputPlugin * playing_decoder;
+static Index<InputPlugin *> borrowed_decoders;
+
+static bool is_borrowed (InputPlugin * ip)
+{
+    for (InputPlugin * borrowed : borrowed_decoders)
+    {
+        if (borrowed == ip)
+            return true;
+    }
+
+    return false;
+}
+
+static bool is_exclusive (InputPlugin * ip)
+    { return ! (ip->input_info.flags & InputPlugin::FlagReentrant); }
+
+// playback thread
+static void claim_decoder (InputPlugin * ip)
+{
+    pthread_mutex_lock (& decoder_mutex);
+
+    playing_decoder = ip;
+    while (is_exclusive (ip) && is_borrowed (ip))
+        pthread_cond_wait (& decoder_cond, & decoder_mutex);
+
+    pthread_mutex_unlock (& decoder_mutex);
+}
+
+// playback thread
+static void unclaim_decoder ()
+{
+    pthread_mutex_lock (& decoder_mutex);
+    playing_decoder = nullptr;
+    pthread_cond_broadcast (& decoder_cond);
+    pthread_mutex_unlock (& decoder_mutex);
+}
+
+// any thread: waits until the plugin is not being used for playback or by
+// another borrower; returns false if <cancelled> returned true first
+bool playback_borrow_decoder (InputPlugin * ip, bool (* cancelled) (void *), void * data)
+{
+    pthread_mutex_lock (& decoder_mutex);
+
+    while (is_exclusive (ip) && (playing_decoder == ip || is_borrowed (ip)))
+    {
+        pthread_mutex_unlock (& decoder_mutex);
+
+        if (cancelled (data))
+            return false;
+
+        pthread_mutex_lock (& decoder_mutex);
+
+        timespec until;
+        clock_gettime (CLOCK_REALTIME, & until);
+        until.tv_sec ++;
+
+        pthread_cond_timedwait (& decoder_cond, & decoder_mutex, & until);
+    }
+
+    borrowed_decoders.append (ip);
+
+    pthread_mutex_unlock (& decoder_mutex);
+    return true;
+}
+
+// any thread: returns true if playback needed the plugin in the meantime, in
+// which case the decoding was probably cut short and should be retried
+bool playback_return_decoder (InputPlugin * ip)
+{
+    pthread_mutex_lock (& decoder_mutex);
+
+    bool wanted = (playing_decoder == ip && is_exclusive (ip));
+
+    for (int i = 0; i < borrowed_decoders.len (); i ++)
+    {
+        if (borrowed_decoders[i] == ip)
+        {
+            borrowed_decoders.remove (i, 1);
+            break;
+        }
+    }
+
+    pthread_cond_broadcast (& decoder_cond);
+
+    pthread_mutex_unlock (& decoder_mutex);
+    return wanted;
+}
+
+// any thread: true if playback is waiting for a borrowed plugin
+bool playback_decoder_wanted (InputPlugin * ip)
+{
+    pthread_mutex_lock (& decoder_mutex);
+    bool wanted = (playing_decoder == ip && is_exclusive (ip));
+    pthread_mutex_unlock (& decoder_mutex);
+    return wanted;
+}
+
 // called from the playlist to update the tuple for the current song
 void playback_set_info (int entry, Tuple && tuple)
 {
@@ -325,6 +450,8 @@ static void run_playback ()
 
     unlock ();
 
+    claim_decoder (dec.ip);
+
     while (1)
     {
         // hand off control to input plugin
@@ -359,6 +486,8 @@ static void run_playback ()
             break;
         }
     }
+
+    unclaim_decoder ();
 }
 
 // playback thread helper
@@ -494,6 +623,9 @@ EXPORT void aud_drct_seek (int time)
 
 EXPORT void InputPlugin::open_audio (int format, int rate, int channels)
 {
+    if (auto sink = get_decode_sink ())
+        return sink->open_audio (format, rate, channels);
+
     // don't open audio if playback thread is lagging
     if (! lock_if (in_sync))
         return;
@@ -527,6 +659,9 @@ EXPORT void InputPlugin::open_audio (int format, int rate, int channels)
 
 EXPORT void InputPlugin::set_replay_gain (const ReplayGainInfo & gain)
 {
+    if (get_decode_sink ())
+        return;
+
     lock ();
     pb_info.gain = gain;
     pb_info.gain_valid = true;
@@ -539,6 +674,9 @@ EXPORT void InputPlugin::set_replay_gain (const ReplayGainInfo & gain)
 
 EXPORT void InputPlugin::write_audio (const void * data, int length)
 {
+    if (auto sink = get_decode_sink ())
+        return sink->write_audio (data, length);
+
     if (! lock_if (in_sync))
         return;
 
@@ -574,9 +712,16 @@ EXPORT void InputPlugin::write_audio (const void * data, int length)
 
 EXPORT Tuple InputPlugin::get_playback_tuple ()
 {
-    lock ();
-    Tuple tuple = pb_info.tuple.ref ();
-    unlock ();
+    Tuple tuple;
+
+    if (auto sink = get_decode_sink ())
+        tuple = sink->get_tuple ();
+    else
+    {
+        lock ();
+        tuple = pb_info.tuple.ref ();
+        unlock ();
+    }
 
     // tuples passed to us from input plugins do not have fallback fields
     // generated; for consistency, tuples passed back should not either
@@ -586,6 +731,9 @@ EXPORT Tuple InputPlugin::get_playback_tuple ()
 
 EXPORT void InputPlugin::set_playback_tuple (Tuple && tuple)
 {
+    if (get_decode_sink ())
+        return;
+
     // due to mutex ordering, we cannot call into the playlist while locked;
     // instead, playback_entry_set_tuple() calls back into first
     // playback_check_serial() and then eventually playback_set_info()
@@ -594,6 +742,9 @@ EXPORT void InputPlugin::set_playback_tuple (Tuple && tuple)
 
 EXPORT void InputPlugin::set_stream_bitrate (int bitrate)
 {
+    if (get_decode_sink ())
+        return;
+
     lock ();
     pb_info.bitrate = bitrate;
 
@@ -605,6 +756,9 @@ EXPORT void InputPlugin::set_stream_bitrate (int bitrate)
 
 EXPORT bool InputPlugin::check_stop ()
 {
+    if (auto sink = get_decode_sink ())
+        return sink->check_stop ();
+
     lock ();
     bool stop = ! is_ready () || pb_info.ended || pb_info.error;
     unlock ();
@@ -613,6 +767,9 @@ EXPORT bool InputPlugin::check_stop ()
 
 EXPORT int InputPlugin::check_seek ()
 {
+    if (get_decode_sink ())
+        return -1;
+
     lock ();
     int seek = -1;
 
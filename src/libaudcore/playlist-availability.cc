@@ -0,0 +1,438 @@
+/*
+ * playlist-availability.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "playlist-internal.h"
+#include "internal.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <glib.h>  /* for GThreadPool */
+
+#include "audstrings.h"
+#include "i18n.h"
+#include "mainloop.h"
+#include "multihash.h"
+#include "runtime.h"
+#include "vfs.h"
+
+/* checking is I/O-bound, so more threads are used than for gain analysis,
+ * but not so many as to overload a network file server */
+#define CHECK_THREADS 8
+
+/* a folder is listed instead of testing each file only if it contains at
+ * least this many entries */
+#define LIST_FOLDER_MIN 2
+
+/*
+ * Entries are grouped by folder.  For local files, each folder is listed
+ * once (a single round trip, even over NFS) and the entries are looked up in
+ * the listing rather than testing each file separately.  Listings are cached
+ * between checks, and reused as long as the folder's modification time has
+ * not changed.  Entries not found in a listing are tested separately before
+ * being removed, in case the file system is case-insensitive or similar.
+ * Other URIs are tested one by one with VFSFile::test_file().
+ */
+struct CheckFolder
+{
+    String path;          // local path of the folder, or null for other URIs
+    Index<int> rows;      // entries in the folder
+    Index<String> names;  // local file names of the entries, if path is set
+};
+
+struct FolderListing
+{
+    time_t mtime, listed_at;
+    Index<String> names;  // sorted with strcmp()
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static GThreadPool * pool;
+
+static Playlist playlist;
+static Playlist::Snapshot rows;
+static Index<CheckFolder> folders;
+static Index<bool> missing;  // one per row
+static int jobs_pending, rows_done;
+static bool session_active, cancelled;
+
+static SimpleHash<String, FolderListing> listing_cache;
+
+static Progress progress ("Checking");
+static QueuedFunc queued_done;
+
+static bool check_cancelled ()
+{
+    pthread_mutex_lock (& mutex);
+    bool stop = cancelled;
+    pthread_mutex_unlock (& mutex);
+    return stop;
+}
+
+/* assumes mutex */
+static void status_update_locked (const char * path)
+{
+    char scratch[128];
+    snprintf (scratch, sizeof scratch, _("%d of %d files checked"),
+     rows_done, rows.len ());
+
+    progress.update (path, scratch);
+}
+
+static void add_done (int n_rows)
+{
+    pthread_mutex_lock (& mutex);
+    rows_done += n_rows;
+    status_update_locked (nullptr);
+    pthread_mutex_unlock (& mutex);
+}
+
+/* use VFS_NO_ACCESS since VFS_EXISTS doesn't distinguish between
+ * inaccessible files and URI schemes that don't support file_test() */
+static void test_rows (const CheckFolder & folder)
+{
+    for (int row : folder.rows)
+    {
+        if (check_cancelled ())
+            return;
+
+        missing[row] = VFSFile::test_file (rows[row].filename, VFS_NO_ACCESS);
+        add_done (1);
+    }
+}
+
+static bool read_listing (const char * path, FolderListing & listing)
+{
+    DIR * dir = opendir (path);
+    if (! dir)
+        return false;
+
+    struct dirent * entry;
+    while ((entry = readdir (dir)))
+        listing.names.append (entry->d_name);
+
+    closedir (dir);
+
+    listing.names.sort ([] (const String & a, const String & b)
+        { return strcmp (a, b); });
+
+    return true;
+}
+
+static void lookup_names (FolderListing & listing,
+ const CheckFolder & folder, Index<bool> & found)
+{
+    for (int i = 0; i < folder.names.len (); i ++)
+    {
+        found[i] = listing.names.bsearch ((const char *) folder.names[i],
+         [] (const char * key, const String & name)
+            { return strcmp (key, name); }) >= 0;
+    }
+}
+
+/* looks up the names in a cached listing of the folder, or returns false if
+ * there is no valid listing in the cache */
+static bool lookup_cached (const CheckFolder & folder, time_t mtime, Index<bool> & found)
+{
+    pthread_mutex_lock (& mutex);
+
+    FolderListing * listing = listing_cache.lookup (folder.path);
+    bool valid = listing && listing->mtime == mtime;
+
+    if (valid)
+        lookup_names (* listing, folder, found);
+
+    pthread_mutex_unlock (& mutex);
+    return valid;
+}
+
+static void check_folder (const CheckFolder & folder)
+{
+    if (! folder.path || folder.rows.len () < LIST_FOLDER_MIN)
+    {
+        test_rows (folder);
+        return;
+    }
+
+    struct stat info;
+    if (stat (folder.path, & info) < 0)
+    {
+        /* the whole folder is gone; otherwise fall back to testing the files */
+        if (errno == ENOENT || errno == ENOTDIR)
+        {
+            for (int row : folder.rows)
+                missing[row] = true;
+
+            add_done (folder.rows.len ());
+        }
+        else
+            test_rows (folder);
+
+        return;
+    }
+
+    Index<bool> found;
+    found.insert (0, folder.names.len ());
+
+    if (! lookup_cached (folder, info.st_mtime, found))
+    {
+        FolderListing listing;
+        listing.mtime = info.st_mtime;
+        listing.listed_at = time (nullptr);
+
+        if (! read_listing (folder.path, listing))
+        {
+            test_rows (folder);
+            return;
+        }
+
+        lookup_names (listing, folder, found);
+
+        /* a listing taken in the same second as the last modification may
+         * have missed a later change within that second, so it would not be
+         * safe to reuse */
+        if (listing.listed_at > listing.mtime)
+        {
+            pthread_mutex_lock (& mutex);
+            listing_cache.add (folder.path, std::move (listing));
+            pthread_mutex_unlock (& mutex);
+        }
+    }
+
+    for (int i = 0; i < folder.rows.len (); i ++)
+    {
+        if (check_cancelled ())
+            return;
+
+        int row = folder.rows[i];
+
+        if (found[i])
+            missing[row] = false;
+        else
+            missing[row] = VFSFile::test_file (rows[row].filename, VFS_NO_ACCESS);
+    }
+
+    add_done (folder.rows.len ());
+}
+
+static void remove_missing ()
+{
+    if (! playlist.exists ())
+        return;
+
+    /* the playlist may have been changed during the check, so the entries
+     * are found again by filename */
+    SimpleHash<String, bool> missing_names;
+
+    for (int i = 0; i < rows.len (); i ++)
+    {
+        if (missing[i])
+            missing_names.add (rows[i].filename, true);
+    }
+
+    if (! missing_names.n_items ())
+        return;
+
+    AUDINFO ("Removing %d unavailable files.\n", missing_names.n_items ());
+
+    auto current = playlist.snapshot ();
+
+    playlist.select_all (false);
+
+    for (int i = 0; i < current.len (); i ++)
+    {
+        if (missing_names.lookup (current[i].filename))
+            playlist.select_entry (i, true);
+    }
+
+    playlist.remove_selected ();
+}
+
+static void done_cb (void *)
+{
+    progress.done ();
+
+    pthread_mutex_lock (& mutex);
+
+    bool finished = ! cancelled;
+
+    pthread_mutex_unlock (& mutex);
+
+    /* the workers are done, so the results can be used without locking */
+    if (finished)
+        remove_missing ();
+    else
+        AUDINFO ("Check for unavailable files cancelled.\n");
+
+    pthread_mutex_lock (& mutex);
+
+    playlist = Playlist ();
+    rows = Playlist::Snapshot ();
+    folders.clear ();
+    missing.clear ();
+    session_active = false;
+
+    pthread_mutex_unlock (& mutex);
+}
+
+static void check_worker (void * data, void *)
+{
+    auto & folder = * (CheckFolder *) data;
+
+    pthread_mutex_lock (& mutex);
+    bool skip = cancelled;
+    status_update_locked (folder.path ? (const char *) folder.path :
+     (const char *) rows[folder.rows[0]].filename);
+    pthread_mutex_unlock (& mutex);
+
+    if (! skip)
+        check_folder (folder);
+
+    pthread_mutex_lock (& mutex);
+
+    if (! (-- jobs_pending))
+        queued_done.queue (done_cb, nullptr);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+/* splits the entries into folders; does not access the file system */
+static Index<CheckFolder> group_by_folder (const Playlist::Snapshot & snap)
+{
+    Index<CheckFolder> groups;
+    SimpleHash<String, int> group_of_path;
+    int other = -1;  // entries which are not local files
+
+    for (int i = 0; i < snap.len (); i ++)
+    {
+        StringBuf path = uri_to_filename (strip_subtune (snap[i].filename));
+        const char * slash = path ? strrchr (path, G_DIR_SEPARATOR) : nullptr;
+
+        if (! slash)
+        {
+            if (other < 0)
+            {
+                other = groups.len ();
+                groups.append ();
+            }
+
+            groups[other].rows.append (i);
+            continue;
+        }
+
+        String dir (str_copy (path, slash - path));
+        int * index = group_of_path.lookup (dir);
+
+        if (! index)
+        {
+            index = group_of_path.add (dir, groups.len ());
+            groups.append ().path = dir;
+        }
+
+        groups[* index].rows.append (i);
+        groups[* index].names.append (slash + 1);
+    }
+
+    return groups;
+}
+
+EXPORT void Playlist::remove_unavailable () const
+{
+    if (unavailable_check_in_progress ())
+    {
+        AUDWARN ("A check for unavailable files is already in progress.\n");
+        return;
+    }
+
+    Snapshot snap = snapshot ();
+    if (! snap.len ())
+        return;
+
+    Index<CheckFolder> groups = group_by_folder (snap);
+
+    pthread_mutex_lock (& mutex);
+
+    if (session_active)
+    {
+        pthread_mutex_unlock (& mutex);
+        return;
+    }
+
+    if (! pool)
+        pool = g_thread_pool_new (check_worker, nullptr, CHECK_THREADS, false, nullptr);
+
+    playlist = * this;
+    rows = std::move (snap);
+    folders = std::move (groups);
+    missing.insert (0, rows.len ());
+
+    session_active = true;
+    cancelled = false;
+    rows_done = 0;
+    jobs_pending = folders.len ();
+
+    /* the folders index is not modified again until the session is done */
+    for (auto & folder : folders)
+        g_thread_pool_push (pool, & folder, nullptr);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+EXPORT bool Playlist::unavailable_check_in_progress ()
+{
+    pthread_mutex_lock (& mutex);
+    bool in_progress = session_active;
+    pthread_mutex_unlock (& mutex);
+    return in_progress;
+}
+
+EXPORT void Playlist::cancel_unavailable_check ()
+{
+    pthread_mutex_lock (& mutex);
+    cancelled = true;
+    pthread_mutex_unlock (& mutex);
+}
+
+void playlist_availability_cleanup ()
+{
+    if (pool)
+    {
+        Playlist::cancel_unavailable_check ();
+
+        g_thread_pool_free (pool, false, true);
+        pool = nullptr;
+    }
+
+    progress.done ();
+    queued_done.stop ();
+
+    playlist = Playlist ();
+    rows = Playlist::Snapshot ();
+    folders.clear ();
+    missing.clear ();
+    jobs_pending = 0;
+    session_active = false;
+
+    listing_cache.clear ();
+}
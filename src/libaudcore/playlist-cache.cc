@@ -31,19 +31,10 @@ EXPORT void Playlist::cache_selected () const
 {
     pthread_mutex_lock (& mutex);
 
-    int entries = n_entries ();
-
-    for (int i = 0; i < entries; i ++)
+    for (auto & row : snapshot ())
     {
-        if (! entry_selected (i))
-            continue;
-
-        String filename = entry_filename (i);
-        Tuple tuple = entry_tuple (i, NoWait);
-        PluginHandle * decoder = entry_decoder (i, NoWait);
-
-        if (tuple.valid () || decoder)
-            cache.add (filename, {filename, std::move (tuple), decoder});
+        if (row.selected && (row.tuple.valid () || row.decoder))
+            cache.add (row.filename, {row.filename, row.tuple.ref (), row.decoder});
     }
 
     clear_timer.queue (30000, playlist_cache_clear, nullptr);
@@ -19,6 +19,7 @@
 
 #include "playlist-data.h"
 
+#include <limits.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -37,14 +38,22 @@ struct PlaylistEntry
     void format ();
     void set_tuple (Tuple && new_tuple);
 
+    int number () const
+        { return chunk ? chunk->start + chunk_pos : -1; }
+
     String filename;
     PluginHandle * decoder;
     Tuple tuple;
     String error;
-    int number;
+    PlaylistData::EntryChunk * chunk;
+    int chunk_pos;
     int length;
-    int shuffle_num;
     bool selected, queued;
+
+    /* Each entry is either in the shuffle pool (not yet played) or linked
+     * into the shuffle history (played, in order of playback). */
+    int pool_pos;  // -1 if in the history
+    PlaylistEntry * history_prev, * history_next;
 };
 
 void PlaylistEntry::format ()
@@ -83,11 +92,14 @@ void PlaylistEntry::set_tuple (Tuple && new_tuple)
 PlaylistEntry::PlaylistEntry (PlaylistAddItem && item) :
     filename (item.filename),
     decoder (item.decoder),
-    number (-1),
+    chunk (nullptr),
+    chunk_pos (0),
     length (0),
-    shuffle_num (0),
     selected (false),
-    queued (false)
+    queued (false),
+    pool_pos (-1),
+    history_prev (nullptr),
+    history_next (nullptr)
 {
     set_tuple (std::move (item.tuple));
 }
@@ -118,22 +130,234 @@ PlaylistData::PlaylistData (Playlist::ID * id, const char * title) :
     m_position (nullptr),
     m_focus (nullptr),
     m_selected_count (0),
-    m_last_shuffle_num (0),
+    m_history_head (nullptr),
+    m_history_tail (nullptr),
     m_total_length (0),
     m_selected_length (0),
     m_last_update (),
     m_next_update (),
-    m_position_changed (false) {}
+    m_journal_len (0),
+    m_position_changed (false),
+    m_sort_serial (0) {}
 
 PlaylistData::~PlaylistData ()
 {
     pl_signal_playlist_deleted (m_id);
 }
 
+#define CHUNK_SIZE 256
+
+int PlaylistData::EntryList::find_chunk (int i) const
+{
+    int low = 0, high = m_chunks.len () - 1;
+
+    while (low < high)
+    {
+        int mid = (low + high + 1) / 2;
+        if (m_chunks[mid]->start <= i)
+            low = mid;
+        else
+            high = mid - 1;
+    }
+
+    return low;
+}
+
+void PlaylistData::EntryList::renumber_chunk (int c)
+{
+    EntryChunk * chunk = m_chunks[c].get ();
+
+    for (int i = 0; i < chunk->entries.len (); i ++)
+    {
+        PlaylistEntry * entry = chunk->entries[i].get ();
+        if (entry)
+        {
+            entry->chunk = chunk;
+            entry->chunk_pos = i;
+        }
+    }
+}
+
+void PlaylistData::EntryList::update_starts (int c)
+{
+    int start = c ? m_chunks[c - 1]->start + m_chunks[c - 1]->entries.len () : 0;
+
+    for (; c < m_chunks.len (); c ++)
+    {
+        m_chunks[c]->start = start;
+        start += m_chunks[c]->entries.len ();
+    }
+
+    m_last_chunk = 0;
+}
+
+/* breaks up an oversized chunk into pieces of CHUNK_SIZE */
+void PlaylistData::EntryList::split_chunk (int c)
+{
+    EntryChunk * chunk = m_chunks[c].get ();
+    int len = chunk->entries.len ();
+
+    Index<SmartPtr<EntryChunk>> pieces;
+
+    for (int from = CHUNK_SIZE; from < len; from += CHUNK_SIZE)
+    {
+        auto piece = new EntryChunk ();
+        piece->start = 0;
+        piece->entries.move_from (chunk->entries, from, 0,
+         aud::min (CHUNK_SIZE, len - from), true, false);
+
+        pieces.append (piece);
+    }
+
+    chunk->entries.remove (CHUNK_SIZE, -1);
+    int n_pieces = pieces.len ();
+    m_chunks.move_from (pieces, 0, c + 1, -1, true, true);
+
+    for (int i = c; i <= c + n_pieces; i ++)
+        renumber_chunk (i);
+}
+
+/* joins a chunk with the one following it, if both are small enough */
+void PlaylistData::EntryList::merge_chunks (int c)
+{
+    if (c < 0 || c + 1 >= m_chunks.len ())
+        return;
+
+    EntryChunk * chunk = m_chunks[c].get ();
+    EntryChunk * next = m_chunks[c + 1].get ();
+
+    if (chunk->entries.len () + next->entries.len () > CHUNK_SIZE)
+        return;
+
+    chunk->entries.move_from (next->entries, 0, -1, -1, true, true);
+    m_chunks.remove (c + 1, 1);
+
+    renumber_chunk (c);
+}
+
+void PlaylistData::EntryList::insert (int at, int count)
+{
+    if (count <= 0)
+        return;
+
+    if (! m_chunks.len ())
+    {
+        auto chunk = new EntryChunk ();
+        chunk->start = 0;
+        m_chunks.append (chunk);
+    }
+
+    int c = (at < m_len) ? find_chunk (at) : m_chunks.len () - 1;
+    EntryChunk * chunk = m_chunks[c].get ();
+
+    chunk->entries.insert (at - chunk->start, count);
+    m_len += count;
+
+    if (chunk->entries.len () > 2 * CHUNK_SIZE)
+        split_chunk (c);
+    else
+        renumber_chunk (c);
+
+    update_starts (c);
+}
+
+void PlaylistData::EntryList::remove (int at, int count)
+{
+    if (count <= 0)
+        return;
+
+    int first = find_chunk (at);
+    int c = first;
+
+    /* chunk starts are not updated until the end, so at is
+     * only meaningful relative to the first chunk */
+    int offset = at - m_chunks[c]->start;
+
+    while (count > 0)
+    {
+        EntryChunk * chunk = m_chunks[c].get ();
+        int n = aud::min (count, chunk->entries.len () - offset);
+
+        chunk->entries.remove (offset, n);
+        count -= n;
+        m_len -= n;
+        offset = 0;
+
+        if (chunk->entries.len ())
+            renumber_chunk (c ++);
+        else
+            m_chunks.remove (c, 1);
+    }
+
+    /* avoid accumulating tiny chunks at the edges of the removed range */
+    merge_chunks (first);
+    merge_chunks (first - 1);
+
+    update_starts (aud::max (first - 1, 0));
+}
+
+void PlaylistData::EntryList::renumber (int at, int count)
+{
+    if (count <= 0)
+        return;
+
+    for (int c = find_chunk (at); c < m_chunks.len (); c ++)
+    {
+        EntryChunk * chunk = m_chunks[c].get ();
+        if (chunk->start >= at + count)
+            break;
+
+        int first = aud::max (at - chunk->start, 0);
+        int last = aud::min (at + count - chunk->start, chunk->entries.len ());
+
+        for (int i = first; i < last; i ++)
+        {
+            PlaylistEntry * entry = chunk->entries[i].get ();
+            entry->chunk = chunk;
+            entry->chunk_pos = i;
+        }
+    }
+}
+
+auto PlaylistData::EntryList::take_all () -> Index<EntryPtr>
+{
+    Index<EntryPtr> entries;
+
+    for (auto & chunk : m_chunks)
+        entries.move_from (chunk->entries, 0, -1, -1, true, true);
+
+    m_chunks.clear ();
+    m_len = 0;
+    m_last_chunk = 0;
+
+    return entries;
+}
+
+void PlaylistData::EntryList::assign (Index<EntryPtr> && entries)
+{
+    m_chunks.clear ();
+    m_len = entries.len ();
+    m_last_chunk = 0;
+
+    if (! m_len)
+        return;
+
+    auto chunk = new EntryChunk ();
+    chunk->start = 0;
+    chunk->entries = std::move (entries);
+    m_chunks.append (chunk);
+
+    if (m_len > 2 * CHUNK_SIZE)
+        split_chunk (0);
+    else
+        renumber_chunk (0);
+
+    update_starts (0);
+}
+
 void PlaylistData::number_entries (int at, int length)
 {
-    for (int i = at; i < at + length; i ++)
-        m_entries[i]->number = i;
+    m_entries.renumber (at, length);
 }
 
 PlaylistEntry * PlaylistData::entry_at (int i)
@@ -146,6 +370,11 @@ const PlaylistEntry * PlaylistData::entry_at (int i) const
     return (i >= 0 && i < m_entries.len ()) ? m_entries[i].get () : nullptr;
 }
 
+int PlaylistData::entry_number (const PlaylistEntry * entry)
+{
+    return entry->number ();
+}
+
 String PlaylistData::entry_filename (int i) const
 {
     auto entry = entry_at (i);
@@ -166,6 +395,23 @@ Tuple PlaylistData::entry_tuple (int i, String * error) const
     return entry ? entry->tuple.ref () : Tuple ();
 }
 
+void PlaylistData::get_rows (int at, int number, Index<Playlist::Snapshot::Row> & rows) const
+{
+    rows.insert (0, number);
+
+    for (int i = 0; i < number; i ++)
+    {
+        const PlaylistEntry * entry = m_entries[at + i].get ();
+        Playlist::Snapshot::Row & row = rows[i];
+
+        row.filename = entry->filename;
+        row.tuple = entry->tuple.ref ();
+        row.decoder = entry->decoder;
+        row.selected = entry->selected;
+        row.queued = entry->queued;
+    }
+}
+
 void PlaylistData::set_entry_tuple (PlaylistEntry * entry, Tuple && tuple)
 {
     m_total_length -= entry->length;
@@ -197,9 +443,121 @@ void PlaylistData::queue_update (Playlist::UpdateLevel level, int at, int count,
     if ((flags & QueueChanged))
         m_next_update.queue_changed = true;
 
+    journal_update (level, at, count);
+
+    /* invalidate any sort in progress */
+    if (level == Playlist::Structure)
+        m_sort_serial ++;
+
     pl_signal_update_queued (m_id, level, flags);
 }
 
+/* beyond this, the closest ranges are merged (which is always correct,
+ * though less precise) */
+#define MAX_UPDATE_RANGES 64
+
+/* Records a change in the update journal.  Every change that adds or
+ * removes entries is recorded right after it is made, so the number of
+ * entries added or removed can be found from the change in length. */
+void PlaylistData::journal_update (Playlist::UpdateLevel level, int at, int count)
+{
+    int delta = m_entries.len () - m_journal_len;
+    m_journal_len = m_entries.len ();
+
+    if (! count && ! delta)
+        return;
+
+    /* the affected range ends at old_end before this change, end after it */
+    int old_end = at + count - delta;
+    int end = at + count;
+
+    Playlist::UpdateRange merged = {level, at, count, 0};
+    int covered = 0, covered_old = 0;
+
+    Index<Playlist::UpdateRange> ranges;
+    int n_before = 0;
+
+    for (auto & range : m_next_ranges)
+    {
+        int range_end = range.at + range.count;
+
+        if (range.at < old_end && range_end > at)
+        {
+            /* overlaps with this change; fold it in */
+            merged.level = aud::max (merged.level, range.level);
+            merged.at = aud::min (merged.at, range.at);
+            end = aud::max (end, range_end + delta);
+            covered += range.count;
+            covered_old += range.old_count;
+        }
+        else if (range_end <= at)
+        {
+            ranges.append (range);
+            n_before ++;
+        }
+        else
+        {
+            auto & shifted = ranges.append (range);
+            shifted.at += delta;
+        }
+    }
+
+    /* rows of the merged range not covered by an earlier range have not
+     * changed since the journal was started */
+    merged.count = end - merged.at;
+    merged.old_count = (end - delta - merged.at) - covered + covered_old;
+
+    /* insert in order, then join adjacent ranges of the same level */
+    ranges.insert (n_before, 1);
+    ranges[n_before] = merged;
+
+    for (int i = 0; i + 1 < ranges.len (); )
+    {
+        auto & a = ranges[i], & b = ranges[i + 1];
+
+        if (a.at + a.count == b.at && a.level == b.level)
+        {
+            a.count += b.count;
+            a.old_count += b.old_count;
+            ranges.remove (i + 1, 1);
+        }
+        else
+            i ++;
+    }
+
+    /* if there are too many ranges, merge those closest together */
+    while (ranges.len () > MAX_UPDATE_RANGES)
+    {
+        int best = 0;
+        int best_gap = INT_MAX;
+
+        for (int i = 0; i + 1 < ranges.len (); i ++)
+        {
+            int gap = ranges[i + 1].at - (ranges[i].at + ranges[i].count);
+            if (gap < best_gap)
+            {
+                best = i;
+                best_gap = gap;
+            }
+        }
+
+        auto & a = ranges[best], & b = ranges[best + 1];
+        a.level = aud::max (a.level, b.level);
+        a.count += best_gap + b.count;
+        a.old_count += best_gap + b.old_count;
+        ranges.remove (best + 1, 1);
+    }
+
+    m_next_ranges = std::move (ranges);
+}
+
+Index<Playlist::UpdateRange> PlaylistData::last_ranges () const
+{
+    Index<Playlist::UpdateRange> ranges;
+    ranges.insert (m_last_ranges.begin (), 0, m_last_ranges.len ());
+    return ranges;
+}
+
 void PlaylistData::queue_position_change ()
 {
     m_position_changed = true;
@@ -210,6 +568,9 @@ void PlaylistData::cancel_updates ()
 {
     m_last_update = Playlist::Update ();
     m_next_update = Playlist::Update ();
+    m_last_ranges.clear ();
+    m_next_ranges.clear ();
+    m_journal_len = m_entries.len ();
     m_position_changed = false;
 }
 
@@ -217,6 +578,9 @@ void PlaylistData::swap_updates (bool & position_changed)
 {
     m_last_update = m_next_update;
     m_next_update = Playlist::Update ();
+    m_last_ranges = std::move (m_next_ranges);
+    m_next_ranges.clear ();
+    m_journal_len = m_entries.len ();
     position_changed = m_position_changed;
     m_position_changed = false;
 }
@@ -237,11 +601,12 @@ void PlaylistData::insert_items (int at, Index<PlaylistAddItem> && items)
         auto entry = new PlaylistEntry (std::move (item));
         m_entries[i ++].capture (entry);
         m_total_length += entry->length;
+        shuffle_pool_add (entry);
     }
 
     items.clear ();
 
-    number_entries (at, n_entries + n_items - at);
+    number_entries (at, n_items);
     queue_update (Playlist::Structure, at, n_items);
 }
 
@@ -256,13 +621,13 @@ void PlaylistData::remove_entries (int at, int number)
     if (number < 0 || number > n_entries - at)
         number = n_entries - at;
 
-    if (m_position && m_position->number >= at && m_position->number < at + number)
+    if (m_position && m_position->number () >= at && m_position->number () < at + number)
     {
         set_position (nullptr, false);
         position_changed = true;
     }
 
-    if (m_focus && m_focus->number >= at && m_focus->number < at + number)
+    if (m_focus && m_focus->number () >= at && m_focus->number () < at + number)
     {
         if (at + number < n_entries)
             m_focus = m_entries[at + number].get ();
@@ -278,7 +643,7 @@ void PlaylistData::remove_entries (int at, int number)
 
         if (entry->queued)
         {
-            m_queued.remove (m_queued.find (entry), 1);
+            entry->queued = false;
             update_flags |= QueueChanged;
         }
 
@@ -289,11 +654,14 @@ void PlaylistData::remove_entries (int at, int number)
         }
 
         m_total_length -= entry->length;
+        shuffle_forget (entry);
     }
 
+    if ((update_flags & QueueChanged))
+        queue_compact ();
+
     m_entries.remove (at, number);
 
-    number_entries (at, n_entries - at - number);
     queue_update (Playlist::Structure, at, 0, update_flags);
 
     if (position_changed)
@@ -307,12 +675,12 @@ void PlaylistData::remove_entries (int at, int number)
 
 int PlaylistData::position () const
 {
-    return m_position ? m_position->number : -1;
+    return m_position ? m_position->number () : -1;
 }
 
 int PlaylistData::focus () const
 {
-    return m_focus ? m_focus->number : -1;
+    return m_focus ? m_focus->number () : -1;
 }
 
 bool PlaylistData::entry_selected (int entry_num) const
@@ -357,16 +725,16 @@ void PlaylistData::set_focus (int entry_num)
 
     if (m_focus)
     {
-        first = aud::min (first, m_focus->number);
-        last = aud::max (last, m_focus->number);
+        first = aud::min (first, m_focus->number ());
+        last = aud::max (last, m_focus->number ());
     }
 
     m_focus = new_focus;
 
     if (m_focus)
     {
-        first = aud::min (first, m_focus->number);
-        last = aud::max (last, m_focus->number);
+        first = aud::min (first, m_focus->number ());
+        last = aud::max (last, m_focus->number ());
     }
 
     if (first <= last)
@@ -405,8 +773,8 @@ void PlaylistData::select_all (bool selected)
         if (entry->selected != selected)
         {
             entry->selected = selected;
-            first = aud::min (first, entry->number);
-            last = entry->number;
+            first = aud::min (first, entry->number ());
+            last = entry->number ();
         }
     }
 
@@ -425,6 +793,38 @@ void PlaylistData::select_all (bool selected)
         queue_update (Playlist::Selection, first, last + 1 - first);
 }
 
+void PlaylistData::select_entries (int at, const Index<bool> & selected)
+{
+    int number = aud::min (selected.len (), m_entries.len () - at);
+    int first = at + number, last = 0;
+
+    for (int i = 0; i < number; i ++)
+    {
+        auto & entry = m_entries[at + i];
+        if (entry->selected == selected[i])
+            continue;
+
+        entry->selected = selected[i];
+
+        if (selected[i])
+        {
+            m_selected_count ++;
+            m_selected_length += entry->length;
+        }
+        else
+        {
+            m_selected_count --;
+            m_selected_length -= entry->length;
+        }
+
+        first = aud::min (first, at + i);
+        last = at + i;
+    }
+
+    if (first < at + number)
+        queue_update (Playlist::Selection, first, last + 1 - first);
+}
+
 int PlaylistData::shift_entries (int entry_num, int distance)
 {
     PlaylistEntry * entry = entry_at (entry_num);
@@ -485,7 +885,8 @@ int PlaylistData::shift_entries (int entry_num, int distance)
             temp.append (std::move (m_entries[i]));
     }
 
-    m_entries.move_from (temp, 0, top, bottom - top, false, true);
+    for (int i = 0; i < temp.len (); i ++)
+        m_entries[top + i] = std::move (temp[i]);
 
     number_entries (top, bottom - top);
     queue_update (Playlist::Structure, top, bottom - top);
@@ -516,6 +917,20 @@ void PlaylistData::remove_selected ()
     while (before < n_entries && ! m_entries[before]->selected)
         before ++;
 
+    /* entries are deleted as they are overwritten below,
+     * so they have to be removed from the queue beforehand */
+    for (PlaylistEntry * entry : m_queued)
+    {
+        if (entry->selected)
+        {
+            entry->queued = false;
+            update_flags |= QueueChanged;
+        }
+    }
+
+    if ((update_flags & QueueChanged))
+        queue_compact ();
+
     int to = before;
 
     for (int from = before; from < n_entries; from ++)
@@ -524,13 +939,8 @@ void PlaylistData::remove_selected ()
 
         if (entry->selected)
         {
-            if (entry->queued)
-            {
-                m_queued.remove (m_queued.find (entry), 1);
-                update_flags |= QueueChanged;
-            }
-
             m_total_length -= entry->length;
+            shuffle_forget (entry);
             after = 0;
         }
         else
@@ -540,8 +950,8 @@ void PlaylistData::remove_selected ()
         }
     }
 
+    m_entries.remove (to, n_entries - to);
     n_entries = to;
-    m_entries.remove (n_entries, -1);
 
     m_selected_count = 0;
     m_selected_length = 0;
@@ -570,9 +980,10 @@ void PlaylistData::sort_entries (Index<EntryPtr> & entries, const CompareData &
 
 void PlaylistData::sort (const CompareData & data)
 {
-    sort_entries (m_entries, data);
+    auto entries = m_entries.take_all ();
+    sort_entries (entries, data);
+    m_entries.assign (std::move (entries));
 
-    number_entries (0, m_entries.len ());
     queue_update (Playlist::Structure, 0, m_entries.len ());
 }
 
@@ -601,6 +1012,38 @@ void PlaylistData::sort_selected (const CompareData & data)
     queue_update (Playlist::Structure, 0, n_entries);
 }
 
+void PlaylistData::get_sort_items (bool selected_only, Index<SortItem> & items,
+ Index<int> & positions) const
+{
+    for (auto & entry : m_entries)
+    {
+        if (selected_only && ! entry->selected)
+            continue;
+
+        auto & item = items.append ();
+        item.filename = entry->filename;
+        item.tuple = entry->tuple.ref ();
+
+        positions.append (entry->number ());
+    }
+}
+
+void PlaylistData::apply_sort (const Index<int> & positions, const Index<int> & order)
+{
+    int n_entries = m_entries.len ();
+
+    Index<EntryPtr> taken;
+
+    for (int pos : positions)
+        taken.append (std::move (m_entries[pos]));
+
+    for (int i = 0; i < positions.len (); i ++)
+        m_entries[positions[i]] = std::move (taken[order[i]]);
+
+    number_entries (0, n_entries);
+    queue_update (Playlist::Structure, 0, n_entries);
+}
+
 void PlaylistData::reverse_order ()
 {
     int n_entries = m_entries.len ();
@@ -663,8 +1106,8 @@ void PlaylistData::randomize_selected ()
 
     for (int i = 0; i < n_selected; i ++)
     {
-        int a = selected[i]->number;
-        int b = selected[rand () % n_selected]->number;
+        int a = selected[i]->number ();
+        int b = selected[rand () % n_selected]->number ();
         std::swap (m_entries[a], m_entries[b]);
     }
 
@@ -674,7 +1117,7 @@ void PlaylistData::randomize_selected ()
 
 int PlaylistData::queue_get_entry (int at) const
 {
-    return (at >= 0 && at < m_queued.len ()) ? m_queued[at]->number : -1;
+    return (at >= 0 && at < m_queued.len ()) ? m_queued[at]->number () : -1;
 }
 
 int PlaylistData::queue_find_entry (int entry_num) const
@@ -718,8 +1161,8 @@ void PlaylistData::queue_insert_selected (int at)
 
         add.append (entry.get ());
         entry->queued = true;
-        first = aud::min (first, entry->number);
-        last = entry->number;
+        first = aud::min (first, entry->number ());
+        last = entry->number ();
     }
 
     m_queued.move_from (add, 0, at, -1, true, true);
@@ -744,8 +1187,8 @@ void PlaylistData::queue_remove (int at, int number)
     {
         PlaylistEntry * entry = m_queued[i];
         entry->queued = false;
-        first = aud::min (first, entry->number);
-        last = entry->number;
+        first = aud::min (first, entry->number ());
+        last = entry->number ();
     }
 
     m_queued.remove (at, number);
@@ -767,8 +1210,8 @@ void PlaylistData::queue_remove_selected ()
         {
             m_queued.remove (i, 1);
             entry->queued = false;
-            first = aud::min (first, entry->number);
-            last = entry->number;
+            first = aud::min (first, entry->number ());
+            last = entry->number ();
         }
         else
             i ++;
@@ -785,7 +1228,10 @@ void PlaylistData::set_position (PlaylistEntry * entry, bool update_shuffle)
 
     /* move entry to top of shuffle list */
     if (entry && update_shuffle)
-        entry->shuffle_num = ++ m_last_shuffle_num;
+    {
+        shuffle_forget (entry);
+        shuffle_history_append (entry);
+    }
 }
 
 void PlaylistData::set_position (int entry_num)
@@ -794,19 +1240,93 @@ void PlaylistData::set_position (int entry_num)
     queue_position_change ();
 }
 
+/* The shuffle order is generated lazily, one step of a Fisher-Yates shuffle
+ * per call to shuffle_next(): the pool holds the entries not yet played, and
+ * picking one means swapping it out of the pool into the history.  Entries
+ * inserted later simply join the pool, so nothing ever needs to be rebuilt,
+ * and all the operations below are O(1) except for shuffle_reset() and the
+ * load/save helpers. */
+void PlaylistData::shuffle_pool_add (PlaylistEntry * entry)
+{
+    entry->pool_pos = m_shuffle_pool.len ();
+    m_shuffle_pool.append (entry);
+}
+
+void PlaylistData::shuffle_pool_remove (PlaylistEntry * entry)
+{
+    PlaylistEntry * last = m_shuffle_pool[m_shuffle_pool.len () - 1];
+
+    m_shuffle_pool[entry->pool_pos] = last;
+    last->pool_pos = entry->pool_pos;
+    m_shuffle_pool.remove (m_shuffle_pool.len () - 1, 1);
+
+    entry->pool_pos = -1;
+}
+
+void PlaylistData::shuffle_history_append (PlaylistEntry * entry)
+{
+    entry->history_prev = m_history_tail;
+    entry->history_next = nullptr;
+
+    if (m_history_tail)
+        m_history_tail->history_next = entry;
+    else
+        m_history_head = entry;
+
+    m_history_tail = entry;
+}
+
+void PlaylistData::shuffle_history_unlink (PlaylistEntry * entry)
+{
+    if (entry->history_prev)
+        entry->history_prev->history_next = entry->history_next;
+    else
+        m_history_head = entry->history_next;
+
+    if (entry->history_next)
+        entry->history_next->history_prev = entry->history_prev;
+    else
+        m_history_tail = entry->history_prev;
+
+    entry->history_prev = entry->history_next = nullptr;
+}
+
+/* removes an entry from both the pool and the history */
+void PlaylistData::shuffle_forget (PlaylistEntry * entry)
+{
+    if (entry->pool_pos >= 0)
+        shuffle_pool_remove (entry);
+    else
+        shuffle_history_unlink (entry);
+}
+
+static bool same_album (const Tuple & a, const Tuple & b)
+{
+    String album = a.get_str (Tuple::Album);
+    return (album && album == b.get_str (Tuple::Album));
+}
+
+/* an unplayed entry is a valid choice for album shuffle if it is the first
+ * unplayed entry of its album */
+bool PlaylistData::shuffle_is_album_start (PlaylistEntry * entry) const
+{
+    if (! entry->number ())
+        return true;
+
+    auto prev = m_entries[entry->number () - 1].get ();
+    return prev->pool_pos < 0 || ! same_album (prev->tuple, entry->tuple);
+}
+
 bool PlaylistData::shuffle_prev ()
 {
-    PlaylistEntry * found = nullptr;
+    PlaylistEntry * found;
 
-    for (auto & entry : m_entries)
-    {
-        if (entry->shuffle_num &&
-            (! m_position || entry->shuffle_num < m_position->shuffle_num) &&
-            (! found || entry->shuffle_num > found->shuffle_num))
-        {
-            found = entry.get ();
-        }
-    }
+    if (! m_position)
+        found = m_history_tail;
+    else if (m_position->pool_pos < 0)
+        found = m_position->history_prev;
+    else
+        found = nullptr;
 
     if (! found)
         return false;
@@ -819,44 +1339,21 @@ bool PlaylistData::shuffle_next ()
 {
     bool by_album = aud_get_bool (nullptr, "album_shuffle");
 
-    // helper #1: determine whether two entries are in the same album
-    auto same_album = [] (const Tuple & a, const Tuple & b)
-    {
-        String album = a.get_str (Tuple::Album);
-        return (album && album == b.get_str (Tuple::Album));
-    };
-
-    // helper #2: determine whether an entry is among the shuffle choices
-    auto is_choice = [&] (PlaylistEntry * prev, PlaylistEntry * entry)
-    {
-        return (! entry->shuffle_num) && (! by_album || ! prev ||
-         prev->shuffle_num || ! same_album (prev->tuple, entry->tuple));
-    };
-
-    if (m_position)
+    if (m_position && m_position->pool_pos < 0)
     {
         // step #1: check to see if the shuffle order is already established
-        PlaylistEntry * next = nullptr;
-
-        for (auto & entry : m_entries)
-        {
-            if (entry->shuffle_num > m_position->shuffle_num &&
-             (! next || entry->shuffle_num < next->shuffle_num))
-                next = entry.get ();
-        }
-
-        if (next)
+        if (m_position->history_next)
         {
-            set_position (next, false);
+            set_position (m_position->history_next, false);
             return true;
         }
 
         // step #2: check to see if we should advance to the next entry
-        if (by_album && m_position->number + 1 < m_entries.len ())
+        if (by_album && m_position->number () + 1 < m_entries.len ())
         {
-            next = m_entries[m_position->number + 1].get ();
+            auto next = m_entries[m_position->number () + 1].get ();
 
-            if (! next->shuffle_num && same_album (m_position->tuple, next->tuple))
+            if (next->pool_pos >= 0 && same_album (m_position->tuple, next->tuple))
             {
                 set_position (next, true);
                 return true;
@@ -864,67 +1361,57 @@ bool PlaylistData::shuffle_next ()
         }
     }
 
-    // step #3: count the number of possible shuffle choices
-    int choices = 0;
-    PlaylistEntry * prev = nullptr;
-
-    for (auto & entry : m_entries)
-    {
-        if (is_choice (prev, entry.get ()))
-            choices ++;
-
-        prev = entry.get ();
-    }
-
+    // step #3: pick one of the unplayed entries by random
+    int choices = m_shuffle_pool.len ();
     if (! choices)
         return false;
 
-    // step #4: pick one of those choices by random and find it again
-    choices = rand () % choices;
-    prev = nullptr;
+    auto entry = m_shuffle_pool[rand () % choices];
 
-    for (auto & entry : m_entries)
+    if (by_album)
     {
-        if (is_choice (prev, entry.get ()))
+        // step #4: retry until we hit an album start (the first entry of a
+        // run of unplayed entries of the same album); rejection sampling
+        // picks each start with equal chance, regardless of album length
+        for (int tries = 0; tries < 32 && ! shuffle_is_album_start (entry); tries ++)
+            entry = m_shuffle_pool[rand () % choices];
+
+        // when starts are rare (long albums), collect them all instead
+        if (! shuffle_is_album_start (entry))
         {
-            if (! choices)
+            Index<PlaylistEntry *> starts;
+
+            for (auto candidate : m_shuffle_pool)
             {
-                set_position (entry.get (), true);
-                return true;
+                if (shuffle_is_album_start (candidate))
+                    starts.append (candidate);
             }
 
-            choices --;
+            // there is always at least one start among unplayed entries
+            entry = starts[rand () % starts.len ()];
         }
-
-        prev = entry.get ();
     }
 
-    return false;  // never reached
+    set_position (entry, true);
+    return true;
 }
 
 void PlaylistData::shuffle_reset ()
 {
-    m_last_shuffle_num = 0;
-
-    for (auto & entry : m_entries)
-        entry->shuffle_num = 0;
+    while (m_history_head)
+    {
+        auto entry = m_history_head;
+        shuffle_history_unlink (entry);
+        shuffle_pool_add (entry);
+    }
 }
 
 Index<int> PlaylistData::shuffle_history () const
 {
     Index<int> history;
 
-    // create a list of all entries in the shuffle list
-    for (auto & entry : m_entries)
-    {
-        if (entry->shuffle_num)
-            history.append (entry->number);
-    }
-
-    // sort by shuffle order
-    history.sort ([this] (int entry_a, int entry_b) {
-        return m_entries[entry_a]->shuffle_num - m_entries[entry_b]->shuffle_num;
-    });
+    for (auto entry = m_history_head; entry; entry = entry->history_next)
+        history.append (entry->number ());
 
     return history;
 }
@@ -938,7 +1425,10 @@ void PlaylistData::shuffle_replay (const Index<int> & history)
     {
         auto entry = entry_at (entry_num);
         if (entry)
-            entry->shuffle_num = ++ m_last_shuffle_num;
+        {
+            shuffle_forget (entry);
+            shuffle_history_append (entry);
+        }
     }
 }
 
@@ -1048,7 +1538,7 @@ void PlaylistData::update_entry_from_scan (PlaylistEntry * entry, ScanRequest *
     if (! entry->tuple.valid () && request->tuple.valid ())
     {
         set_entry_tuple (entry, std::move (request->tuple));
-        queue_update (Playlist::Metadata, entry->number, 1, update_flags);
+        queue_update (Playlist::Metadata, entry->number (), 1, update_flags);
     }
 
     if (! entry->decoder || ! entry->tuple.valid ())
@@ -1057,7 +1547,7 @@ void PlaylistData::update_entry_from_scan (PlaylistEntry * entry, ScanRequest *
     if (entry->tuple.state () == Tuple::Initial)
     {
         entry->tuple.set_state (Tuple::Failed);
-        queue_update (Playlist::Metadata, entry->number, 1, update_flags);
+        queue_update (Playlist::Metadata, entry->number (), 1, update_flags);
     }
 }
 
@@ -1067,7 +1557,7 @@ void PlaylistData::update_playback_entry (Tuple && tuple)
     if (m_position && ! m_position->tuple.is_set (Tuple::StartTime))
     {
         set_entry_tuple (m_position, std::move (tuple));
-        queue_update (Playlist::Metadata, m_position->number, 1);
+        queue_update (Playlist::Metadata, m_position->number (), 1);
     }
 }
 
@@ -1109,7 +1599,7 @@ void PlaylistData::reset_tuple_of_file (const char * filename)
         if (! strcmp (entry->filename, filename))
         {
             set_entry_tuple (entry.get (), Tuple ());
-            queue_update (Playlist::Metadata, entry->number, 1);
+            queue_update (Playlist::Metadata, entry->number (), 1);
             found = true;
         }
     }
@@ -1125,13 +1615,13 @@ PlaylistEntry * PlaylistData::find_unselected_focus ()
 
     int n_entries = m_entries.len ();
 
-    for (int search = m_focus->number + 1; search < n_entries; search ++)
+    for (int search = m_focus->number () + 1; search < n_entries; search ++)
     {
         if (! m_entries[search]->selected)
             return m_entries[search].get ();
     }
 
-    for (int search = m_focus->number; search --;)
+    for (int search = m_focus->number (); search --;)
     {
         if (! m_entries[search]->selected)
             return m_entries[search].get ();
@@ -1140,6 +1630,20 @@ PlaylistEntry * PlaylistData::find_unselected_focus ()
     return nullptr;
 }
 
+/* drops entries from the queue that have been flagged as no longer queued */
+void PlaylistData::queue_compact ()
+{
+    int to = 0;
+
+    for (PlaylistEntry * entry : m_queued)
+    {
+        if (entry->queued)
+            m_queued[to ++] = entry;
+    }
+
+    m_queued.remove (to, -1);
+}
+
 PlaylistEntry * PlaylistData::queue_pop ()
 {
     if (! m_queued.len ())
@@ -1149,7 +1653,7 @@ PlaylistEntry * PlaylistData::queue_pop ()
     m_queued.remove (0, 1);
     entry->queued = false;
 
-    queue_update (Playlist::Selection, entry->number, 1, QueueChanged);
+    queue_update (Playlist::Selection, entry->number (), 1, QueueChanged);
 
     return entry;
 }
@@ -47,15 +47,25 @@ public:
         Playlist::TupleCompareFunc tuple_compare;
     };
 
+    struct EntryChunk;
+
+    /* copy of an entry's data, for sorting outside of the playlist lock */
+    struct SortItem {
+        String filename;
+        Tuple tuple;
+    };
+
     PlaylistData (Playlist::ID * m_id, const char * title);
     ~PlaylistData ();
 
     PlaylistEntry * entry_at (int i);
     const PlaylistEntry * entry_at (int i) const;
+    static int entry_number (const PlaylistEntry * entry);
 
     String entry_filename (int i) const;
     PluginHandle * entry_decoder (int i, String * error = nullptr) const;
     Tuple entry_tuple (int i, String * error = nullptr) const;
+    void get_rows (int at, int number, Index<Playlist::Snapshot::Row> & rows) const;
 
     void cancel_updates ();
     void swap_updates (bool & position_changed);
@@ -73,12 +83,27 @@ public:
 
     void select_entry (int entry_num, bool selected);
     void select_all (bool selected);
+    void select_entries (int at, const Index<bool> & selected);
     int shift_entries (int entry_num, int distance);
     void remove_selected ();
 
     void sort (const CompareData & data);
     void sort_selected (const CompareData & data);
 
+    /* keyed sort by a preset scheme (see playlist-sort.cc); sort_items() may
+     * be run without locking, and the result is only valid to apply if
+     * sort_serial() has not changed in the meantime */
+    int sort_serial () const { return m_sort_serial; }
+    void get_sort_items (bool selected_only, Index<SortItem> & items, Index<int> & positions) const;
+    static Index<int> sort_items (Playlist::SortType scheme, const Index<SortItem> & items);
+    void apply_sort (const Index<int> & positions, const Index<int> & order);
+
+    /* appends the sort key of a single item to <key>, as a byte string which
+     * is equal for two items if and only if they would compare as equal;
+     * returns false if the item has no value (or an empty one) for the key */
+    static bool append_sort_key (Playlist::SortType scheme, const SortItem & item,
+     Index<char> & key);
+
     void reverse_order ();
     void randomize_order ();
     void reverse_selected ();
@@ -120,6 +145,7 @@ public:
     int64_t selected_length () const { return m_selected_length; }
 
     const Playlist::Update & last_update () const { return m_last_update; }
+    Index<Playlist::UpdateRange> last_ranges () const;
     bool update_pending () const { return m_next_update.level != Playlist::NoUpdate; }
 
     static void update_formatter ();
@@ -129,15 +155,68 @@ private:
     static void delete_entry (PlaylistEntry * entry);
     typedef SmartPtr<PlaylistEntry, delete_entry> EntryPtr;
 
+    /* Entries are stored in chunks of a few hundred, so that inserting or
+     * removing entries only shifts and renumbers the chunks affected rather
+     * than the whole playlist.  An entry's number is the start of its chunk
+     * plus its offset within the chunk. */
+    class EntryList
+    {
+    public:
+        class Iter;
+
+        int len () const
+            { return m_len; }
+
+        /* the non-const version remembers the chunk found, for faster
+         * sequential access; the const version writes nothing, so that
+         * several threads can read the playlist at once */
+        EntryPtr & operator[] (int i);
+        const EntryPtr & operator[] (int i) const;
+
+        Iter begin () const;
+        Iter end () const;
+
+        /* inserts empty slots; call renumber() after filling them */
+        void insert (int at, int count);
+        void remove (int at, int count);
+
+        /* updates the numbers of entries moved to the given slots */
+        void renumber (int at, int count);
+
+        /* for operations that reorder the whole playlist */
+        Index<EntryPtr> take_all ();
+        void assign (Index<EntryPtr> && entries);
+
+    private:
+        Index<SmartPtr<EntryChunk>> m_chunks;
+        int m_len = 0;
+        int m_last_chunk = 0;
+
+        int find_chunk (int i) const;
+        void split_chunk (int c);
+        void merge_chunks (int c);
+        void renumber_chunk (int c);
+        void update_starts (int c);
+    };
+
     void number_entries (int at, int length);
+    void queue_compact ();
     void set_entry_tuple (PlaylistEntry * entry, Tuple && tuple);
     void queue_update (Playlist::UpdateLevel level, int at, int count, int flags = 0);
+    void journal_update (Playlist::UpdateLevel level, int at, int count);
     void queue_position_change ();
 
     static void sort_entries (Index<EntryPtr> & entries, const CompareData & data);
 
     void set_position (PlaylistEntry * entry, bool update_shuffle);
 
+    void shuffle_pool_add (PlaylistEntry * entry);
+    void shuffle_pool_remove (PlaylistEntry * entry);
+    void shuffle_history_append (PlaylistEntry * entry);
+    void shuffle_history_unlink (PlaylistEntry * entry);
+    void shuffle_forget (PlaylistEntry * entry);
+    bool shuffle_is_album_start (PlaylistEntry * entry) const;
+
     bool shuffle_prev ();
     bool shuffle_next ();
     void shuffle_reset ();
@@ -155,16 +234,80 @@ public:
 
 private:
     Playlist::ID * m_id;
-    Index<EntryPtr> m_entries;
+    EntryList m_entries;
     PlaylistEntry * m_position, * m_focus;
     int m_selected_count;
-    int m_last_shuffle_num;
+    PlaylistEntry * m_history_head, * m_history_tail;
+    Index<PlaylistEntry *> m_shuffle_pool;
     Index<PlaylistEntry *> m_queued;
     int64_t m_total_length, m_selected_length;
     Playlist::Update m_last_update, m_next_update;
+    Index<Playlist::UpdateRange> m_last_ranges, m_next_ranges;
+    int m_journal_len;  // number of entries when m_next_ranges was started
     bool m_position_changed;
+    int m_sort_serial;
+};
+
+struct PlaylistData::EntryChunk
+{
+    int start;
+    Index<EntryPtr> entries;
+};
+
+class PlaylistData::EntryList::Iter
+{
+public:
+    Iter (const EntryList * list, int chunk, int pos) :
+        m_list (list), m_chunk (chunk), m_pos (pos) {}
+
+    EntryPtr & operator* () const
+        { return const_cast<EntryChunk &> (* m_list->m_chunks[m_chunk]).entries[m_pos]; }
+
+    Iter & operator++ ()
+    {
+        if (++ m_pos == m_list->m_chunks[m_chunk]->entries.len ())
+        {
+            m_chunk ++;
+            m_pos = 0;
+        }
+
+        return * this;
+    }
+
+    bool operator!= (const Iter & b) const
+        { return m_chunk != b.m_chunk || m_pos != b.m_pos; }
+
+private:
+    const EntryList * m_list;
+    int m_chunk, m_pos;
 };
 
+inline PlaylistData::EntryPtr & PlaylistData::EntryList::operator[] (int i)
+{
+    /* sequential access usually stays within the same chunk */
+    EntryChunk * chunk = m_chunks[m_last_chunk].get ();
+
+    if (i < chunk->start || i >= chunk->start + chunk->entries.len ())
+        chunk = m_chunks[m_last_chunk = find_chunk (i)].get ();
+
+    return chunk->entries[i - chunk->start];
+}
+
+inline const PlaylistData::EntryPtr & PlaylistData::EntryList::operator[] (int i) const
+{
+    const EntryChunk * chunk = m_chunks[m_last_chunk].get ();
+
+    if (i < chunk->start || i >= chunk->start + chunk->entries.len ())
+        chunk = m_chunks[find_chunk (i)].get ();
+
+    return chunk->entries[i - chunk->start];
+}
+
+inline PlaylistData::EntryList::Iter PlaylistData::EntryList::begin () const
+    { return Iter (this, 0, 0); }
+inline PlaylistData::EntryList::Iter PlaylistData::EntryList::end () const
+    { return Iter (this, m_chunks.len (), 0); }
+
 /* callbacks or "signals" (in the QObject sense) */
 void pl_signal_entry_deleted (PlaylistEntry * entry);
 void pl_signal_position_changed (Playlist::ID * id);
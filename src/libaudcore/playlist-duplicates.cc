@@ -0,0 +1,547 @@
+/*
+ * playlist-duplicates.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "playlist-internal.h"
+#include "playlist-data.h"
+#include "internal.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <glib.h>  /* for g_get_num_processors */
+
+#include "audio.h"
+#include "audstrings.h"
+#include "i18n.h"
+#include "multihash.h"
+#include "plugin.h"
+#include "probe.h"
+#include "runtime.h"
+#include "tuple.h"
+#include "vfs.h"
+
+/* below this many entries, keys taken only from the tuples are computed in
+ * the calling thread; keys that need file access are always computed in
+ * parallel, since most of the time is spent waiting for I/O */
+#define PARALLEL_FIELDS_MIN 16384
+#define MAX_DUPLICATE_THREADS 8
+
+#define FNV_OFFSET 0xcbf29ce484222325ull
+#define FNV_PRIME 0x100000001b3ull
+
+/*
+ * Each entry's key is the concatenation of the requested keys, as a byte
+ * string.  Keys are computed in parallel into a separate buffer per entry;
+ * then the entries are grouped by a hash table in a single pass, without
+ * reordering the playlist.
+ */
+struct EntryKey
+{
+    const char * data;
+    int len;
+    unsigned hash_val;
+
+    unsigned hash () const
+        { return hash_val; }
+    bool operator== (const EntryKey & b) const
+        { return len == b.len && ! memcmp (data, b.data, len); }
+};
+
+struct DuplicateSearch
+{
+    Playlist::SortType scheme;
+    int keys;
+    int serial;
+
+    const Playlist::Snapshot * rows;
+    Index<char> * entry_keys;  // one per row
+    bool * has_key;            // one per row
+
+    int next;  // next row to be processed, incremented atomically
+};
+
+/* Fingerprints of local files are cached, since decoding them again takes
+ * much longer than checking whether they have changed. */
+struct CachedFingerprint
+{
+    int64_t size, mtime;
+    uint64_t fingerprint;
+};
+
+static pthread_mutex_t cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static SimpleHash<String, CachedFingerprint> fingerprint_cache;
+
+/* incremented to cancel all searches in progress */
+static int cancel_serial;
+
+static bool search_cancelled (int serial)
+{
+    return __sync_fetch_and_add (& cancel_serial, 0) != serial;
+}
+
+/* for playback_borrow_decoder() */
+static bool search_cancelled_cb (void * serial)
+{
+    return search_cancelled (* (int *) serial);
+}
+
+static unsigned hash_bytes (const char * data, int len)
+{
+    uint64_t hash = FNV_OFFSET;
+
+    for (int i = 0; i < len; i ++)
+        hash = (hash ^ (unsigned char) data[i]) * FNV_PRIME;
+
+    return (unsigned) (hash ^ (hash >> 32));
+}
+
+/* size and modification time of a local file, or only the size (with mtime
+ * set to -1) of a file accessed through a transport plugin */
+static bool get_file_info (const char * filename, int64_t & size, int64_t & mtime)
+{
+    StringBuf path = uri_to_filename (filename);
+
+    if (path)
+    {
+        struct stat info;
+        if (stat (path, & info) < 0 || ! S_ISREG (info.st_mode))
+            return false;
+
+        size = info.st_size;
+        mtime = info.st_mtime;
+        return true;
+    }
+
+    VFSFile file (filename, "r");
+    if (! file || (size = file.fsize ()) < 0)
+        return false;
+
+    mtime = -1;
+    return true;
+}
+
+/* Hashes the decoded audio, converted to 16-bit integers.  The result does
+ * not depend on the file name, container, or tags, so it finds copies of the
+ * same recording (including those converted to a different lossless format).
+ * Lossy re-encodings of the same recording are not detected. */
+class FingerprintSink : public DecodeSink
+{
+public:
+    FingerprintSink (const Tuple & tuple, int serial, InputPlugin * ip) :
+        m_tuple (tuple.ref ()),
+        m_serial (serial),
+        m_ip (ip) {}
+
+    void open_audio (int format, int rate, int channels)
+    {
+        m_format = format;
+        m_channels = channels;
+
+        mix (rate);
+        mix (channels);
+    }
+
+    void write_audio (const void * data, int length)
+    {
+        if (! m_channels)
+            return;
+
+        int samples = length / FMT_SIZEOF (m_format);
+        const int16_t * idata = (const int16_t *) data;
+
+        if (m_format != FMT_S16_NE)
+        {
+            const float * fdata = (const float *) data;
+
+            if (m_format != FMT_FLOAT)
+            {
+                m_float_buf.resize (samples);
+                audio_from_int (data, m_format, m_float_buf.begin (), samples);
+                fdata = m_float_buf.begin ();
+            }
+
+            m_int_buf.resize (samples);
+            audio_to_int (fdata, m_int_buf.begin (), FMT_S16_NE, samples);
+            idata = m_int_buf.begin ();
+        }
+
+        for (int i = 0; i < samples; i ++)
+            mix ((uint16_t) idata[i]);
+
+        m_samples += samples;
+    }
+
+    bool check_stop ()
+        { return search_cancelled (m_serial) || playback_decoder_wanted (m_ip); }
+
+    Tuple get_tuple ()
+        { return m_tuple.ref (); }
+
+    bool get_fingerprint (uint64_t & fingerprint) const
+    {
+        fingerprint = m_hash;
+        return m_samples > 0;
+    }
+
+    void reset ()
+    {
+        m_format = FMT_FLOAT;
+        m_channels = 0;
+        m_samples = 0;
+        m_hash = FNV_OFFSET;
+    }
+
+private:
+    void mix (unsigned value)
+        { m_hash = (m_hash ^ value) * FNV_PRIME; }
+
+    Tuple m_tuple;
+    int m_serial;
+    InputPlugin * m_ip;
+
+    int m_format = FMT_FLOAT;
+    int m_channels = 0;
+    int64_t m_samples = 0;
+    uint64_t m_hash = FNV_OFFSET;
+
+    Index<float> m_float_buf;
+    Index<int16_t> m_int_buf;
+};
+
+static bool decode_fingerprint (const char * filename, PluginHandle * decoder,
+ const Tuple & tuple, int serial, uint64_t & fingerprint)
+{
+    VFSFile file;
+    String error;
+
+    if (! decoder)
+        decoder = aud_file_find_decoder (filename, false, file, & error);
+
+    auto ip = decoder ? load_input_plugin (decoder, & error) : nullptr;
+    if (! ip)
+        goto err;
+
+    {
+        FingerprintSink sink (tuple, serial, ip);
+        bool exclusive = ! (ip->input_info.flags & InputPlugin::FlagReentrant);
+        bool success;
+
+        /* start over if playback needed the plugin meanwhile */
+        do
+        {
+            if (exclusive && ! playback_borrow_decoder (ip, search_cancelled_cb, & serial))
+                return false;
+
+            if (! open_input_file (filename, "r", ip, file, & error))
+            {
+                if (exclusive)
+                    playback_return_decoder (ip);
+
+                goto err;
+            }
+
+            sink.reset ();
+
+            playback_set_decode_sink (& sink);
+            success = ip->play (filename, file);
+            playback_set_decode_sink (nullptr);
+        }
+        while (exclusive && playback_return_decoder (ip) && ! search_cancelled (serial));
+
+        if (! success || search_cancelled (serial))
+            return false;
+
+        return sink.get_fingerprint (fingerprint);
+    }
+
+err:
+    AUDWARN ("Cannot fingerprint %s: %s\n", filename,
+     error ? (const char *) error : _("Unknown error"));
+    return false;
+}
+
+static bool get_fingerprint (const Playlist::Snapshot::Row & row, int64_t size,
+ int64_t mtime, int serial, uint64_t & fingerprint)
+{
+    /* only local files are cached, since there is no modification time for
+     * the others to tell whether the cached fingerprint is still valid */
+    bool cache = (mtime >= 0);
+
+    if (cache)
+    {
+        pthread_mutex_lock (& cache_mutex);
+
+        auto cached = fingerprint_cache.lookup (row.filename);
+        bool found = cached && cached->size == size && cached->mtime == mtime;
+        if (found)
+            fingerprint = cached->fingerprint;
+
+        pthread_mutex_unlock (& cache_mutex);
+
+        if (found)
+            return true;
+    }
+
+    if (! decode_fingerprint (row.filename, row.decoder, row.tuple, serial, fingerprint))
+        return false;
+
+    if (cache)
+    {
+        pthread_mutex_lock (& cache_mutex);
+        fingerprint_cache.add (row.filename, {size, mtime, fingerprint});
+        pthread_mutex_unlock (& cache_mutex);
+    }
+
+    return true;
+}
+
+static bool make_entry_key (const DuplicateSearch & search,
+ const Playlist::Snapshot::Row & row, Index<char> & key)
+{
+    if (search.keys & Playlist::DupField)
+    {
+        /* as in sort_entries(), tuple fields are compared only once the
+         * entries have been scanned */
+        PlaylistData::SortItem item {row.filename,
+         (row.tuple.state () == Tuple::Valid) ? row.tuple.ref () : Tuple ()};
+
+        if (! PlaylistData::append_sort_key (search.scheme, item, key))
+            return false;
+    }
+
+    if (! (search.keys & (Playlist::DupFileSize | Playlist::DupContent)))
+        return true;
+
+    /* cuesheet tracks and subtunes share a file with other entries */
+    if (is_subtune (row.filename) || row.tuple.is_set (Tuple::StartTime))
+        return false;
+
+    int64_t size, mtime;
+    if (! get_file_info (row.filename, size, mtime))
+        return false;
+
+    if (search.keys & Playlist::DupFileSize)
+        key.insert ((const char *) & size, -1, sizeof size);
+
+    if (search.keys & Playlist::DupContent)
+    {
+        uint64_t fingerprint;
+        if (! get_fingerprint (row, size, mtime, search.serial, fingerprint))
+            return false;
+
+        key.insert ((const char *) & fingerprint, -1, sizeof fingerprint);
+    }
+
+    return true;
+}
+
+static void * duplicate_worker (void * data)
+{
+    auto search = (DuplicateSearch *) data;
+    int n_rows = search->rows->len ();
+    int i;
+
+    while ((i = __sync_fetch_and_add (& search->next, 1)) < n_rows)
+    {
+        if (search_cancelled (search->serial))
+            break;
+
+        search->has_key[i] = make_entry_key (* search, (* search->rows)[i],
+         search->entry_keys[i]);
+    }
+
+    return nullptr;
+}
+
+static int count_threads (int keys, int n_rows)
+{
+    if (! (keys & (Playlist::DupFileSize | Playlist::DupContent)) &&
+     n_rows < PARALLEL_FIELDS_MIN)
+        return 1;
+
+    return aud::clamp (n_rows, 1, aud::min (g_get_num_processors (),
+     MAX_DUPLICATE_THREADS));
+}
+
+static Index<Index<int>> find_duplicates_real (Playlist playlist,
+ Playlist::SortType scheme, int keys, int serial)
+{
+    Index<Index<int>> groups;
+
+    if (! keys)
+        return groups;
+
+    /* paths and file names are known without scanning */
+    bool need_tuples = (keys & Playlist::DupField) &&
+     scheme != Playlist::Path && scheme != Playlist::Filename;
+    auto rows = playlist.snapshot (0, -1, need_tuples ? Playlist::Wait : Playlist::NoWait);
+    int n_rows = rows.len ();
+
+    Index<Index<char>> entry_keys;
+    Index<bool> has_key;
+    entry_keys.insert (0, n_rows);
+    has_key.insert (0, n_rows);
+
+    DuplicateSearch search = DuplicateSearch ();
+    search.scheme = scheme;
+    search.keys = keys;
+    search.serial = serial;
+    search.rows = & rows;
+    search.entry_keys = entry_keys.begin ();
+    search.has_key = has_key.begin ();
+
+    int n_threads = count_threads (keys, n_rows);
+
+    if (n_threads == 1)
+        duplicate_worker (& search);
+    else
+    {
+        Index<pthread_t> threads;
+        threads.insert (0, n_threads);
+
+        for (pthread_t & thread : threads)
+            pthread_create (& thread, nullptr, duplicate_worker, & search);
+        for (pthread_t & thread : threads)
+            pthread_join (thread, nullptr);
+    }
+
+    if (search_cancelled (search.serial))
+    {
+        AUDINFO ("Duplicate search cancelled.\n");
+        return groups;
+    }
+
+    /* maps each key to the group of entries having it; a group is only added
+     * to the result once a second entry is found */
+    SimpleHash<EntryKey, int> group_of_key;
+    Index<int> firsts;
+
+    for (int i = 0; i < n_rows; i ++)
+    {
+        if (! has_key[i])
+            continue;
+
+        const Index<char> & data = entry_keys[i];
+        EntryKey key = {data.begin (), data.len (), hash_bytes (data.begin (), data.len ())};
+
+        int * group = group_of_key.lookup (key);
+
+        if (! group)
+            group_of_key.add (key, -1 - i);  // first entry with this key
+        else if (* group < 0)
+        {
+            int first = -1 - * group;
+            * group = groups.len ();
+
+            Index<int> & entries = groups.append ();
+            entries.append (first);
+            entries.append (i);
+        }
+        else
+            groups[* group].append (i);
+    }
+
+    groups.sort ([] (const Index<int> & a, const Index<int> & b)
+        { return a[0] - b[0]; });
+
+    return groups;
+}
+
+EXPORT Index<Index<int>> Playlist::find_duplicates (SortType scheme, int keys) const
+{
+    return find_duplicates_real (* this, scheme, keys,
+     __sync_fetch_and_add (& cancel_serial, 0));
+}
+
+EXPORT void Playlist::cancel_duplicate_search ()
+{
+    __sync_fetch_and_add (& cancel_serial, 1);
+}
+
+/* ---- background removal ---- */
+
+struct RemoveJob
+{
+    Playlist playlist;
+    Playlist::SortType scheme;
+    int keys;
+    int serial;  // cancel_serial when the job was queued
+};
+
+static GThreadPool * remove_pool;
+
+static void remove_worker (void * data, void *)
+{
+    auto job = (RemoveJob *) data;
+    PlaylistEx playlist = job->playlist;
+
+    /* entry numbers are only valid as long as no entries are added, removed,
+     * or moved, so the playlist is checked for that before the removal */
+    int structure = playlist.structure_serial ();
+    auto groups = find_duplicates_real (playlist, job->scheme, job->keys, job->serial);
+
+    if (groups.len ())
+    {
+        Index<bool> remove;
+        remove.insert (0, playlist.n_entries ());
+
+        for (auto & group : groups)
+        {
+            for (int i = 1; i < group.len (); i ++)
+            {
+                if (group[i] < remove.len ())
+                    remove[group[i]] = true;
+            }
+        }
+
+        if (! playlist.remove_flagged (remove, structure))
+            AUDINFO ("Playlist modified, duplicates not removed.\n");
+    }
+
+    delete job;
+}
+
+EXPORT void Playlist::remove_duplicates (SortType scheme, int keys) const
+{
+    if (! remove_pool)
+        remove_pool = g_thread_pool_new (remove_worker, nullptr, 1, false, nullptr);
+
+    auto job = new RemoveJob {* this, scheme, keys,
+     __sync_fetch_and_add (& cancel_serial, 0)};
+
+    g_thread_pool_push (remove_pool, job, nullptr);
+}
+
+void playlist_duplicates_cleanup ()
+{
+    if (remove_pool)
+    {
+        /* queued jobs are still run, but return right away */
+        Playlist::cancel_duplicate_search ();
+
+        g_thread_pool_free (remove_pool, false, true);
+        remove_pool = nullptr;
+    }
+
+    pthread_mutex_lock (& cache_mutex);
+    fingerprint_cache.clear ();
+    pthread_mutex_unlock (& cache_mutex);
+}
@@ -19,6 +19,8 @@
 
 #include "playlist-internal.h"
 
+#include <glib.h>
+
 #include "audstrings.h"
 #include "i18n.h"
 #include "interface.h"
@@ -109,43 +111,115 @@ bool PlaylistEx::insert_flat_playlist (const char * filename) const
     return true;
 }
 
+static PlaylistPlugin * get_save_plugin (const char * filename)
+{
+    StringBuf ext = uri_get_extension (filename);
+    if (! ext)
+        return nullptr;
+
+    for (PluginHandle * plugin : aud_plugin_list (PluginType::Playlist))
+    {
+        if (! aud_plugin_get_enabled (plugin) || ! playlist_plugin_has_ext (plugin, ext))
+            continue;
+
+        PlaylistPlugin * pp = (PlaylistPlugin *) aud_plugin_get_header (plugin);
+        if (pp && pp->can_save)
+            return pp;
+    }
+
+    return nullptr;
+}
+
+/* write-only file which collects its contents in memory */
+class MemoryFile : public VFSImpl
+{
+public:
+    Index<char> data;
+
+    int64_t fread (void * ptr, int64_t size, int64_t nmemb)
+        { return 0; }
+    int fseek (int64_t offset, VFSSeekType whence)
+        { return -1; }
+
+    int64_t ftell ()
+        { return data.len (); }
+    int64_t fsize ()
+        { return data.len (); }
+    bool feof ()
+        { return true; }
+
+    int64_t fwrite (const void * ptr, int64_t size, int64_t nmemb)
+    {
+        data.insert ((const char *) ptr, -1, size * nmemb);
+        return nmemb;
+    }
+
+    int ftruncate (int64_t length)
+        { return -1; }
+    int fflush ()
+        { return 0; }
+};
+
+/* Saves a playlist to a local file.  The playlist is first written out in
+ * memory and then swapped in with g_file_set_contents(), which goes through
+ * a temporary file and a rename, so that a crash or a full disk can never
+ * leave a truncated playlist behind.  Safe to call from any thread. */
+bool playlist_save_local (const char * path, const char * title,
+ const Index<PlaylistAddItem> & items)
+{
+    StringBuf uri = filename_to_uri (path);
+    PlaylistPlugin * pp = get_save_plugin (uri);
+
+    if (! pp)
+    {
+        AUDERR ("No playlist plugin found to save %s.\n", path);
+        return false;
+    }
+
+    auto memory = new MemoryFile;
+    VFSFile file (uri, memory);
+
+    if (! pp->save (uri, file, title, items))
+    {
+        AUDERR ("Error saving %s.\n", path);
+        return false;
+    }
+
+    GError * error = nullptr;
+
+    if (! g_file_set_contents (path, memory->data.begin (), memory->data.len (), & error))
+    {
+        AUDERR ("Error saving %s: %s\n", path, error->message);
+        g_error_free (error);
+        return false;
+    }
+
+    return true;
+}
+
 EXPORT bool Playlist::save_to_file (const char * filename, GetMode mode) const
 {
     String title = get_title ();
 
     Index<PlaylistAddItem> items;
-    items.insert (0, n_entries ());
 
-    int i = 0;
-    for (PlaylistAddItem & item : items)
+    for (auto & row : snapshot (0, -1, mode))
     {
-        item.filename = entry_filename (i);
-        item.tuple = entry_tuple (i, mode);
+        auto & item = items.append (row.filename, row.tuple.ref ());
         item.tuple.delete_fallbacks ();
-        i ++;
     }
 
     AUDINFO ("Saving playlist %s.\n", filename);
 
-    StringBuf ext = uri_get_extension (filename);
+    PlaylistPlugin * pp = get_save_plugin (filename);
 
-    if (ext)
+    if (pp)
     {
-        for (PluginHandle * plugin : aud_plugin_list (PluginType::Playlist))
-        {
-            if (! aud_plugin_get_enabled (plugin) || ! playlist_plugin_has_ext (plugin, ext))
-                continue;
+        VFSFile file (filename, "w");
+        if (! file)
+            return false;
 
-            PlaylistPlugin * pp = (PlaylistPlugin *) aud_plugin_get_header (plugin);
-            if (! pp || ! pp->can_save)
-                continue;
-
-            VFSFile file (filename, "w");
-            if (! file)
-                return false;
-
-            return pp->save (filename, file, title, items) && file.fflush () == 0;
-        }
+        return pp->save (filename, file, title, items) && file.fflush () == 0;
     }
 
     aud_ui_show_error (str_printf (_("Cannot save %s: unsupported file name extension."), filename));
@@ -0,0 +1,424 @@
+/*
+ * playlist-filter.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#define AUD_GLIB_INTEGRATION
+#include "playlist.h"
+#include "internal.h"
+#include "playlist-internal.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "runtime.h"
+
+/* below this many rows per thread, filtering is not split up */
+#define PARALLEL_FILTER_MIN 16384
+#define MAX_FILTER_THREADS 8
+
+/* fields kept in a TextIndex */
+static const Tuple::Field text_fields[] = {
+    Tuple::Title,
+    Tuple::Artist,
+    Tuple::Album,
+    Tuple::AlbumArtist,
+    Tuple::Genre,
+    Tuple::Comment,
+    Tuple::Basename
+};
+
+static constexpr int n_text_fields = aud::n_elems (text_fields);
+
+/* conditions are evaluated cheapest first, so that most rows are rejected
+ * before any regular expression has to be run */
+enum class CondType {
+    Range,
+    Prefix,
+    Substring,
+    Regex
+};
+
+typedef SmartPtr<GRegex, g_regex_unref> RegexPtr;
+
+struct Condition
+{
+    CondType type;
+    Tuple::Field field;
+    int text_field;   // position in text_fields, or -1
+
+    int min, max;     // for CondType::Range
+    String pattern;   // case-folded, for CondType::Prefix and Substring
+    int pattern_len;
+    RegexPtr regex;   // for CondType::Regex
+};
+
+struct Playlist::Filter::Data
+{
+    Index<Condition> conditions;  // sorted by type
+};
+
+struct Playlist::TextIndex::Data
+{
+    Snapshot rows;  // reference to the indexed rows
+    Index<Index<char>> arenas;
+    Index<const char *> texts;  // n_text_fields per row, nullptr if not set
+};
+
+/* appends a case-folded, nul-terminated copy of the text */
+static int append_folded (Index<char> & out, const char * text)
+{
+    int start = out.len ();
+    const char * s = text;
+
+    /* most tags are plain ASCII, which is much faster to fold by hand */
+    while (* s && ! (* s & 0x80))
+        s ++;
+
+    if (! * s)
+    {
+        for (s = text; * s; s ++)
+            out.append (g_ascii_tolower (* s));
+    }
+    else
+    {
+        CharPtr normal (g_utf8_normalize (text, -1, G_NORMALIZE_DEFAULT_COMPOSE));
+        CharPtr folded (g_utf8_casefold (normal ? normal : text, -1));
+        out.insert (folded, -1, strlen (folded));
+    }
+
+    out.append (0);
+    return start;
+}
+
+static int find_text_field (Tuple::Field field)
+{
+    for (int i = 0; i < n_text_fields; i ++)
+    {
+        if (text_fields[i] == field)
+            return i;
+    }
+
+    return -1;
+}
+
+static bool match_text (const Condition & cond, const char * folded)
+{
+    if (cond.type == CondType::Prefix)
+        return ! strncmp (folded, cond.pattern, cond.pattern_len);
+    else
+        return strstr (folded, cond.pattern);
+}
+
+/* <texts> points to the row's entries in a TextIndex, or is nullptr;
+ * <scratch> is used for case folding if there is no index */
+static bool match_row (const Index<Condition> & conditions,
+ const Playlist::Snapshot::Row & row, const char * const * texts, Index<char> & scratch)
+{
+    for (const Condition & cond : conditions)
+    {
+        if (cond.type == CondType::Range)
+        {
+            if (row.tuple.get_value_type (cond.field) != Tuple::Int)
+                return false;
+
+            int value = row.tuple.get_int (cond.field);
+            if (value < cond.min || value > cond.max)
+                return false;
+        }
+        else if (cond.type != CondType::Regex && texts && cond.text_field >= 0)
+        {
+            const char * text = texts[cond.text_field];
+            if (! text || ! match_text (cond, text))
+                return false;
+        }
+        else
+        {
+            String text = row.tuple.get_str (cond.field);
+            if (! text)
+                return false;
+
+            if (cond.type == CondType::Regex)
+            {
+                if (! g_regex_match (cond.regex.get (), text, (GRegexMatchFlags) 0, nullptr))
+                    return false;
+            }
+            else
+            {
+                scratch.remove (0, -1);
+                append_folded (scratch, text);
+
+                if (! match_text (cond, scratch.begin ()))
+                    return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+struct FilterChunk
+{
+    const Index<Condition> * conditions;
+    const Playlist::Snapshot * rows;
+    const char * const * texts;
+    bool * matches;
+    int first, last;
+};
+
+static void * filter_chunk (void * data)
+{
+    auto chunk = (FilterChunk *) data;
+    Index<char> scratch;
+
+    for (int i = chunk->first; i < chunk->last; i ++)
+    {
+        const char * const * texts = chunk->texts ? chunk->texts + i * n_text_fields : nullptr;
+        chunk->matches[i] = match_row (* chunk->conditions, (* chunk->rows)[i], texts, scratch);
+    }
+
+    return nullptr;
+}
+
+struct FoldChunk
+{
+    const Playlist::Snapshot * rows;
+    int first, last;
+
+    Index<char> arena;
+    Index<int> offsets;  // n_text_fields per row, -1 if not set
+};
+
+static void * fold_chunk (void * data)
+{
+    auto chunk = (FoldChunk *) data;
+
+    for (int i = chunk->first; i < chunk->last; i ++)
+    {
+        const Tuple & tuple = (* chunk->rows)[i].tuple;
+
+        for (Tuple::Field field : text_fields)
+        {
+            String text = tuple.get_str (field);
+            chunk->offsets.append (text ? append_folded (chunk->arena, text) : -1);
+        }
+    }
+
+    return nullptr;
+}
+
+static int count_chunks (int n_rows)
+{
+    return aud::clamp (n_rows / PARALLEL_FILTER_MIN, 1,
+     aud::min (g_get_num_processors (), MAX_FILTER_THREADS));
+}
+
+EXPORT Playlist::Filter::Filter () :
+    m_data (new Data) {}
+
+EXPORT Playlist::Filter::~Filter ()
+{
+    delete m_data;
+}
+
+EXPORT bool Playlist::Filter::add_text (Tuple::Field field, TextMatch match,
+ const char * pattern)
+{
+    if (! pattern || ! pattern[0])
+        return false;
+
+    Condition cond = Condition ();
+    cond.field = field;
+    cond.text_field = find_text_field (field);
+
+    if (match == Regex)
+    {
+        GError * error = nullptr;
+        cond.type = CondType::Regex;
+        cond.regex.capture (g_regex_new (pattern, G_REGEX_CASELESS,
+         (GRegexMatchFlags) 0, & error));
+
+        if (! cond.regex)
+        {
+            AUDWARN ("Invalid pattern %s: %s\n", pattern, error->message);
+            g_error_free (error);
+            return false;
+        }
+    }
+    else
+    {
+        Index<char> folded;
+        append_folded (folded, pattern);
+
+        cond.type = (match == Prefix) ? CondType::Prefix : CondType::Substring;
+        cond.pattern = String (folded.begin ());
+        cond.pattern_len = strlen (cond.pattern);
+    }
+
+    auto & conditions = m_data->conditions;
+    int at = 0;
+    while (at < conditions.len () && conditions[at].type <= cond.type)
+        at ++;
+
+    conditions.insert (at, 1);
+    conditions[at] = std::move (cond);
+
+    return true;
+}
+
+EXPORT void Playlist::Filter::add_range (Tuple::Field field, int min, int max)
+{
+    Condition cond = Condition ();
+    cond.type = CondType::Range;
+    cond.field = field;
+    cond.text_field = -1;
+    cond.min = min;
+    cond.max = max;
+
+    /* ranges are the cheapest to check, so they always go first */
+    m_data->conditions.insert (0, 1);
+    m_data->conditions[0] = std::move (cond);
+}
+
+EXPORT bool Playlist::Filter::is_empty () const
+{
+    return ! m_data->conditions.len ();
+}
+
+EXPORT Index<bool> Playlist::Filter::evaluate (const Snapshot & rows,
+ const TextIndex * text) const
+{
+    int n_rows = rows.len ();
+
+    Index<bool> matches;
+    matches.insert (0, n_rows);
+
+    const char * const * texts = nullptr;
+
+    if (text)
+    {
+        if (text->m_data->rows.begin () == rows.begin ())
+            texts = text->m_data->texts.begin ();
+        else
+            AUDWARN ("Text index does not match the rows being filtered.\n");
+    }
+
+    int n_chunks = count_chunks (n_rows);
+
+    Index<FilterChunk> chunks;
+    chunks.insert (0, n_chunks);
+
+    for (int c = 0; c < n_chunks; c ++)
+    {
+        chunks[c].conditions = & m_data->conditions;
+        chunks[c].rows = & rows;
+        chunks[c].texts = texts;
+        chunks[c].matches = matches.begin ();
+        chunks[c].first = (int64_t) n_rows * c / n_chunks;
+        chunks[c].last = (int64_t) n_rows * (c + 1) / n_chunks;
+    }
+
+    run_parallel (chunks, filter_chunk);
+
+    return matches;
+}
+
+EXPORT Playlist::TextIndex::TextIndex (const Snapshot & rows) :
+    m_data (new Data)
+{
+    int n_rows = rows.len ();
+    int n_chunks = count_chunks (n_rows);
+
+    Index<FoldChunk> chunks;
+    chunks.insert (0, n_chunks);
+
+    for (int c = 0; c < n_chunks; c ++)
+    {
+        chunks[c].rows = & rows;
+        chunks[c].first = (int64_t) n_rows * c / n_chunks;
+        chunks[c].last = (int64_t) n_rows * (c + 1) / n_chunks;
+    }
+
+    run_parallel (chunks, fold_chunk);
+
+    m_data->rows = rows.ref ();
+    m_data->texts.insert (0, n_rows * n_text_fields);
+
+    /* the arenas are no longer resized, so pointers into them are stable */
+    for (auto & chunk : chunks)
+    {
+        int base = chunk.first * n_text_fields;
+
+        for (int i = 0; i < chunk.offsets.len (); i ++)
+        {
+            if (chunk.offsets[i] >= 0)
+                m_data->texts[base + i] = chunk.arena.begin () + chunk.offsets[i];
+        }
+
+        m_data->arenas.append (std::move (chunk.arena));
+    }
+}
+
+EXPORT Playlist::TextIndex::~TextIndex ()
+{
+    delete m_data;
+}
+
+EXPORT void Playlist::select_by_filter (const Filter & filter) const
+{
+    if (filter.is_empty ())
+    {
+        select_all (true);
+        return;
+    }
+
+    Snapshot rows = snapshot (0, -1, Wait);
+    PlaylistEx (* this).select_entries (0, filter.evaluate (rows));
+}
+
+/* true if the pattern has no characters with a special meaning in a regular
+ * expression, and can therefore be matched as plain text */
+static bool is_plain_text (const char * pattern)
+{
+    return ! pattern[strcspn (pattern, "\\^$.|?*+()[]{}")];
+}
+
+EXPORT void Playlist::select_by_patterns (const Tuple & patterns) const
+{
+    Filter filter;
+
+    for (Tuple::Field field : {Tuple::Title, Tuple::Album, Tuple::Artist, Tuple::Basename})
+    {
+        String pattern = patterns.get_str (field);
+        if (! pattern || ! pattern[0])
+            continue;
+
+        /* "^" alone would match anything */
+        if (pattern[0] == '^' && is_plain_text (pattern + 1))
+        {
+            if (pattern[1])
+                filter.add_text (field, Filter::Prefix, pattern + 1);
+        }
+        else if (is_plain_text (pattern))
+            filter.add_text (field, Filter::Substring, pattern);
+        else
+            filter.add_text (field, Filter::Regex, pattern);
+    }
+
+    select_by_filter (filter);
+}
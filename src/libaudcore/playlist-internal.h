@@ -45,12 +45,27 @@ public:
     int stamp () const;
 
     static Playlist insert_with_stamp (int at, int stamp);
+    static Playlist get_resume_playlist ();
 
     bool get_modified () const;
     void set_modified (bool modified) const;
 
     bool insert_flat_playlist (const char * filename) const;
     void insert_flat_items (int at, Index<PlaylistAddItem> && items) const;
+    void apply_saved_state () const;
+
+    /* sets the selection of entries <at> through <at> + selected.len () - 1
+     * at once, with a single update */
+    void select_entries (int at, const Index<bool> & selected) const;
+
+    /* changes whenever entries are added, removed, or moved */
+    int structure_serial () const;
+
+    /* removes the entries flagged in <remove>, unless structure_serial() has
+     * changed from <serial> in the meantime */
+    bool remove_flagged (const Index<bool> & remove, int serial) const;
+
+    void sort_by_scheme (SortType scheme, bool selected_only) const;
 };
 
 /* playlist.cc */
@@ -69,8 +84,16 @@ void playback_entry_set_tuple (int serial, Tuple && tuple);
 void playlist_cache_load (Index<PlaylistAddItem> & items);
 void playlist_cache_clear (void * = nullptr);
 
+/* playlist-availability.cc */
+void playlist_availability_cleanup ();
+
+/* playlist-duplicates.cc */
+void playlist_duplicates_cleanup ();
+
 /* playlist-files.cc */
 bool playlist_load (const char * filename, String & title, Index<PlaylistAddItem> & items);
+bool playlist_save_local (const char * path, const char * title,
+ const Index<PlaylistAddItem> & items);
 
 /* playlist-utils.cc */
 void load_playlists ();
@@ -0,0 +1,351 @@
+/*
+ * playlist-sort.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "playlist-data.h"
+#include "internal.h"
+
+#include <string.h>
+
+#include <glib.h>  /* for g_get_num_processors */
+
+#include "tuple.h"
+
+/* below this many entries per thread, sorting is not split up */
+#define PARALLEL_SORT_MIN 16384
+#define MAX_SORT_THREADS 8
+
+/*
+ * Rather than calling str_compare() and friends for every comparison (which
+ * fetches the strings from the tuples and re-parses them each time), a sort
+ * key is computed once per entry.  Text keys are byte strings which compare
+ * with memcmp() in the same order as str_compare(): letters are folded to
+ * lower case, and each run of digits is replaced by a '0' marker, the number
+ * of significant digits, and the digits themselves, so that numbers compare
+ * by value.
+ */
+enum class KeyType {
+    Path,
+    Basename,
+    String,
+    Int
+};
+
+struct KeyInfo {
+    KeyType type;
+    Tuple::Field field;
+};
+
+static const KeyInfo key_info[] = {
+    {KeyType::Path, Tuple::Invalid},
+    {KeyType::Basename, Tuple::Invalid},
+    {KeyType::String, Tuple::Title},
+    {KeyType::String, Tuple::Album},
+    {KeyType::String, Tuple::Artist},
+    {KeyType::String, Tuple::AlbumArtist},
+    {KeyType::Int, Tuple::Year},
+    {KeyType::String, Tuple::Genre},
+    {KeyType::Int, Tuple::Track},
+    {KeyType::String, Tuple::FormattedTitle},
+    {KeyType::Int, Tuple::Length},
+    {KeyType::String, Tuple::Comment}
+};
+
+static_assert (aud::n_elems (key_info) == Playlist::n_sort_types,
+ "Update playlist sort keys");
+
+struct SortKey
+{
+    bool is_set;
+    int num;          // for KeyType::Int
+    int text, len;    // for text keys, offset and length in the arena
+    const char * ptr; // set once the arena is complete
+};
+
+static int from_hex (char c)
+{
+    if (c >= '0' && c <= '9')
+        return c - '0';
+    if (c >= 'a' && c <= 'f')
+        return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F')
+        return c - 'A' + 10;
+
+    return 0;
+}
+
+static void append_collation_key (Index<char> & out, const char * s, bool decode)
+{
+    while (* s)
+    {
+        unsigned char c = * s ++;
+
+        if (decode && c == '%' && s[0] && s[1])
+        {
+            c = (from_hex (s[0]) << 4) | from_hex (s[1]);
+            s += 2;
+        }
+
+        if (c >= '0' && c <= '9')
+        {
+            /* skip leading zeroes, but keep at least one digit */
+            while (c == '0' && * s >= '0' && * s <= '9')
+                c = * s ++;
+
+            const char * digits = s - 1;
+            int n_digits = 1;
+
+            while (* s >= '0' && * s <= '9')
+                s ++, n_digits ++;
+
+            out.append ('0');
+            out.append ((char) aud::min (n_digits, 255));
+
+            if (c == (unsigned char) * digits)
+                out.insert (digits, -1, n_digits);
+            else
+            {
+                /* first digit was percent-encoded */
+                out.append (c);
+                out.insert (digits + 1, -1, n_digits - 1);
+            }
+        }
+        else
+        {
+            if (c >= 'A' && c <= 'Z')
+                c += 'a' - 'A';
+
+            out.append (c);
+        }
+    }
+}
+
+static void make_key (SortKey & key, Index<char> & arena, KeyInfo info,
+ const PlaylistData::SortItem & item)
+{
+    key = SortKey ();
+
+    if (info.type == KeyType::Int)
+    {
+        if (item.tuple.get_value_type (info.field) == Tuple::Int)
+        {
+            key.is_set = true;
+            key.num = item.tuple.get_int (info.field);
+        }
+
+        return;
+    }
+
+    String str;
+    const char * text;
+
+    if (info.type == KeyType::String)
+    {
+        str = item.tuple.get_str (info.field);
+        text = str;
+    }
+    else
+    {
+        text = item.filename;
+
+        if (text && info.type == KeyType::Basename)
+        {
+            const char * slash = strrchr (text, '/');
+            if (slash)
+                text = slash + 1;
+        }
+    }
+
+    if (! text)
+        return;
+
+    key.is_set = true;
+    key.text = arena.len ();
+    append_collation_key (arena, text, info.type != KeyType::String);
+    key.len = arena.len () - key.text;
+}
+
+bool PlaylistData::append_sort_key (Playlist::SortType scheme,
+ const SortItem & item, Index<char> & key) // static
+{
+    KeyInfo info = key_info[scheme];
+    SortKey sort_key;
+
+    make_key (sort_key, key, info, item);
+
+    if (! sort_key.is_set)
+        return false;
+
+    if (info.type == KeyType::Int)
+        key.insert ((const char *) & sort_key.num, -1, sizeof sort_key.num);
+
+    /* an empty string is no better than a missing one */
+    return info.type == KeyType::Int || sort_key.len > 0;
+}
+
+/* ties are broken by the original position, which makes the sort stable */
+static int compare_keys (const SortKey * keys, int a, int b)
+{
+    const SortKey & ka = keys[a];
+    const SortKey & kb = keys[b];
+
+    if (ka.is_set != kb.is_set)
+        return ka.is_set ? 1 : -1;
+
+    /* integer keys have no text, and text keys have num = 0 */
+    if (ka.num != kb.num)
+        return (ka.num < kb.num) ? -1 : 1;
+
+    int len = aud::min (ka.len, kb.len);
+    int diff = len ? memcmp (ka.ptr, kb.ptr, len) : 0;
+
+    if (diff)
+        return diff;
+    if (ka.len != kb.len)
+        return (ka.len < kb.len) ? -1 : 1;
+
+    return a - b;
+}
+
+struct SortChunk
+{
+    KeyInfo info;
+    const Index<PlaylistData::SortItem> * items;
+    SortKey * keys;
+    int first, last;
+
+    Index<char> arena;
+    Index<int> order;
+};
+
+struct MergeTask
+{
+    const SortKey * keys;
+    const Index<int> * a, * b;
+    Index<int> out;
+};
+
+static void * sort_chunk (void * data)
+{
+    auto chunk = (SortChunk *) data;
+
+    for (int i = chunk->first; i < chunk->last; i ++)
+        make_key (chunk->keys[i], chunk->arena, chunk->info, (* chunk->items)[i]);
+
+    /* the arena is no longer resized, so pointers into it are now stable */
+    for (int i = chunk->first; i < chunk->last; i ++)
+    {
+        SortKey & key = chunk->keys[i];
+        if (key.is_set && chunk->info.type != KeyType::Int)
+            key.ptr = chunk->arena.begin () + key.text;
+    }
+
+    chunk->order.insert (0, chunk->last - chunk->first);
+    for (int i = chunk->first; i < chunk->last; i ++)
+        chunk->order[i - chunk->first] = i;
+
+    const SortKey * keys = chunk->keys;
+    chunk->order.sort ([keys] (int a, int b)
+        { return compare_keys (keys, a, b); });
+
+    return nullptr;
+}
+
+static void * merge_chunks (void * data)
+{
+    auto task = (MergeTask *) data;
+    const Index<int> & a = * task->a;
+    const Index<int> & b = * task->b;
+
+    task->out.insert (0, a.len () + b.len ());
+
+    int i = 0, j = 0, k = 0;
+    while (i < a.len () && j < b.len ())
+    {
+        if (compare_keys (task->keys, a[i], b[j]) <= 0)
+            task->out[k ++] = a[i ++];
+        else
+            task->out[k ++] = b[j ++];
+    }
+
+    while (i < a.len ())
+        task->out[k ++] = a[i ++];
+    while (j < b.len ())
+        task->out[k ++] = b[j ++];
+
+    return nullptr;
+}
+
+/* returns the new order of the items, as indexes into the given list;
+ * does not access any playlist data, so it can be called without locking */
+Index<int> PlaylistData::sort_items (Playlist::SortType scheme,
+ const Index<SortItem> & items) // static
+{
+    int n_items = items.len ();
+
+    Index<SortKey> keys;
+    keys.resize (n_items);
+
+    int n_chunks = aud::clamp (n_items / PARALLEL_SORT_MIN, 1,
+     aud::min (g_get_num_processors (), MAX_SORT_THREADS));
+
+    Index<SortChunk> chunks;
+    chunks.insert (0, n_chunks);
+
+    for (int c = 0; c < n_chunks; c ++)
+    {
+        chunks[c].info = key_info[scheme];
+        chunks[c].items = & items;
+        chunks[c].keys = keys.begin ();
+        chunks[c].first = (int64_t) n_items * c / n_chunks;
+        chunks[c].last = (int64_t) n_items * (c + 1) / n_chunks;
+    }
+
+    run_parallel (chunks, sort_chunk);
+
+    Index<Index<int>> sorted;
+    for (auto & chunk : chunks)
+        sorted.append (std::move (chunk.order));
+
+    /* merge pairs of sorted runs until only one is left */
+    while (sorted.len () > 1)
+    {
+        Index<MergeTask> tasks;
+        tasks.insert (0, sorted.len () / 2);
+
+        for (int i = 0; i < tasks.len (); i ++)
+        {
+            tasks[i].keys = keys.begin ();
+            tasks[i].a = & sorted[2 * i];
+            tasks[i].b = & sorted[2 * i + 1];
+        }
+
+        run_parallel (tasks, merge_chunks);
+
+        Index<Index<int>> merged;
+        for (auto & task : tasks)
+            merged.append (std::move (task.out));
+
+        if (sorted.len () % 2)
+            merged.append (std::move (sorted[sorted.len () - 1]));
+
+        sorted = std::move (merged);
+    }
+
+    return n_items ? std::move (sorted[0]) : Index<int> ();
+}
@@ -18,7 +18,9 @@
  */
 
 #include "playlist-internal.h"
+#include "internal.h"
 
+#include <pthread.h>
 #include <stdlib.h>
 #include <string.h>
 
@@ -26,263 +28,281 @@
 
 #include "audstrings.h"
 #include "hook.h"
+#include "mainloop.h"
 #include "multihash.h"
 #include "runtime.h"
 #include "tuple.h"
 #include "vfs.h"
 
-static const char * get_basename (const char * filename)
-{
-    const char * slash = strrchr (filename, '/');
-    return slash ? slash + 1 : filename;
-}
-
-static int filename_compare_basename (const char * a, const char * b)
-{
-    return str_compare_encoded (get_basename (a), get_basename (b));
-}
+EXPORT void Playlist::sort_entries (SortType scheme) const
+    { PlaylistEx (* this).sort_by_scheme (scheme, false); }
+EXPORT void Playlist::sort_selected (SortType scheme) const
+    { PlaylistEx (* this).sort_by_scheme (scheme, true); }
 
-static int tuple_compare_string (const Tuple & a, const Tuple & b, Tuple::Field field)
+static StringBuf make_playlist_path (int playlist)
 {
-    String string_a = a.get_str (field);
-    String string_b = b.get_str (field);
-
-    if (! string_a)
-        return (! string_b) ? 0 : -1;
+    if (! playlist)
+        return filename_build ({aud_get_path (AudPath::UserDir), "playlist.xspf"});
 
-    return (! string_b) ? 1 : str_compare (string_a, string_b);
+    return filename_build ({aud_get_path (AudPath::UserDir),
+                            str_printf ("playlist_%02d.xspf", 1 + playlist)});
 }
 
-static int tuple_compare_int (const Tuple & a, const Tuple & b, Tuple::Field field)
-{
-    if (a.get_value_type (field) != Tuple::Int)
-        return (b.get_value_type (field) != Tuple::Int) ? 0 : -1;
-    if (b.get_value_type (field) != Tuple::Int)
-        return 1;
+/* playlists are local files, so parsing them is mostly CPU-bound */
+#define LOAD_THREADS 4
 
-    int int_a = a.get_int (field);
-    int int_b = b.get_int (field);
-
-    return (int_a < int_b) ? -1 : (int_a > int_b);
-}
-
-static int tuple_compare_title (const Tuple & a, const Tuple & b)
-    { return tuple_compare_string (a, b, Tuple::Title); }
-static int tuple_compare_album (const Tuple & a, const Tuple & b)
-    { return tuple_compare_string (a, b, Tuple::Album); }
-static int tuple_compare_artist (const Tuple & a, const Tuple & b)
-    { return tuple_compare_string (a, b, Tuple::Artist); }
-static int tuple_compare_album_artist (const Tuple & a, const Tuple & b)
-    { return tuple_compare_string (a, b, Tuple::AlbumArtist); }
-static int tuple_compare_date (const Tuple & a, const Tuple & b)
-    { return tuple_compare_int (a, b, Tuple::Year); }
-static int tuple_compare_genre (const Tuple & a, const Tuple & b)
-    { return tuple_compare_string (a, b, Tuple::Genre); }
-static int tuple_compare_track (const Tuple & a, const Tuple & b)
-    { return tuple_compare_int (a, b, Tuple::Track); }
-static int tuple_compare_formatted_title (const Tuple & a, const Tuple & b)
-    { return tuple_compare_string (a, b, Tuple::FormattedTitle); }
-static int tuple_compare_length (const Tuple & a, const Tuple & b)
-    { return tuple_compare_int (a, b, Tuple::Length); }
-static int tuple_compare_comment (const Tuple & a, const Tuple & b)
-    { return tuple_compare_string (a, b, Tuple::Comment); }
-
-static const Playlist::StringCompareFunc filename_comparisons[] = {
-    str_compare_encoded,  // path
-    filename_compare_basename,  // filename
-    nullptr,  // title
-    nullptr,  // album
-    nullptr,  // artist
-    nullptr,  // album artist
-    nullptr,  // date
-    nullptr,  // genre
-    nullptr,  // track
-    nullptr,  // formatted title
-    nullptr,  // length
-    nullptr   // comment
-};
+/*
+ * At startup, all the playlists are first created empty.  The active playlist
+ * and the one to be resumed are then loaded right away, and the rest are
+ * parsed by a thread pool and filled in by the main thread as they finish.
+ * Until then, such a playlist is not marked as modified, so it is never saved
+ * in its empty state.  Playlist plugins are thread-safe (the adder also calls
+ * them from a worker thread).
+ */
+struct LoadJob
+{
+    Playlist playlist;
+    String uri;
+    bool save_again;  // to convert from an old format
 
-static const Playlist::TupleCompareFunc tuple_comparisons[] = {
-    nullptr,  // path
-    nullptr,  // filename
-    tuple_compare_title,
-    tuple_compare_album,
-    tuple_compare_artist,
-    tuple_compare_album_artist,
-    tuple_compare_date,
-    tuple_compare_genre,
-    tuple_compare_track,
-    tuple_compare_formatted_title,
-    tuple_compare_length,
-    tuple_compare_comment
+    bool loaded;
+    String title;
+    Index<PlaylistAddItem> items;
 };
 
-static_assert (aud::n_elems (filename_comparisons) == Playlist::n_sort_types &&
- aud::n_elems (tuple_comparisons) == Playlist::n_sort_types,
- "Update playlist comparison functions");
+static pthread_mutex_t load_mutex = PTHREAD_MUTEX_INITIALIZER;
+static GThreadPool * load_pool;
+static Index<LoadJob *> loads_done;  // parsed, but not yet inserted
+static int loads_pending;
+static int64_t load_start;
+static QueuedFunc queued_insert;
 
-EXPORT void Playlist::sort_entries (SortType scheme) const
+static LoadJob * add_load_job (Index<LoadJob *> & jobs, Playlist playlist,
+ const char * path, bool save_again)
 {
-    if (filename_comparisons[scheme])
-        sort_by_filename (filename_comparisons[scheme]);
-    else if (tuple_comparisons[scheme])
-        sort_by_tuple (tuple_comparisons[scheme]);
-}
+    auto job = new LoadJob ();
+    job->playlist = playlist;
+    job->uri = String (filename_to_uri (path));
+    job->save_again = save_again;
 
-EXPORT void Playlist::sort_selected (SortType scheme) const
-{
-    if (filename_comparisons[scheme])
-        sort_selected_by_filename (filename_comparisons[scheme]);
-    else if (tuple_comparisons[scheme])
-        sort_selected_by_tuple (tuple_comparisons[scheme]);
+    jobs.append (job);
+    return job;
 }
 
-/* FIXME: this considers empty fields as duplicates */
-EXPORT void Playlist::remove_duplicates (SortType scheme) const
+static Index<LoadJob *> create_playlists ()
 {
-    int entries = n_entries ();
-    if (entries < 1)
-        return;
+    const char * folder = aud_get_path (AudPath::PlaylistDir);
+    Index<LoadJob *> jobs;
 
-    select_all (false);
+    /* old (v3.1 and earlier) naming scheme */
 
-    if (filename_comparisons[scheme])
+    int count;
+    for (count = 0; ; count ++)
     {
-        StringCompareFunc compare = filename_comparisons[scheme];
+        StringBuf path = make_playlist_path (count);
+        if (! g_file_test (path, G_FILE_TEST_EXISTS))
+            break;
 
-        sort_by_filename (compare);
-        String last = entry_filename (0);
+        add_load_job (jobs, Playlist::insert_playlist (count), path, true);
+    }
 
-        for (int i = 1; i < entries; i ++)
-        {
-            String current = entry_filename (i);
+    /* unique ID-based naming scheme */
 
-            if (compare (last, current) == 0)
-                select_entry (i, true);
+    StringBuf order_path = filename_build ({folder, "order"});
+    auto order_string = VFSFile::read_file (order_path,
+        VFSReadOptions (VFS_APPEND_NULL | VFS_IGNORE_MISSING));
+    auto order = str_list_to_index (order_string.begin (), " ");
 
-            last = current;
-        }
-    }
-    else if (tuple_comparisons[scheme])
+    for (int i = 0; i < order.len (); i ++)
     {
-        TupleCompareFunc compare = tuple_comparisons[scheme];
+        const char * number = order[i];
+
+        StringBuf path = filename_build ({folder, str_concat ({number, ".audpl"})});
+        if (! g_file_test (path, G_FILE_TEST_EXISTS))
+            path = filename_build ({folder, str_concat ({number, ".xspf"})});
 
-        sort_by_tuple (compare);
-        Tuple last = entry_tuple (0);
+        add_load_job (jobs, PlaylistEx::insert_with_stamp (count + i, atoi (number)),
+         path, g_str_has_suffix (path, ".xspf"));
+    }
 
-        for (int i = 1; i < entries; i ++)
-        {
-            Tuple current = entry_tuple (i);
+    if (! Playlist::n_playlists ())
+        Playlist::insert_playlist (0);
 
-            if (last.valid () && current.valid () && compare (last, current) == 0)
-                select_entry (i, true);
+    return jobs;
+}
 
-            last = std::move (current);
-        }
+static void finish_load_job (LoadJob * job)
+{
+    PlaylistEx playlist = job->playlist;
+
+    if (job->loaded)
+    {
+        /* the user may already have added to (or renamed) the playlist */
+        bool touched = playlist.get_modified ();
+
+        if (job->title && ! touched)
+            playlist.set_title (job->title);
+
+        playlist.insert_flat_items (0, std::move (job->items));
+        playlist.set_modified (touched || job->save_again);
     }
 
-    remove_selected ();
+    playlist.apply_saved_state ();
+    delete job;
 }
 
-EXPORT void Playlist::remove_unavailable () const
+static void insert_loaded (void *)
 {
-    int entries = n_entries ();
+    pthread_mutex_lock (& load_mutex);
+    auto done = std::move (loads_done);
+    pthread_mutex_unlock (& load_mutex);
 
-    select_all (false);
+    for (LoadJob * job : done)
+    {
+        finish_load_job (job);
+        loads_pending --;
+    }
 
-    for (int i = 0; i < entries; i ++)
+    if (load_pool && ! loads_pending)
     {
-        String filename = entry_filename (i);
+        startup_profile_report ("playlists (background)", load_start);
 
-        /* use VFS_NO_ACCESS since VFS_EXISTS doesn't distinguish between
-         * inaccessible files and URI schemes that don't support file_test() */
-        if (VFSFile::test_file (filename, VFS_NO_ACCESS))
-            select_entry (i, true);
+        g_thread_pool_free (load_pool, false, true);
+        load_pool = nullptr;
     }
-
-    remove_selected ();
 }
 
-EXPORT void Playlist::select_by_patterns (const Tuple & patterns) const
+static void load_worker (void * data, void *)
 {
-    int entries = n_entries ();
+    auto job = (LoadJob *) data;
+    job->loaded = playlist_load (job->uri, job->title, job->items);
 
-    select_all (true);
+    pthread_mutex_lock (& load_mutex);
+    loads_done.append (job);
+    queued_insert.queue (insert_loaded, nullptr);
+    pthread_mutex_unlock (& load_mutex);
+}
 
-    for (Tuple::Field field : {Tuple::Title, Tuple::Album, Tuple::Artist, Tuple::Basename})
-    {
-        String pattern = patterns.get_str (field);
-        GRegex * regex;
+static void load_playlists_real ()
+{
+    auto jobs = create_playlists ();
 
-        if (! pattern || ! pattern[0] || ! (regex = g_regex_new (pattern,
-         G_REGEX_CASELESS, (GRegexMatchFlags) 0, nullptr)))
-            continue;
+    /* needs to know the playlists, but not their contents */
+    playlist_load_state ();
 
-        for (int i = 0; i < entries; i ++)
-        {
-            if (! entry_selected (i))
-                continue;
+    Playlist active = Playlist::active_playlist ();
+    Playlist resume = PlaylistEx::get_resume_playlist ();
 
-            Tuple tuple = entry_tuple (i);
-            String string = tuple.get_str (field);
+    load_start = g_get_monotonic_time ();
 
-            if (! string || ! g_regex_match (regex, string, (GRegexMatchFlags) 0, nullptr))
-                select_entry (i, false);
+    for (LoadJob * job : jobs)
+    {
+        if (job->playlist == active || job->playlist == resume)
+        {
+            job->loaded = playlist_load (job->uri, job->title, job->items);
+            finish_load_job (job);
         }
+        else
+        {
+            if (! load_pool)
+                load_pool = g_thread_pool_new (load_worker, nullptr, LOAD_THREADS, false, nullptr);
 
-        g_regex_unref (regex);
+            loads_pending ++;
+            g_thread_pool_push (load_pool, job, nullptr);
+        }
     }
 }
 
-static StringBuf make_playlist_path (int playlist)
+/* waits for the remaining playlists to be loaded, so that none of them (or
+ * their saved state) is lost when exiting */
+static void finish_loading ()
 {
-    if (! playlist)
-        return filename_build ({aud_get_path (AudPath::UserDir), "playlist.xspf"});
+    if (! load_pool)
+        return;
 
-    return filename_build ({aud_get_path (AudPath::UserDir),
-                            str_printf ("playlist_%02d.xspf", 1 + playlist)});
+    g_thread_pool_free (load_pool, false, true);
+    load_pool = nullptr;
+
+    queued_insert.stop ();
+    insert_loaded (nullptr);
 }
 
-static void load_playlists_real ()
+/*
+ * Playlists are saved by a background thread, so that saving a large playlist
+ * does not block the UI.  The main thread only takes a snapshot of each
+ * modified playlist; everything else (formatting the playlist, writing the
+ * files, and cleaning up old ones) is done from that snapshot.  There is only
+ * one writer thread, so saves are always carried out in the order queued.
+ */
+struct SaveJob
 {
-    const char * folder = aud_get_path (AudPath::PlaylistDir);
+    Playlist playlist;
+    String path, title;
+    Playlist::Snapshot rows;
+};
 
-    /* old (v3.1 and earlier) naming scheme */
+struct SaveBatch
+{
+    Index<SaveJob> jobs;
+    String order;                   // contents of the "order" file
+    SimpleHash<String, bool> keep;  // names of all current playlist files
+};
 
-    int count;
-    for (count = 0; ; count ++)
+static void save_worker (void * data)
+{
+    auto batch = (SaveBatch *) data;
+    const char * folder = aud_get_path (AudPath::PlaylistDir);
+
+    for (SaveJob & job : batch->jobs)
     {
-        StringBuf path = make_playlist_path (count);
-        if (! g_file_test (path, G_FILE_TEST_EXISTS))
-            break;
+        Index<PlaylistAddItem> items;
 
-        PlaylistEx playlist = Playlist::insert_playlist (count);
-        playlist.insert_flat_playlist (filename_to_uri (path));
-        playlist.set_modified (true);
-    }
+        for (auto & row : job.rows)
+        {
+            auto & item = items.append (row.filename, row.tuple.ref ());
+            item.tuple.delete_fallbacks ();
+        }
 
-    /* unique ID-based naming scheme */
+        /* the snapshot is no longer needed; release it early */
+        job.rows = Playlist::Snapshot ();
+
+        AUDINFO ("Saving playlist %s.\n", (const char *) job.path);
+
+        /* try again next time */
+        if (! playlist_save_local (job.path, job.title, items))
+            PlaylistEx (job.playlist).set_modified (true);
+    }
 
     StringBuf order_path = filename_build ({folder, "order"});
-    auto order_string = VFSFile::read_file (order_path,
+    auto old_order = VFSFile::read_file (order_path,
         VFSReadOptions (VFS_APPEND_NULL | VFS_IGNORE_MISSING));
-    auto order = str_list_to_index (order_string.begin (), " ");
 
-    for (int i = 0; i < order.len (); i ++)
+    if (strcmp (old_order.begin (), batch->order) &&
+     ! g_file_set_contents (order_path, batch->order, -1, nullptr))
+        AUDERR ("Error saving %s.\n", (const char *) order_path);
+
+    /* clean up deleted playlists and files from old naming scheme */
+
+    g_unlink (make_playlist_path (0));
+
+    GDir * dir = g_dir_open (folder, 0, nullptr);
+
+    if (dir)
     {
-        const char * number = order[i];
+        const char * name;
+        while ((name = g_dir_read_name (dir)))
+        {
+            if (! g_str_has_suffix (name, ".audpl") && ! g_str_has_suffix (name, ".xspf"))
+                continue;
 
-        StringBuf path = filename_build ({folder, str_concat ({number, ".audpl"})});
-        if (! g_file_test (path, G_FILE_TEST_EXISTS))
-            path = filename_build ({folder, str_concat ({number, ".xspf"})});
+            if (! batch->keep.lookup (String (name)))
+                g_unlink (filename_build ({folder, name}));
+        }
 
-        PlaylistEx playlist = PlaylistEx::insert_with_stamp (count + i, atoi (number));
-        playlist.insert_flat_playlist (filename_to_uri (path));
-        playlist.set_modified (g_str_has_suffix (path, ".xspf"));
+        g_dir_close (dir);
     }
 
-    if (! Playlist::n_playlists ())
-        Playlist::insert_playlist (0);
+    delete batch;
 }
 
 static void save_playlists_real ()
@@ -290,10 +310,8 @@ static void save_playlists_real ()
     int lists = Playlist::n_playlists ();
     const char * folder = aud_get_path (AudPath::PlaylistDir);
 
-    /* save playlists */
-
+    auto batch = new SaveBatch;
     Index<String> order;
-    SimpleHash<String, bool> saved;
 
     for (int i = 0; i < lists; i ++)
     {
@@ -303,42 +321,22 @@ static void save_playlists_real ()
 
         if (playlist.get_modified ())
         {
-            StringBuf path = filename_build ({folder, name});
-            playlist.save_to_file (filename_to_uri (path), Playlist::NoWait);
+            SaveJob & job = batch->jobs.append ();
+            job.playlist = playlist;
+            job.path = String (filename_build ({folder, name}));
+            job.title = playlist.get_title ();
+            job.rows = playlist.snapshot ();
+
             playlist.set_modified (false);
         }
 
         order.append (String (number));
-        saved.add (String (name), true);
+        batch->keep.add (String (name), true);
     }
 
-    StringBuf order_string = index_to_str_list (order, " ");
-    StringBuf order_path = filename_build ({folder, "order"});
-    auto old_order_string = VFSFile::read_file (order_path,
-        VFSReadOptions (VFS_APPEND_NULL | VFS_IGNORE_MISSING));
-
-    if (strcmp (old_order_string.begin (), order_string))
-        VFSFile::write_file (order_path, (const char *) order_string, order_string.len ());
-
-    /* clean up deleted playlists and files from old naming scheme */
+    batch->order = String (index_to_str_list (order, " "));
 
-    g_unlink (make_playlist_path (0));
-
-    GDir * dir = g_dir_open (folder, 0, nullptr);
-    if (! dir)
-        return;
-
-    const char * name;
-    while ((name = g_dir_read_name (dir)))
-    {
-        if (! g_str_has_suffix (name, ".audpl") && ! g_str_has_suffix (name, ".xspf"))
-            continue;
-
-        if (! saved.lookup (String (name)))
-            g_unlink (filename_build ({folder, name}));
-    }
-
-    g_dir_close (dir);
+    persist_queue (save_worker, batch);
 }
 
 static bool hooks_added, state_changed;
@@ -358,7 +356,6 @@ static void state_cb (void * data, void * user)
 void load_playlists ()
 {
     load_playlists_real ();
-    playlist_load_state ();
 
     state_changed = false;
 
@@ -374,6 +371,9 @@ void load_playlists ()
 
 void save_playlists (bool exiting)
 {
+    if (exiting)
+        finish_loading ();
+
     save_playlists_real ();
 
     /* on exit, save resume states */
@@ -383,6 +383,10 @@ void save_playlists (bool exiting)
         state_changed = false;
     }
 
+    /* on exit, wait for everything to be written */
+    if (exiting)
+        persist_wait ();
+
     if (exiting && hooks_added)
     {
         hook_dissociate ("playlist update", update_cb);
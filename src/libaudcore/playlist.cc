@@ -38,6 +38,7 @@
 #include "parse.h"
 #include "playlist-data.h"
 #include "runtime.h"
+#include "vfs.h"
 
 enum {
     ResumeStop,
@@ -120,6 +121,31 @@ static Playlist::ID * playing_id = nullptr;
 static int resume_playlist = -1;
 static bool resume_paused = false;
 
+/* Per-playlist state which can only be restored once the entries have been
+ * loaded.  At startup, most playlists are loaded in the background, so this is
+ * held until PlaylistEx::apply_saved_state() is called for each of them. */
+struct SavedState
+{
+    Playlist::ID * id;
+    int position;
+    Index<int> history;
+};
+
+static Index<SavedState> saved_states;
+
+struct SortJob : public ListNode
+{
+    Playlist::ID * id;
+    Playlist::SortType scheme;
+    bool selected_only;
+    bool cancelled;
+};
+
+/* smaller playlists are always sorted synchronously */
+#define BACKGROUND_SORT_MIN 20000
+
+static List<SortJob> sort_jobs;
+
 static QueuedFunc queued_update;
 static Playlist::UpdateLevel update_level;
 static int update_hooks;
@@ -135,11 +161,22 @@ struct ScanItem : public ListNode
         for_playback (for_playback),
         handled_by_playback (false) {}
 
+    /* the scan is finished or canceled either way */
+    ~ScanItem ()
+    {
+        for (int * pending : waiters)
+            (* pending) --;
+    }
+
     PlaylistData * playlist;
     PlaylistEntry * entry;
     ScanRequest * request;
     bool for_playback;
     bool handled_by_playback;
+
+    /* counts of scans still pending, one for each Playlist::snapshot() call
+     * waiting on this entry */
+    Index<int *> waiters;
 };
 
 static bool scan_enabled_nominal, scan_enabled;
@@ -298,16 +335,19 @@ static ScanItem * scan_list_find_entry (PlaylistEntry * entry)
     return scan_list.find (match);
 }
 
-static void scan_queue_entry (PlaylistData * playlist, PlaylistEntry * entry, bool for_playback = false)
+static ScanItem * scan_queue_entry (PlaylistData * playlist, PlaylistEntry * entry, bool for_playback = false)
 {
     int extra_flags = for_playback ? (SCAN_IMAGE | SCAN_FILE) : 0;
     auto request = playlist->create_scan_request (entry, scan_finish, extra_flags);
+    auto item = new ScanItem (playlist, entry, request, for_playback);
 
-    scan_list.append (new ScanItem (playlist, entry, request, for_playback));
+    scan_list.append (item);
 
     /* playback entry will be scanned by the playback thread */
     if (! for_playback)
         scanner_request (request);
+
+    return item;
 }
 
 static void scan_reset_playback ()
@@ -442,6 +482,8 @@ static void scan_cancel (PlaylistEntry * entry)
 
     scan_list.remove (item);
     delete (item);
+
+    pthread_cond_broadcast (& cond);
 }
 
 static void scan_restart ()
@@ -649,6 +691,13 @@ void playlist_end ()
 
     ENTER;
 
+    /* abandon any background sorts and wait for them to exit */
+    for (SortJob * job = sort_jobs.head (); job; job = sort_jobs.next (job))
+        job->cancelled = true;
+
+    while (sort_jobs.head ())
+        pthread_cond_wait (& cond, & mutex);
+
     /* playback should already be stopped */
     assert (! playing_id);
     assert (! scan_list.head ());
@@ -659,6 +708,7 @@ void playlist_end ()
     resume_playlist = -1;
     resume_paused = false;
 
+    saved_states.clear ();
     playlists.clear ();
     id_table.clear ();
 
@@ -694,11 +744,139 @@ EXPORT int Playlist::n_selected (int at, int number) const
     { SIMPLE_WRAPPER (int, 0, n_selected, at, number); }
 EXPORT void Playlist::select_all (bool selected) const
     { SIMPLE_VOID_WRAPPER (select_all, selected); }
+
+void PlaylistEx::select_entries (int at, const Index<bool> & selected) const
+    { SIMPLE_VOID_WRAPPER (select_entries, at, selected); }
+int PlaylistEx::structure_serial () const
+    { SIMPLE_WRAPPER (int, -1, sort_serial); }
+
+bool PlaylistEx::remove_flagged (const Index<bool> & remove, int serial) const
+{
+    ENTER_GET_PLAYLIST (false);
+
+    if (playlist->sort_serial () != serial)
+        RETURN (false);
+
+    playlist->select_entries (0, remove);
+    playlist->remove_selected ();
+
+    RETURN (true);
+}
 EXPORT int Playlist::shift_entries (int entry_num, int distance) const
     { SIMPLE_WRAPPER (int, 0, shift_entries, entry_num, distance); }
 EXPORT void Playlist::remove_selected () const
     { SIMPLE_VOID_WRAPPER (remove_selected); }
 
+static void cancel_sort_jobs (Playlist::ID * id)
+{
+    for (SortJob * job = sort_jobs.head (); job; job = sort_jobs.next (job))
+    {
+        if (job->id == id)
+            job->cancelled = true;
+    }
+}
+
+static void * sort_worker (void * data)
+{
+    auto job = (SortJob *) data;
+
+    ENTER;
+
+    PlaylistData * playlist = job->id->data;
+
+    if (playlist && ! job->cancelled)
+    {
+        Index<PlaylistData::SortItem> items;
+        Index<int> positions;
+
+        playlist->get_sort_items (job->selected_only, items, positions);
+        int serial = playlist->sort_serial ();
+
+        LEAVE;
+        Index<int> order = PlaylistData::sort_items (job->scheme, items);
+        ENTER;
+
+        /* the playlist may have been deleted or modified while unlocked */
+        playlist = job->id->data;
+
+        if (playlist && ! job->cancelled)
+        {
+            if (playlist->sort_serial () == serial)
+                playlist->apply_sort (positions, order);
+            else
+                AUDINFO ("Playlist modified, sort abandoned.\n");
+        }
+    }
+
+    sort_jobs.remove (job);
+    pthread_cond_broadcast (& cond);
+
+    LEAVE;
+
+    delete job;
+    return nullptr;
+}
+
+void PlaylistEx::sort_by_scheme (SortType scheme, bool selected_only) const
+{
+    ENTER_GET_PLAYLIST ();
+
+    /* a new sort replaces any earlier one */
+    cancel_sort_jobs (m_id);
+
+    if (playlist->n_entries () < BACKGROUND_SORT_MIN ||
+     ! aud_get_bool (nullptr, "background_sort"))
+    {
+        Index<PlaylistData::SortItem> items;
+        Index<int> positions;
+
+        playlist->get_sort_items (selected_only, items, positions);
+        playlist->apply_sort (positions, PlaylistData::sort_items (scheme, items));
+
+        RETURN ();
+    }
+
+    auto job = new SortJob ();
+    job->id = m_id;
+    job->scheme = scheme;
+    job->selected_only = selected_only;
+    job->cancelled = false;
+
+    pthread_t thread;
+    if (pthread_create (& thread, nullptr, sort_worker, job))
+    {
+        AUDERR ("Failed to start sort thread.\n");
+        delete job;
+        RETURN ();
+    }
+
+    pthread_detach (thread);
+    sort_jobs.append (job);
+
+    LEAVE;
+}
+
+EXPORT bool Playlist::sort_in_progress () const
+{
+    ENTER;
+
+    bool in_progress = false;
+    for (SortJob * job = sort_jobs.head (); job; job = sort_jobs.next (job))
+    {
+        if (job->id == m_id && ! job->cancelled)
+            in_progress = true;
+    }
+
+    RETURN (in_progress);
+}
+
+EXPORT void Playlist::cancel_sort () const
+{
+    ENTER;
+    cancel_sort_jobs (m_id);
+    LEAVE;
+}
+
 EXPORT void Playlist::sort_by_filename (StringCompareFunc compare) const
     { SIMPLE_VOID_WRAPPER (sort, {compare, nullptr}); }
 EXPORT void Playlist::sort_by_tuple (TupleCompareFunc compare) const
@@ -745,6 +923,8 @@ EXPORT bool Playlist::update_pending () const
     { SIMPLE_WRAPPER (bool, false, update_pending); }
 EXPORT Playlist::Update Playlist::update_detail () const
     { SIMPLE_WRAPPER (Update, Update (), last_update); }
+EXPORT Index<Playlist::UpdateRange> Playlist::update_ranges () const
+    { SIMPLE_WRAPPER (Index<UpdateRange>, Index<UpdateRange> (), last_ranges); }
 
 void PlaylistEx::insert_flat_items (int at, Index<PlaylistAddItem> && items) const
     { SIMPLE_VOID_WRAPPER (insert_items, at, std::move (items)); }
@@ -1066,6 +1246,85 @@ EXPORT Tuple Playlist::entry_tuple (int entry_num, GetMode mode, String * error)
     RETURN (tuple);
 }
 
+static void clamp_range (PlaylistData * playlist, int & at, int & number)
+{
+    int entries = playlist->n_entries ();
+
+    if (at < 0 || at > entries)
+        at = entries;
+    if (number < 0 || number > entries - at)
+        number = entries - at;
+}
+
+EXPORT Playlist::Snapshot Playlist::snapshot (int at, int number, GetMode mode) const
+{
+    ENTER_GET_PLAYLIST (Snapshot ());
+    clamp_range (playlist, at, number);
+
+    if (mode == Wait)
+    {
+        /* every scan of an entry in the range, whether already running or
+         * queued here, counts down <pending> when it is finished or canceled
+         * (deleting the entry cancels its scan, so the count always reaches
+         * zero); all the scans are queued at once to run in parallel */
+        int pending = 0;
+        Index<bool> scanning;
+        scanning.insert (0, number);
+
+        for (ScanItem * item = scan_list.head (); item; item = scan_list.next (item))
+        {
+            int entry_num = PlaylistData::entry_number (item->entry);
+            if (item->playlist == playlist && entry_num >= at && entry_num < at + number)
+            {
+                scanning[entry_num - at] = true;
+                item->waiters.append (& pending);
+                pending ++;
+            }
+        }
+
+        for (int i = 0; i < number; i ++)
+        {
+            auto entry = playlist->entry_at (at + i);
+            if (! scanning[i] && playlist->entry_needs_rescan (entry, false, true))
+            {
+                scan_queue_entry (playlist, entry)->waiters.append (& pending);
+                pending ++;
+            }
+        }
+
+        while (pending)
+            pthread_cond_wait (& cond, & mutex);
+
+        /* the playlist may have changed (or been deleted) in the meantime */
+        if (! (playlist = m_id->data))
+            RETURN (Snapshot ());
+
+        clamp_range (playlist, at, number);
+    }
+
+    auto data = new Snapshot::Data;
+    data->refcount = 1;
+    data->first = at;
+
+    playlist->get_rows (at, number, data->rows);
+
+    RETURN (Snapshot (data));
+}
+
+EXPORT Playlist::Snapshot::~Snapshot ()
+{
+    if (m_data && ! __sync_sub_and_fetch (& m_data->refcount, 1))
+        delete m_data;
+}
+
+EXPORT Playlist::Snapshot Playlist::Snapshot::ref () const
+{
+    if (m_data)
+        __sync_fetch_and_add (& m_data->refcount, 1);
+
+    return Snapshot (m_data);
+}
+
 EXPORT void Playlist::rescan_file (const char * filename)
 {
     ENTER;
@@ -1130,6 +1389,26 @@ void playback_entry_set_tuple (int serial, Tuple && tuple)
     LEAVE;
 }
 
+struct StateJob
+{
+    String path, text;
+};
+
+/* runs in the background; the state file is rewritten only if it changed */
+static void write_state (void * data)
+{
+    auto job = (StateJob *) data;
+
+    auto old_text = VFSFile::read_file (job->path,
+        VFSReadOptions (VFS_APPEND_NULL | VFS_IGNORE_MISSING));
+
+    if (strcmp (old_text.begin (), job->text) &&
+     ! g_file_set_contents (job->path, job->text, -1, nullptr))
+        AUDERR ("Error saving %s.\n", (const char *) job->path);
+
+    delete job;
+}
+
 void playlist_save_state ()
 {
     /* get playback state before locking playlists */
@@ -1138,24 +1417,17 @@ void playlist_save_state ()
 
     ENTER;
 
-    const char * user_dir = aud_get_path (AudPath::UserDir);
-    StringBuf path = filename_build ({user_dir, STATE_FILE});
-
-    FILE * handle = g_fopen (path, "w");
-    if (! handle)
-        RETURN ();
-
-    fprintf (handle, "active %d\n", active_id ? active_id->index : -1);
-    fprintf (handle, "playing %d\n", playing_id ? playing_id->index : -1);
+    StringBuf text = str_printf ("active %d\n", active_id ? active_id->index : -1);
+    str_append_printf (text, "playing %d\n", playing_id ? playing_id->index : -1);
 
     for (auto & playlist : playlists)
     {
-        fprintf (handle, "playlist %d\n", playlist->id ()->index);
+        str_append_printf (text, "playlist %d\n", playlist->id ()->index);
 
         if (playlist->filename)
-            fprintf (handle, "filename %s\n", (const char *) playlist->filename);
+            str_append_printf (text, "filename %s\n", (const char *) playlist->filename);
 
-        fprintf (handle, "position %d\n", playlist->position ());
+        str_append_printf (text, "position %d\n", playlist->position ());
 
         /* save shuffle history */
         auto history = playlist->shuffle_history ();
@@ -1164,17 +1436,22 @@ void playlist_save_state ()
         {
             int count = aud::min (16, history.len () - i);
             auto list = int_array_to_str (& history[i], count);
-            fprintf (handle, "shuffle %s\n", (const char *) list);
+            str_append_printf (text, "shuffle %s\n", (const char *) list);
         }
 
         /* resume state is stored per-playlist for historical reasons */
         bool is_playing = (playlist->id () == playing_id);
-        fprintf (handle, "resume-state %d\n", (is_playing && paused) ? ResumePause : ResumePlay);
-        fprintf (handle, "resume-time %d\n", is_playing ? time : playlist->resume_time);
+        str_append_printf (text, "resume-state %d\n", (is_playing && paused) ? ResumePause : ResumePlay);
+        str_append_printf (text, "resume-time %d\n", is_playing ? time : playlist->resume_time);
     }
 
-    fclose (handle);
+    auto job = new StateJob;
+    job->path = String (filename_build ({aud_get_path (AudPath::UserDir), STATE_FILE}));
+    job->text = String (text);
+
     LEAVE;
+
+    persist_queue (write_state, job);
 }
 
 void playlist_load_state ()
@@ -1182,6 +1459,8 @@ void playlist_load_state ()
     ENTER;
     int playlist_num;
 
+    saved_states.clear ();
+
     const char * user_dir = aud_get_path (AudPath::UserDir);
     StringBuf path = filename_build ({user_dir, STATE_FILE});
 
@@ -1206,6 +1485,10 @@ void playlist_load_state ()
            playlist_num >= 0 && playlist_num < playlists.len ())
     {
         PlaylistData * playlist = playlists[playlist_num].get ();
+        SavedState & state = saved_states.append ();
+
+        state.id = playlist->id ();
+        state.position = -1;
 
         parser.next ();
 
@@ -1213,26 +1496,17 @@ void playlist_load_state ()
         if (playlist->filename)
             parser.next ();
 
-        int position = -1;
-        if (parser.get_int ("position", position))
-        {
-            playlist->set_position (position);
+        if (parser.get_int ("position", state.position))
             parser.next ();
-        }
-
-        /* restore shuffle history */
-        Index<int> history;
 
+        /* shuffle history */
         for (String list; (list = parser.get_str ("shuffle")); parser.next ())
         {
             auto split = str_list_to_index (list, ", ");
             for (auto & str : split)
-                history.append (str_to_int (str));
+                state.history.append (str_to_int (str));
         }
 
-        if (history.len ())
-            playlist->shuffle_replay (history);
-
         /* resume state is stored per-playlist for historical reasons */
         int resume_state = ResumePlay;
         if (parser.get_int ("resume-state", resume_state))
@@ -1251,24 +1525,52 @@ void playlist_load_state ()
     }
 
     fclose (handle);
+    LEAVE;
+}
 
-    /* set initial focus and selection */
-    for (auto & playlist : playlists)
+void PlaylistEx::apply_saved_state () const
+{
+    ENTER_GET_PLAYLIST ();
+
+    for (int i = 0; i < saved_states.len (); i ++)
     {
-        int focus = playlist->position ();
-        if (focus < 0 && playlist->n_entries ())
-            focus = 0;
+        SavedState & state = saved_states[i];
+        if (state.id != m_id)
+            continue;
 
-        if (focus >= 0)
-        {
-            playlist->set_focus (focus);
-            playlist->select_entry (focus, true);
-        }
+        /* don't override a position chosen while the playlist was loading */
+        if (playlist->position () < 0 && state.position >= 0)
+            playlist->set_position (state.position);
+
+        if (state.history.len ())
+            playlist->shuffle_replay (state.history);
+
+        saved_states.remove (i, 1);
+        break;
+    }
+
+    /* set initial focus and selection */
+    int focus = playlist->position ();
+    if (focus < 0 && playlist->n_entries ())
+        focus = 0;
+
+    if (focus >= 0)
+    {
+        playlist->set_focus (focus);
+        playlist->select_entry (focus, true);
     }
 
     LEAVE;
 }
 
+Playlist PlaylistEx::get_resume_playlist ()
+{
+    ENTER;
+    Playlist::ID * id = (resume_playlist >= 0 && resume_playlist < playlists.len ()) ?
+     playlists[resume_playlist]->id () : nullptr;
+    RETURN (Playlist (id));
+}
+
 EXPORT void aud_resume ()
 {
     if (aud_get_bool (nullptr, "always_resume_paused"))
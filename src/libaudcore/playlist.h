@@ -58,6 +58,17 @@ public:
         bool queue_changed;  // true if entries have been added to/removed from queue
     };
 
+    /* One of the (possibly several) ranges of entries covered by an update.
+     * Replacing <old_count> rows at <at> with <count> rows, for each range in
+     * order, transforms a view of the playlist from before the update into
+     * one of the playlist after it. */
+    struct UpdateRange {
+        UpdateLevel level;  // type of change within this range
+        int at;             // first entry of the range (after the update)
+        int count;          // number of entries in the range after the update
+        int old_count;      // number of entries in the range before the update
+    };
+
     /* Preset sorting "schemes" */
     enum SortType {
         Path,            // entry's entire URI
@@ -75,6 +86,13 @@ public:
         n_sort_types
     };
 
+    /* Keys for find_duplicates(), which may be combined */
+    enum DuplicateKey {
+        DupField = (1 << 0),     // the field used by the given sort scheme
+        DupFileSize = (1 << 1),  // size of the file
+        DupContent = (1 << 2)    // fingerprint of the decoded audio
+    };
+
     /* Possible behaviors for entry_{decoder, tuple}. */
     enum GetMode {
         NoWait,  // non-blocking call; returned tuple will be in Initial state if not yet scanned
@@ -87,6 +105,118 @@ public:
         Index<String> exts;  // supported filename extensions
     };
 
+    /* Read-only copy of a range of playlist entries, returned by snapshot().
+     * The copy is taken all at once, so it is consistent even if the playlist
+     * is changed afterward.  The strings and tuples are shared with the
+     * playlist rather than duplicated, and the snapshot itself is reference-
+     * counted, so it can be passed around (e.g. to another thread) cheaply. */
+    class Snapshot
+    {
+    public:
+        struct Row {
+            String filename;
+            Tuple tuple;             // in Initial state if not yet scanned
+            PluginHandle * decoder;  // nullptr if not yet scanned
+            bool selected;
+            bool queued;
+        };
+
+        constexpr Snapshot () : m_data (nullptr) {}
+        Snapshot (Snapshot && b) : m_data (b.m_data)
+            { b.m_data = nullptr; }
+
+        ~Snapshot ();
+
+        Snapshot & operator= (Snapshot && b)
+            { return aud::move_assign (* this, std::move (b)); }
+
+        /* Returns another reference to the same rows. */
+        Snapshot ref () const;
+
+        /* Row <i> describes playlist entry first() + i. */
+        int first () const { return m_data ? m_data->first : 0; }
+        int len () const { return m_data ? m_data->rows.len () : 0; }
+
+        const Row & operator[] (int i) const { return m_data->rows[i]; }
+
+        const Row * begin () const { return m_data ? m_data->rows.begin () : nullptr; }
+        const Row * end () const { return m_data ? m_data->rows.end () : nullptr; }
+
+    private:
+        struct Data {
+            int refcount;
+            int first;
+            Index<Row> rows;
+        };
+
+        explicit Snapshot (Data * data) : m_data (data) {}
+
+        Data * m_data;
+
+        friend class Playlist;
+    };
+
+    class TextIndex;
+
+    /* A set of conditions on the fields of playlist entries, compiled once and
+     * then evaluated for many entries.  An entry matches the filter if it meets
+     * all of the conditions; an entry which lacks one of the fields never
+     * matches.  Text is compared without regard to case. */
+    class Filter
+    {
+    public:
+        enum TextMatch {
+            Substring,  // field contains the pattern
+            Prefix,     // field starts with the pattern
+            Regex       // field matches the regular expression
+        };
+
+        Filter ();
+        ~Filter ();
+
+        Filter (const Filter &) = delete;
+        void operator= (const Filter &) = delete;
+
+        /* Adds a condition on a string field.  Returns false if the pattern is
+         * empty or not a valid regular expression. */
+        bool add_text (Tuple::Field field, TextMatch match, const char * pattern);
+
+        /* Adds a condition on an integer field (e.g. Year, Length, Bitrate):
+         * <min> <= value <= <max>. */
+        void add_range (Tuple::Field field, int min, int max);
+
+        bool is_empty () const;
+
+        /* Returns, for each of the rows, whether it matches.  Large snapshots
+         * are divided among several threads.  If <text> is given, it must have
+         * been built from the same snapshot. */
+        Index<bool> evaluate (const Snapshot & rows, const TextIndex * text = nullptr) const;
+
+    private:
+        struct Data;
+        Data * m_data;
+    };
+
+    /* Case-folded copy of the text fields (title, artist, album, album artist,
+     * genre, comment, and file name) of the rows of a snapshot.  Building it
+     * takes some time, but it makes filtering the same snapshot repeatedly
+     * (for example, while the user is typing a search) much faster. */
+    class TextIndex
+    {
+    public:
+        explicit TextIndex (const Snapshot & rows);
+        ~TextIndex ();
+
+        TextIndex (const TextIndex &) = delete;
+        void operator= (const TextIndex &) = delete;
+
+    private:
+        struct Data;
+        Data * m_data;
+
+        friend class Filter;
+    };
+
     typedef bool (* FilterFunc) (const char * filename, void * user);
     typedef int (* StringCompareFunc) (const char * a, const char * b);
     typedef int (* TupleCompareFunc) (const Tuple & a, const Tuple & b);
@@ -214,6 +344,12 @@ public:
      * according to <mode>.  An optional error message may be returned. */
     Tuple entry_tuple (int entry, GetMode mode = Wait, String * error = nullptr) const;
 
+    /* Returns a snapshot of <number> entries starting with <at> (-1 = all
+     * remaining entries).  This is much faster than calling entry_filename(),
+     * entry_tuple(), etc. for each entry in turn.  With Wait, the entries are
+     * first scanned as needed, as with entry_tuple(). */
+    Snapshot snapshot (int at = 0, int number = -1, GetMode mode = NoWait) const;
+
     /* Gets/sets the playing or last-played entry (-1 = no entry).
      * Affects playback only if this playlist is currently playing.
      * set_position(get_position()) restarts playback from 0:00.
@@ -336,6 +472,11 @@ public:
      * level and number of entries changed in a playlist. */
     Update update_detail () const;
 
+    /* Like update_detail(), but returns each changed range of entries
+     * separately, in ascending order.  Rows outside these ranges are
+     * unchanged (though they may have been shifted up or down). */
+    Index<UpdateRange> update_ranges () const;
+
     /* Returns true if entries are being added in the background. */
     bool add_in_progress () const;
     static bool add_in_progress_any ();
@@ -346,22 +487,65 @@ public:
 
     /* --- UTILITY API --- */
 
-    /* Sorts entries according to a preset scheme. */
+    /* Sorts entries according to a preset scheme.  Large playlists are sorted
+     * in the background if "background_sort" is enabled; a structure update
+     * is sent when done.  The sort is abandoned if the playlist is modified
+     * (added to, removed from, or reordered) in the meantime. */
     void sort_entries (SortType scheme) const;
     void sort_selected (SortType scheme) const;
 
-    /* Removes duplicate entries according to a preset scheme.
-     * The current implementation also sorts the playlist. */
-    void remove_duplicates (SortType scheme) const;
-
-    /* Removes all entries referring to inaccessible files in a playlist. */
+    /* Checks for or cancels a background sort of a playlist. */
+    bool sort_in_progress () const;
+    void cancel_sort () const;
+
+    /* Finds groups of duplicate entries, without changing the playlist.
+     * Entries are duplicates if all of the given <keys> are equal; an entry
+     * for which any of the keys is empty or unknown has no duplicates.  Each
+     * group lists two or more entry numbers in ascending order, and the groups
+     * are ordered by their first entry.  The search runs on several threads
+     * over a snapshot of the playlist, but the calling thread is blocked until
+     * it is done.  With DupContent, every file must be decoded, which is slow,
+     * so the search should then be started from a background thread (or
+     * through remove_duplicates(), which does not block).
+     * cancel_duplicate_search() makes all searches in progress return early,
+     * without any groups. */
+    Index<Index<int>> find_duplicates (SortType scheme, int keys = DupField) const;
+    static void cancel_duplicate_search ();
+
+    /* Removes duplicate entries according to a preset scheme and the given
+     * keys, as found by find_duplicates().  The first entry of each group of
+     * duplicates is kept; the playlist is not sorted.  The search is done in
+     * the background, and nothing is removed if entries are added, removed,
+     * or moved in the meantime, or if cancel_duplicate_search() is called. */
+    void remove_duplicates (SortType scheme, int keys = DupField) const;
+
+    /* Removes all entries referring to inaccessible files in a playlist.  The
+     * files are checked in the background, listing each folder only once where
+     * possible; progress is shown through the "ui show progress" hooks.  The
+     * entries are removed when the check is done, unless it was cancelled. */
     void remove_unavailable () const;
+    static bool unavailable_check_in_progress ();
+    static void cancel_unavailable_check ();
 
     /* Selects entries by matching regular expressions.
      * Example: To select all titles starting with the letter "A",
-     * create a blank tuple and set its title field to "^A". */
+     * create a blank tuple and set its title field to "^A".
+     * Patterns without special characters are matched as plain text. */
     void select_by_patterns (const Tuple & patterns) const;
 
+    /* Selects the entries matching a filter and deselects all others. */
+    void select_by_filter (const Filter & filter) const;
+
+    /* Measures the loudness of the selected entries in the background and
+     * writes the resulting track and album gain to their tags.  Progress is
+     * shown through the "ui show progress" hooks; the "gain analysis complete"
+     * hook is called when done. */
+    void analyze_replay_gain_selected () const;
+    /* Same, but for <number> entries starting with <at> (-1 = all entries). */
+    void analyze_replay_gain (int at, int number) const;
+    static bool gain_analysis_in_progress ();
+    static void cancel_gain_analysis ();
+
     /* Saves metadata for the selected entries to an internal cache.
      * This will speed up adding those entries to another playlist. */
     void cache_selected () const;
@@ -181,10 +181,9 @@ static void start_plugins (PluginType type)
     }
 }
 
+/* plugin_system_init() must have been called first */
 void start_plugins_one ()
 {
-    plugin_system_init ();
-
     start_plugins (PluginType::Transport);
     start_plugins (PluginType::Playlist);
     start_plugins (PluginType::Input);
@@ -320,7 +320,13 @@ public:
          * to the second song in the file "somefile.sid".
          * 3. When one of the songs is played, Audacious opens the file and
          * calls play() with a file name modified in this way. */
-        FlagSubtunes = (1 << 1)
+        FlagSubtunes = (1 << 1),
+
+        /* Indicates that play() may be called from more than one thread at
+         * once.  Audacious decodes files outside of playback (for ReplayGain
+         * analysis); for plugins without this flag, that is never done while
+         * the plugin is also being used for playback. */
+        FlagReentrant = (1 << 2)
     };
 
     struct InputInfo
@@ -0,0 +1,123 @@
+/*
+ * progress.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "internal.h"
+
+#include <pthread.h>
+#include <stdio.h>
+
+#include "audstrings.h"
+#include "hook.h"
+#include "mainloop.h"
+#include "runtime.h"
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static Index<Progress *> users;  // tasks that have reported but are not done
+static Progress * latest;        // the one that reported most recently
+static QueuedFunc status_timer;
+static bool status_shown;
+
+void Progress::show (void *)
+{
+    pthread_mutex_lock (& mutex);
+
+    if (! latest)
+    {
+        pthread_mutex_unlock (& mutex);
+        return;
+    }
+
+    StringBuf path = str_copy (latest->m_path);
+    StringBuf status = str_copy (latest->m_status);
+    const char * verb = latest->m_verb;
+
+    status_shown = true;
+
+    pthread_mutex_unlock (& mutex);
+
+    if (aud_get_headless_mode ())
+    {
+        printf ("%s, %s ...\r", verb, (const char *) status);
+        fflush (stdout);
+    }
+    else
+    {
+        hook_call ("ui show progress", (char *) path);
+        hook_call ("ui show progress 2", (char *) status);
+    }
+}
+
+void Progress::update (const char * path, const char * status)
+{
+    pthread_mutex_lock (& mutex);
+
+    if (path)
+        snprintf (m_path, sizeof m_path, "%s", path);
+    snprintf (m_status, sizeof m_status, "%s", status);
+
+    if (! m_active)
+    {
+        users.append (this);
+        m_active = true;
+    }
+
+    latest = this;
+
+    if (! status_timer.running ())
+        status_timer.start (250, show, nullptr);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void Progress::done ()
+{
+    pthread_mutex_lock (& mutex);
+
+    if (! m_active)
+    {
+        pthread_mutex_unlock (& mutex);
+        return;
+    }
+
+    users.remove (users.find (this), 1);
+    m_active = false;
+
+    /* another task may still be running; if so, show it instead */
+    if (latest == this)
+        latest = users.len () ? users[users.len () - 1] : nullptr;
+
+    bool hide = false;
+
+    if (! users.len ())
+    {
+        status_timer.stop ();
+        hide = status_shown;
+        status_shown = false;
+    }
+
+    pthread_mutex_unlock (& mutex);
+
+    if (hide)
+    {
+        if (aud_get_headless_mode ())
+            printf ("\n");
+        else
+            hook_call ("ui hide progress", nullptr);
+    }
+}
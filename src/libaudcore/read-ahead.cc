@@ -0,0 +1,472 @@
+/*
+ * read-ahead.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "read-ahead.h"
+#include "runtime.h"
+
+#include <string.h>
+
+#include <glib.h>
+
+#include "audstrings.h"
+
+/* the thread is started after this much has been read without seeking; this
+ * is beyond what ProbeBuffer holds, so probing alone never starts it */
+static constexpr int64_t ACTIVATE_AFTER = 512 * 1024;
+
+static constexpr int CHUNK = 64 * 1024;           // read from the real file at once
+static constexpr int MIN_WINDOW = 256 * 1024;
+static constexpr int MAX_WINDOW = 8 * 1024 * 1024;
+static constexpr int WINDOW_SECS = 10;            // of audio, at the measured rate
+static constexpr int64_t RATE_INTERVAL = 1000000; // microseconds
+
+/* metadata fields that may change in the course of a stream */
+static const char * const tracked_fields[] = {
+    "track-name",
+    "stream-name",
+    "content-bitrate"
+};
+
+static int tracked_index (const char * field)
+{
+    for (int i = 0; i < aud::n_elems (tracked_fields); i ++)
+    {
+        if (! strcmp (field, tracked_fields[i]))
+            return i;
+    }
+
+    return -1;
+}
+
+ReadAhead::ReadAhead (const char * filename, VFSImpl * file) :
+    m_filename (filename),
+    m_file (file) {}
+
+ReadAhead::~ReadAhead ()
+{
+    if (! m_active)
+        return;
+
+    pthread_mutex_lock (& m_mutex);
+    m_quit = true;
+    pthread_cond_broadcast (& m_cond);
+    pthread_mutex_unlock (& m_mutex);
+
+    pthread_join (m_thread, nullptr);
+
+    AUDINFO ("<%p> read-ahead for %s: %d/%d reads waited, %d ms total\n", this,
+     (const char *) m_filename, (int) m_stalls, (int) m_reads, (int) (m_stall_time / 1000));
+}
+
+void * ReadAhead::run_thread (void * data)
+{
+    ((ReadAhead *) data)->prefetch ();
+    return nullptr;
+}
+
+void ReadAhead::activate ()
+{
+    int64_t pos = m_file->ftell ();
+
+    /* the virtual position could not be tracked */
+    if (pos < 0)
+    {
+        m_disabled = true;
+        return;
+    }
+
+    m_pos = pos;
+    m_window = MIN_WINDOW;
+
+    read_metadata (m_latest);
+    for (int i = 0; i < N_TRACKED; i ++)
+        m_visible[i] = m_latest[i];
+    m_buffer.alloc (m_window);
+    m_rate_start = g_get_monotonic_time ();
+
+    if (pthread_create (& m_thread, nullptr, run_thread, this))
+    {
+        AUDERR ("<%p> cannot start read-ahead thread\n", this);
+        m_buffer.destroy ();
+        m_disabled = true;
+        return;
+    }
+
+    AUDINFO ("<%p> read-ahead enabled for %s\n", this, (const char *) m_filename);
+    m_active = true;
+}
+
+void ReadAhead::prefetch ()
+{
+    Index<char> chunk;
+    chunk.resize (CHUNK);
+
+    pthread_mutex_lock (& m_mutex);
+
+    while (! m_quit)
+    {
+        int want = aud::min (CHUNK, m_window - m_buffer.len ());
+
+        if (m_held || m_eof || want <= 0)
+        {
+            pthread_cond_wait (& m_cond, & m_mutex);
+            continue;
+        }
+
+        /* the real file is read without the lock, so that the caller can
+         * still take data from the buffer meanwhile */
+        m_busy = true;
+        pthread_mutex_unlock (& m_mutex);
+
+        int64_t got = m_file->fread (chunk.begin (), 1, want);
+
+        String values[N_TRACKED];
+        if (got > 0)
+            read_metadata (values);
+
+        pthread_mutex_lock (& m_mutex);
+        m_busy = false;
+
+        if (got > 0)
+        {
+            m_buffer.copy_in (chunk.begin (), got);
+            mark_metadata (values);
+        }
+        else
+            m_eof = true;
+
+        pthread_cond_broadcast (& m_cond);
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+}
+
+/* reads the tracked metadata from the real file; called only by whichever
+ * thread is using the real file */
+void ReadAhead::read_metadata (String * values)
+{
+    static_assert (aud::n_elems (tracked_fields) == N_TRACKED,
+     "Update tracked metadata fields");
+
+    for (int i = 0; i < N_TRACKED; i ++)
+        values[i] = m_file->get_metadata (tracked_fields[i]);
+}
+
+/* records metadata just read along with a chunk of data, to be seen by the
+ * caller once it reaches the end of the chunk; assumes mutex */
+void ReadAhead::mark_metadata (String * values)
+{
+    bool changed = false;
+
+    for (int i = 0; i < N_TRACKED; i ++)
+    {
+        if (values[i] != m_latest[i])
+        {
+            m_latest[i] = values[i];
+            changed = true;
+        }
+    }
+
+    if (! changed)
+        return;
+
+    MetadataMark & mark = m_marks.append ();
+    mark.pos = m_pos + m_buffer.len ();
+
+    for (int i = 0; i < N_TRACKED; i ++)
+        mark.values[i] = values[i];
+}
+
+/* makes visible the metadata of the marks the caller has reached; assumes
+ * mutex */
+void ReadAhead::apply_marks ()
+{
+    int reached = 0;
+
+    while (reached < m_marks.len () && m_marks[reached].pos <= m_pos)
+    {
+        for (int i = 0; i < N_TRACKED; i ++)
+            m_visible[i] = m_marks[reached].values[i];
+
+        reached ++;
+    }
+
+    if (reached)
+        m_marks.remove (0, reached);
+}
+
+/* gives the caller exclusive use of the real file; assumes mutex */
+void ReadAhead::hold_file ()
+{
+    m_held = true;
+
+    while (m_busy)
+        pthread_cond_wait (& m_cond, & m_mutex);
+}
+
+/* assumes mutex */
+void ReadAhead::release_file ()
+{
+    m_held = false;
+    pthread_cond_broadcast (& m_cond);
+}
+
+/* assumes mutex */
+void ReadAhead::adjust_window (int64_t now)
+{
+    if (now - m_rate_start < RATE_INTERVAL)
+        return;
+
+    /* the first interval includes the burst of reading done at the start of
+     * playback, so later intervals are weighted more heavily */
+    double rate = m_rate_bytes * 1000000.0 / (now - m_rate_start);
+    m_rate = m_rate ? m_rate * 0.5 + rate * 0.5 : rate;
+    m_rate_start = now;
+    m_rate_bytes = 0;
+
+    /* the window only grows; a stream that is slow for a while (or paused)
+     * does not need the memory given back immediately */
+    int target = aud::clamp ((int64_t) (m_rate * WINDOW_SECS),
+     (int64_t) MIN_WINDOW, (int64_t) MAX_WINDOW);
+
+    if (target > m_window)
+    {
+        m_window = target;
+        m_buffer.alloc (m_window);
+        pthread_cond_broadcast (& m_cond);
+    }
+}
+
+int64_t ReadAhead::fread (void * ptr, int64_t size, int64_t nmemb)
+{
+    if (! m_active)
+    {
+        int64_t got = m_file->fread (ptr, size, nmemb);
+
+        m_sequential += got * size;
+        if (m_sequential >= ACTIVATE_AFTER && ! m_disabled)
+            activate ();
+
+        return got;
+    }
+
+    int64_t total = 0;
+    int64_t remain = size * nmemb;
+
+    if (remain <= 0)
+        return 0;
+
+    pthread_mutex_lock (& m_mutex);
+
+    int64_t start = g_get_monotonic_time ();
+    bool stalled = false;
+
+    while (remain > 0)
+    {
+        int avail = m_buffer.len ();
+
+        if (avail)
+        {
+            int copy = aud::min (remain, (int64_t) avail);
+            m_buffer.move_out ((char *) ptr + total, copy);
+
+            total += copy;
+            remain -= copy;
+
+            pthread_cond_broadcast (& m_cond);
+            continue;
+        }
+
+        if (m_eof)
+            break;
+
+        /* the buffer ran dry, so it is too small for this transport */
+        if (! stalled && m_window < MAX_WINDOW)
+        {
+            m_window = aud::min (m_window * 2, MAX_WINDOW);
+            m_buffer.alloc (m_window);
+        }
+
+        stalled = true;
+        pthread_cond_wait (& m_cond, & m_mutex);
+    }
+
+    int64_t now = g_get_monotonic_time ();
+
+    m_pos += total;
+    m_reads ++;
+
+    apply_marks ();
+
+    if (stalled)
+    {
+        m_stalls ++;
+        m_stall_time += now - start;
+    }
+
+    m_rate_bytes += total;
+    adjust_window (now);
+
+    pthread_mutex_unlock (& m_mutex);
+
+    return (size > 0) ? total / size : 0;
+}
+
+int64_t ReadAhead::fwrite (const void * data, int64_t size, int64_t count)
+{
+    return 0; /* not allowed */
+}
+
+int ReadAhead::fseek (int64_t offset, VFSSeekType whence)
+{
+    if (! m_active)
+    {
+        if (m_file->fseek (offset, whence) < 0)
+            return -1;
+
+        m_sequential = 0;
+        return 0;
+    }
+
+    pthread_mutex_lock (& m_mutex);
+
+    int64_t target = -1;
+    if (whence == VFS_SEEK_SET)
+        target = offset;
+    else if (whence == VFS_SEEK_CUR)
+        target = m_pos + offset;
+
+    /* a short seek forward is served from the buffer */
+    if (target >= m_pos && target - m_pos <= m_buffer.len ())
+    {
+        m_buffer.discard (target - m_pos);
+        m_pos = target;
+        apply_marks ();
+        pthread_cond_broadcast (& m_cond);
+        pthread_mutex_unlock (& m_mutex);
+        return 0;
+    }
+
+    int result = -1;
+
+    if (whence == VFS_SEEK_END || target >= 0)
+    {
+        hold_file ();
+
+        if (whence == VFS_SEEK_END)
+            result = m_file->fseek (offset, whence);
+        else
+            result = m_file->fseek (target, VFS_SEEK_SET);
+
+        /* drop the buffer only if the real seek succeeded
+         * (prevents change of file position if seek failed) */
+        if (result == 0)
+        {
+            m_buffer.discard ();
+            m_pos = (whence == VFS_SEEK_END) ? m_file->ftell () : target;
+            m_eof = false;
+
+            /* the data the marks belonged to is gone */
+            read_metadata (m_latest);
+            for (int i = 0; i < N_TRACKED; i ++)
+                m_visible[i] = m_latest[i];
+
+            m_marks.clear ();
+        }
+
+        release_file ();
+    }
+
+    pthread_mutex_unlock (& m_mutex);
+    return result;
+}
+
+int64_t ReadAhead::ftell ()
+{
+    if (! m_active)
+        return m_file->ftell ();
+
+    pthread_mutex_lock (& m_mutex);
+    int64_t pos = m_pos;
+    pthread_mutex_unlock (& m_mutex);
+    return pos;
+}
+
+bool ReadAhead::feof ()
+{
+    if (! m_active)
+        return m_file->feof ();
+
+    pthread_mutex_lock (& m_mutex);
+    bool eof = (m_eof && ! m_buffer.len ());
+    pthread_mutex_unlock (& m_mutex);
+    return eof;
+}
+
+int ReadAhead::ftruncate (int64_t size)
+{
+    return -1; /* not allowed */
+}
+
+int ReadAhead::fflush ()
+{
+    return 0; /* no-op */
+}
+
+int64_t ReadAhead::fsize ()
+{
+    if (! m_active)
+        return m_file->fsize ();
+
+    pthread_mutex_lock (& m_mutex);
+    hold_file ();
+    int64_t size = m_file->fsize ();
+    release_file ();
+    pthread_mutex_unlock (& m_mutex);
+    return size;
+}
+
+String ReadAhead::get_metadata (const char * field)
+{
+    if (! m_active)
+        return m_file->get_metadata (field);
+
+    int tracked = tracked_index (field);
+
+    /* anything else is static, and can be asked of the real file at any time
+     * without waiting for the thread */
+    if (tracked < 0 && strncmp (field, "read-ahead-", 11))
+        return m_file->get_metadata (field);
+
+    pthread_mutex_lock (& m_mutex);
+
+    String value;
+
+    if (tracked >= 0)
+        value = m_visible[tracked];
+    else if (! strcmp (field, "read-ahead-hit-rate"))
+        value = String (int_to_str (m_reads ? (int) ((m_reads - m_stalls) * 100 / m_reads) : 100));
+    else if (! strcmp (field, "read-ahead-stall-ms"))
+        value = String (int_to_str ((int) (m_stall_time / 1000)));
+    else if (! strcmp (field, "read-ahead-window"))
+        value = String (int_to_str (m_window));
+
+    pthread_mutex_unlock (& m_mutex);
+    return value;
+}
@@ -0,0 +1,122 @@
+/*
+ * read-ahead.h
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#ifndef LIBAUDCORE_READ_AHEAD_H
+#define LIBAUDCORE_READ_AHEAD_H
+
+/* ReadAhead sits below the ProbeBuffer of a read-only file opened through a
+ * transport plugin, or of a local file on a network file system (NFS, SMB,
+ * FUSE, and the like), but not of other local files or stdin.  At first, it
+ * simply passes everything through to the real file, so that probing and tag
+ * reading (which read little and seek a lot) cost nothing extra.  Once enough
+ * of the file has been read sequentially, a background thread is started that
+ * reads ahead of the caller into a ring buffer, so that a slow transport (a
+ * network share or HTTP) does not stall the decoder.
+ *
+ * While the thread is running, m_pos is the virtual file position and the real
+ * file position is at the end of the buffer.  The real file is used only by
+ * the thread, except when the caller "holds" it (see hold_file()) to seek or
+ * to query it; the buffer is then dropped unless the seek lands inside it.
+ *
+ * The amount read ahead is adjusted to the rate at which the caller consumes
+ * data (for a decoder, the bitrate of the stream), and is also doubled
+ * whenever the caller has to wait for data.
+ *
+ * Some metadata (such as the title sent by an Icecast/Shoutcast stream)
+ * changes in the course of the stream.  The thread reads it along with each
+ * chunk of data and marks where it changed, so that the caller sees the new
+ * value when it reaches that point, rather than when the thread did.
+ */
+
+#include <pthread.h>
+
+#include "ringbuf.h"
+#include "vfs.h"
+
+class ReadAhead : public VFSImpl
+{
+public:
+    ReadAhead (const char * filename, VFSImpl * file);
+    ~ReadAhead ();
+
+    int64_t fread (void * ptr, int64_t size, int64_t nmemb);
+    int fseek (int64_t offset, VFSSeekType whence);
+
+    int64_t ftell ();
+    int64_t fsize ();
+    bool feof ();
+
+    int64_t fwrite (const void * ptr, int64_t size, int64_t nmemb);
+    int ftruncate (int64_t length);
+    int fflush ();
+
+    /* "read-ahead-hit-rate" (percentage of reads not having to wait),
+     * "read-ahead-stall-ms", and "read-ahead-window" (in bytes) are
+     * answered here, as are the fields read along with the data; other
+     * fields are passed on to the real file */
+    String get_metadata (const char * field);
+
+private:
+    static constexpr int N_TRACKED = 3;
+
+    struct MetadataMark {
+        int64_t pos;  // virtual position from which the values apply
+        String values[N_TRACKED];
+    };
+
+    static void * run_thread (void * data);
+
+    void activate ();
+    void prefetch ();
+    void hold_file ();
+    void release_file ();
+    void adjust_window (int64_t now);
+
+    void read_metadata (String * values);
+    void mark_metadata (String * values);
+    void apply_marks ();
+
+    String m_filename;
+    SmartPtr<VFSImpl> m_file;
+
+    pthread_mutex_t m_mutex = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t m_cond = PTHREAD_COND_INITIALIZER;
+    pthread_t m_thread;
+
+    bool m_active = false, m_disabled = false;
+    int64_t m_sequential = 0;  // bytes read since the last seek (before activation)
+
+    /* protected by m_mutex once active */
+    RingBuf<char> m_buffer;
+    int64_t m_pos = 0;
+    int m_window = 0;
+    bool m_busy = false, m_held = false, m_eof = false, m_quit = false;
+
+    /* tracked metadata: as seen by the caller, and as last read by the
+     * thread; the marks in between are in order of position */
+    String m_visible[N_TRACKED], m_latest[N_TRACKED];
+    Index<MetadataMark> m_marks;
+
+    /* statistics, also protected by m_mutex */
+    int64_t m_reads = 0, m_stalls = 0, m_stall_time = 0;
+    int64_t m_rate_start = 0, m_rate_bytes = 0;
+    double m_rate = 0;  // bytes per second consumed by the caller
+};
+
+#endif // LIBAUDCORE_READ_AHEAD_H
@@ -0,0 +1,734 @@
+/*
+ * replaygain.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/*
+ * Loudness analysis following EBU R128 / ITU-R BS.1770, with the results stored
+ * as ReplayGain 2.0 tags (reference level -18 LUFS).  Each selected entry is
+ * decoded in a background thread by running its input plugin against a
+ * DecodeSink instead of the output system.  Entries are analyzed in parallel,
+ * but input plugins are not required to be reentrant, so one that is not is
+ * only run by one thread at a time.  Such a plugin is also given back when it
+ * is needed for playback, and the entry is then analyzed again from the start.
+ *
+ * Gating is done through a histogram of block loudness, so that album values
+ * can be computed by simply summing the histograms of the tracks instead of
+ * keeping every block in memory.
+ */
+
+#include "internal.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <glib.h>  /* for GThreadPool */
+
+#include "audio.h"
+#include "audstrings.h"
+#include "hook.h"
+#include "i18n.h"
+#include "interface.h"
+#include "mainloop.h"
+#include "multihash.h"
+#include "playlist.h"
+#include "plugin.h"
+#include "probe.h"
+#include "runtime.h"
+#include "tuple.h"
+#include "vfs.h"
+
+#define REFERENCE_LUFS -18.0
+#define ABSOLUTE_GATE -70.0  /* LUFS */
+#define RELATIVE_GATE -10.0  /* LU */
+
+/* block loudness is collected in 0.1 LU steps from -70 to +30 LUFS */
+#define HIST_MIN ABSOLUTE_GATE
+#define HIST_STEP 0.1
+#define HIST_BINS 1000
+
+#define SUBBLOCKS 4  /* 400 ms blocks with 75% overlap */
+#define CHUNK_FRAMES 1024
+
+static double bin_energy (int bin)
+{
+    double loudness = HIST_MIN + (bin + 0.5) * HIST_STEP;
+    return pow (10, (loudness + 0.691) / 10);
+}
+
+struct LoudnessHistogram
+{
+    int64_t counts[HIST_BINS] {};
+    float peak = 0;
+
+    void add (double energy)
+    {
+        double loudness = -0.691 + 10 * log10 (energy);
+        if (loudness < ABSOLUTE_GATE)
+            return;
+
+        int bin = aud::min ((int) ((loudness - HIST_MIN) / HIST_STEP), HIST_BINS - 1);
+        counts[bin] ++;
+    }
+
+    void merge (const LoudnessHistogram & other)
+    {
+        for (int bin = 0; bin < HIST_BINS; bin ++)
+            counts[bin] += other.counts[bin];
+
+        peak = aud::max (peak, other.peak);
+    }
+
+    /* returns false if nothing was above the absolute gate */
+    bool integrate (double & loudness) const;
+};
+
+bool LoudnessHistogram::integrate (double & loudness) const
+{
+    double sum = 0;
+    int64_t total = 0;
+
+    for (int bin = 0; bin < HIST_BINS; bin ++)
+    {
+        sum += counts[bin] * bin_energy (bin);
+        total += counts[bin];
+    }
+
+    if (! total)
+        return false;
+
+    double gate = -0.691 + 10 * log10 (sum / total) + RELATIVE_GATE;
+    int first = aud::clamp ((int) ceil ((gate - HIST_MIN) / HIST_STEP - 0.5), 0, HIST_BINS);
+
+    sum = 0;
+    total = 0;
+
+    for (int bin = first; bin < HIST_BINS; bin ++)
+    {
+        sum += counts[bin] * bin_energy (bin);
+        total += counts[bin];
+    }
+
+    if (! total)
+        return false;
+
+    loudness = -0.691 + 10 * log10 (sum / total);
+    return true;
+}
+
+/* Second-order IIR section (direct form II transposed).  The K-weighting
+ * filter is a high shelf followed by a high pass, with the coefficients
+ * derived for the actual sample rate rather than hard-coded for 48 kHz. */
+struct Biquad
+{
+    double b0, b1, b2, a1, a2;
+    double z1, z2;
+
+    void run (float * data, int frames)
+    {
+        for (int i = 0; i < frames; i ++)
+        {
+            double in = data[i];
+            double out = b0 * in + z1;
+            z1 = b1 * in - a1 * out + z2;
+            z2 = b2 * in - a2 * out;
+            data[i] = out;
+        }
+    }
+};
+
+static void init_k_weighting (Biquad & shelf, Biquad & highpass, int rate)
+{
+    double f0 = 1681.974450955533;
+    double gain = 3.999843853973347;
+    double q = 0.7071752369554196;
+
+    double k = tan (M_PI * f0 / rate);
+    double vh = pow (10, gain / 20);
+    double vb = pow (vh, 0.4996667741545416);
+    double a0 = 1 + k / q + k * k;
+
+    shelf.b0 = (vh + vb * k / q + k * k) / a0;
+    shelf.b1 = 2 * (k * k - vh) / a0;
+    shelf.b2 = (vh - vb * k / q + k * k) / a0;
+    shelf.a1 = 2 * (k * k - 1) / a0;
+    shelf.a2 = (1 - k / q + k * k) / a0;
+
+    f0 = 38.13547087602444;
+    q = 0.5003270373238773;
+
+    k = tan (M_PI * f0 / rate);
+    a0 = 1 + k / q + k * k;
+
+    highpass.b0 = 1;
+    highpass.b1 = -2;
+    highpass.b2 = 1;
+    highpass.a1 = 2 * (k * k - 1) / a0;
+    highpass.a2 = (1 - k / q + k * k) / a0;
+}
+
+/* The per-sample work outside of the (inherently serial) IIR filters is kept
+ * in flat loops over contiguous buffers so that the compiler can vectorize
+ * them without any architecture-specific code. */
+static float peak_of (const float * data, int samples)
+{
+    float peak = 0;
+    for (int i = 0; i < samples; i ++)
+        peak = aud::max (peak, fabsf (data[i]));
+
+    return peak;
+}
+
+static double sum_of_squares (const float * data, int frames)
+{
+    double sum = 0;
+    for (int i = 0; i < frames; i ++)
+        sum += data[i] * data[i];
+
+    return sum;
+}
+
+class LoudnessMeter
+{
+public:
+    LoudnessHistogram hist;
+
+    void init (int channels, int rate);
+    void process (const float * data, int frames);
+
+private:
+    int m_channels = 0;
+    int m_subblock_frames = 0;
+
+    Index<Biquad> m_shelf, m_highpass;
+    Index<float> m_planar;
+
+    double m_subblocks[SUBBLOCKS] {};
+    int m_n_subblocks = 0;
+    double m_energy = 0;
+    int m_frames = 0;
+
+    void process_chunk (const float * data, int frames);
+};
+
+void LoudnessMeter::init (int channels, int rate)
+{
+    m_channels = channels;
+    m_subblock_frames = aud::max (rate / 10, 1);
+
+    m_shelf.resize (channels);
+    m_highpass.resize (channels);
+
+    for (int c = 0; c < channels; c ++)
+    {
+        m_shelf[c] = Biquad ();
+        m_highpass[c] = Biquad ();
+        init_k_weighting (m_shelf[c], m_highpass[c], rate);
+    }
+
+    m_planar.resize (CHUNK_FRAMES);
+
+    m_n_subblocks = 0;
+    m_energy = 0;
+    m_frames = 0;
+}
+
+/* BS.1770 channel weights: surround channels are boosted by 1.5 dB and the
+ * LFE channel of a 5.1 stream is ignored */
+static double channel_weight (int channels, int channel)
+{
+    if (channels != 6)
+        return 1;
+
+    switch (channel)
+    {
+        case 3: return 0;
+        case 4: case 5: return 1.41;
+        default: return 1;
+    }
+}
+
+void LoudnessMeter::process_chunk (const float * data, int frames)
+{
+    float * planar = m_planar.begin ();
+    double energy = 0;
+
+    for (int c = 0; c < m_channels; c ++)
+    {
+        for (int i = 0; i < frames; i ++)
+            planar[i] = data[i * m_channels + c];
+
+        m_shelf[c].run (planar, frames);
+        m_highpass[c].run (planar, frames);
+
+        energy += channel_weight (m_channels, c) * sum_of_squares (planar, frames);
+    }
+
+    m_energy += energy;
+    m_frames += frames;
+
+    if (m_frames < m_subblock_frames)
+        return;
+
+    memmove (m_subblocks, m_subblocks + 1, sizeof m_subblocks - sizeof m_subblocks[0]);
+    m_subblocks[SUBBLOCKS - 1] = m_energy;
+    m_energy = 0;
+    m_frames = 0;
+
+    if (m_n_subblocks < SUBBLOCKS - 1)
+    {
+        m_n_subblocks ++;
+        return;
+    }
+
+    double block = 0;
+    for (double subblock : m_subblocks)
+        block += subblock;
+
+    hist.add (block / (SUBBLOCKS * m_subblock_frames));
+}
+
+void LoudnessMeter::process (const float * data, int frames)
+{
+    if (! m_channels)
+        return;
+
+    hist.peak = aud::max (hist.peak, peak_of (data, frames * m_channels));
+
+    while (frames > 0)
+    {
+        /* never let a chunk cross a sub-block boundary */
+        int chunk = aud::min (frames, aud::min (CHUNK_FRAMES, m_subblock_frames - m_frames));
+
+        process_chunk (data, chunk);
+
+        data += chunk * m_channels;
+        frames -= chunk;
+    }
+}
+
+/* ---- analysis session ---- */
+
+struct GainAlbum
+{
+    LoudnessHistogram hist;
+};
+
+struct GainTrack
+{
+    String filename;
+    PluginHandle * decoder;
+    Tuple tuple;
+
+    /* only the integrated values are kept per track; the histogram itself is
+     * merged into the album's right away */
+    bool analyzed = false;
+    double loudness = 0;
+    float peak = 0;
+    String album_key;
+};
+
+struct GainJob
+{
+    enum {Analyze, Write} type;
+    GainTrack * track;
+};
+
+static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
+static GThreadPool * pool;
+
+static Index<GainTrack> tracks;
+static SimpleHash<String, GainAlbum> albums;
+static int jobs_pending, tracks_done;
+static bool session_active, cancelled;
+
+static Progress progress ("Analyzing");
+static QueuedFunc queued_done;
+
+static bool is_cancelled (void * = nullptr)
+{
+    pthread_mutex_lock (& mutex);
+    bool stop = cancelled;
+    pthread_mutex_unlock (& mutex);
+    return stop;
+}
+
+class GainSink : public DecodeSink
+{
+public:
+    GainSink (GainTrack & track, InputPlugin * ip) :
+        m_track (track),
+        m_ip (ip) {}
+
+    void open_audio (int format, int rate, int channels)
+    {
+        m_format = format;
+        m_meter.init (channels, rate);
+        m_channels = channels;
+    }
+
+    void write_audio (const void * data, int length)
+    {
+        if (! m_channels)
+            return;
+
+        int samples = length / FMT_SIZEOF (m_format);
+        const float * fdata = (const float *) data;
+
+        if (m_format != FMT_FLOAT)
+        {
+            m_buffer.resize (samples);
+            audio_from_int (data, m_format, m_buffer.begin (), samples);
+            fdata = m_buffer.begin ();
+        }
+
+        m_meter.process (fdata, samples / m_channels);
+    }
+
+    bool check_stop ()
+        { return is_cancelled () || playback_decoder_wanted (m_ip); }
+
+    Tuple get_tuple ()
+        { return m_track.tuple.ref (); }
+
+    const LoudnessHistogram & histogram () const
+        { return m_meter.hist; }
+
+    void reset ()
+    {
+        m_meter = LoudnessMeter ();
+        m_channels = 0;
+    }
+
+private:
+    GainTrack & m_track;
+    InputPlugin * m_ip;
+    LoudnessMeter m_meter;
+    Index<float> m_buffer;
+    int m_format = FMT_FLOAT;
+    int m_channels = 0;
+};
+
+static StringBuf make_album_key (const Tuple & tuple)
+{
+    String album = tuple.get_str (Tuple::Album);
+    if (! album)
+        return StringBuf ();
+
+    String artist = tuple.get_str (Tuple::AlbumArtist);
+    if (! artist)
+        artist = tuple.get_str (Tuple::Artist);
+
+    return str_concat ({album, "\n", artist ? (const char *) artist : ""});
+}
+
+static void analyze_track (GainTrack & track)
+{
+    VFSFile file;
+    String error;
+
+    if (! track.decoder)
+        track.decoder = aud_file_find_decoder (track.filename, false, file, & error);
+    if (! track.decoder)
+        goto err;
+
+    if (! track.tuple.valid () && ! aud_file_read_tag (track.filename,
+     track.decoder, file, track.tuple, nullptr, & error))
+        goto err;
+
+    {
+        auto ip = load_input_plugin (track.decoder, & error);
+        if (! ip)
+            goto err;
+
+        GainSink sink (track, ip);
+        bool exclusive = ! (ip->input_info.flags & InputPlugin::FlagReentrant);
+        bool success;
+
+        /* start over if playback needed the plugin meanwhile */
+        do
+        {
+            if (exclusive && ! playback_borrow_decoder (ip, is_cancelled, nullptr))
+                return;
+
+            if (! open_input_file (track.filename, "r", ip, file, & error))
+            {
+                if (exclusive)
+                    playback_return_decoder (ip);
+
+                goto err;
+            }
+
+            sink.reset ();
+
+            playback_set_decode_sink (& sink);
+            success = ip->play (track.filename, file);
+            playback_set_decode_sink (nullptr);
+        }
+        while (exclusive && playback_return_decoder (ip) && ! is_cancelled ());
+
+        if (! success || is_cancelled ())
+            return;
+
+        auto & hist = sink.histogram ();
+        if (! hist.integrate (track.loudness))
+        {
+            AUDWARN ("No audible content in %s.\n", (const char *) track.filename);
+            return;
+        }
+
+        track.peak = hist.peak;
+        track.album_key = String (make_album_key (track.tuple));
+
+        if (track.album_key)
+        {
+            pthread_mutex_lock (& mutex);
+
+            GainAlbum * album = albums.lookup (track.album_key);
+            if (! album)
+                album = albums.add (track.album_key, GainAlbum ());
+
+            album->hist.merge (hist);
+
+            pthread_mutex_unlock (& mutex);
+        }
+
+        track.analyzed = true;
+
+        AUDINFO ("Analyzed %s: %.2f LUFS.\n", (const char *) track.filename, track.loudness);
+        return;
+    }
+
+err:
+    AUDWARN ("Gain analysis failed for %s: %s\n", (const char *) track.filename,
+     error ? (const char *) error : _("Unknown error"));
+}
+
+static void write_track (GainTrack & track)
+{
+    if (! aud_file_can_write_tuple (track.filename, track.decoder))
+    {
+        AUDWARN ("Cannot write gain to %s.\n", (const char *) track.filename);
+        return;
+    }
+
+    Tuple tuple = track.tuple.ref ();
+    tuple.delete_fallbacks ();
+
+    tuple.set_int (Tuple::TrackGain, lround ((REFERENCE_LUFS - track.loudness) * 1000000));
+    tuple.set_int (Tuple::TrackPeak, lround (track.peak * 1000000));
+
+    /* albums are no longer modified once the writes have been queued */
+    GainAlbum * album = track.album_key ? albums.lookup (track.album_key) : nullptr;
+    double album_loudness;
+
+    if (album && album->hist.integrate (album_loudness))
+    {
+        tuple.set_int (Tuple::AlbumGain, lround ((REFERENCE_LUFS - album_loudness) * 1000000));
+        tuple.set_int (Tuple::AlbumPeak, lround (album->hist.peak * 1000000));
+    }
+
+    tuple.set_int (Tuple::GainDivisor, 1000000);
+    tuple.set_int (Tuple::PeakDivisor, 1000000);
+
+    if (! aud_file_write_tuple (track.filename, track.decoder, tuple))
+        AUDWARN ("Error writing gain to %s.\n", (const char *) track.filename);
+}
+
+/* assumes mutex */
+static void status_update_locked (const char * filename)
+{
+    char scratch[128];
+    snprintf (scratch, sizeof scratch, _("%d of %d files analyzed"),
+     tracks_done, tracks.len ());
+
+    progress.update (filename, scratch);
+}
+
+static void done_cb (void *)
+{
+    progress.done ();
+
+    pthread_mutex_lock (& mutex);
+
+    tracks.clear ();
+    albums.clear ();
+    session_active = false;
+
+    pthread_mutex_unlock (& mutex);
+
+    event_queue ("gain analysis complete", nullptr);
+}
+
+/* called with the mutex held, once all the tracks have been analyzed */
+static void queue_writes_locked ()
+{
+    for (auto & track : tracks)
+    {
+        if (! track.analyzed)
+            continue;
+
+        jobs_pending ++;
+        g_thread_pool_push (pool, new GainJob {GainJob::Write, & track}, nullptr);
+    }
+}
+
+static void gain_worker (void * data, void *)
+{
+    auto job = (GainJob *) data;
+    GainTrack & track = * job->track;
+
+    pthread_mutex_lock (& mutex);
+    bool skip = cancelled;
+    if (job->type == GainJob::Analyze)
+        status_update_locked (track.filename);
+    pthread_mutex_unlock (& mutex);
+
+    if (! skip)
+    {
+        if (job->type == GainJob::Analyze)
+            analyze_track (track);
+        else
+            write_track (track);
+    }
+
+    pthread_mutex_lock (& mutex);
+
+    if (job->type == GainJob::Analyze)
+    {
+        tracks_done ++;
+        status_update_locked (track.filename);
+
+        if (tracks_done == tracks.len () && ! cancelled)
+            queue_writes_locked ();
+    }
+
+    if (! (-- jobs_pending))
+        queued_done.queue (done_cb, nullptr);
+
+    pthread_mutex_unlock (& mutex);
+
+    delete job;
+}
+
+static void start_analysis (const Playlist::Snapshot & rows, bool selected_only)
+{
+    if (Playlist::gain_analysis_in_progress ())
+    {
+        AUDWARN ("Gain analysis is already in progress.\n");
+        return;
+    }
+
+    Index<GainTrack> selected;
+
+    for (auto & row : rows)
+    {
+        if (selected_only && ! row.selected)
+            continue;
+
+        const String & filename = row.filename;
+        Tuple tuple = row.tuple.ref ();
+
+        /* cuesheet tracks and subtunes share a file with other entries */
+        if (is_subtune (filename) || tuple.is_set (Tuple::StartTime))
+        {
+            AUDINFO ("Skipping gain analysis for %s.\n", (const char *) filename);
+            continue;
+        }
+
+        if (tuple.state () != Tuple::Valid)
+            tuple = Tuple ();
+
+        GainTrack & track = selected.append ();
+        track.filename = filename;
+        track.decoder = row.decoder;
+        track.tuple = std::move (tuple);
+    }
+
+    if (! selected.len ())
+        return;
+
+    pthread_mutex_lock (& mutex);
+
+    if (session_active)
+    {
+        pthread_mutex_unlock (& mutex);
+        return;
+    }
+
+    /* plugins that are not reentrant are serialized by playback_borrow_decoder() */
+    if (! pool)
+        pool = g_thread_pool_new (gain_worker, nullptr, g_get_num_processors (), false, nullptr);
+
+    tracks = std::move (selected);
+    session_active = true;
+    cancelled = false;
+    tracks_done = 0;
+    jobs_pending = tracks.len ();
+
+    /* the tracks index is not modified again until the session is done */
+    for (auto & track : tracks)
+        g_thread_pool_push (pool, new GainJob {GainJob::Analyze, & track}, nullptr);
+
+    pthread_mutex_unlock (& mutex);
+}
+
+EXPORT void Playlist::analyze_replay_gain_selected () const
+{
+    start_analysis (snapshot (), true);
+}
+
+EXPORT void Playlist::analyze_replay_gain (int at, int number) const
+{
+    start_analysis (snapshot (at, number), false);
+}
+
+EXPORT bool Playlist::gain_analysis_in_progress ()
+{
+    pthread_mutex_lock (& mutex);
+    bool in_progress = session_active;
+    pthread_mutex_unlock (& mutex);
+    return in_progress;
+}
+
+EXPORT void Playlist::cancel_gain_analysis ()
+{
+    pthread_mutex_lock (& mutex);
+    cancelled = true;
+    pthread_mutex_unlock (& mutex);
+}
+
+void replaygain_cleanup ()
+{
+    if (! pool)
+        return;
+
+    Playlist::cancel_gain_analysis ();
+
+    g_thread_pool_free (pool, false, true);
+    pool = nullptr;
+
+    progress.done ();
+    queued_done.stop ();
+
+    tracks.clear ();
+    albums.clear ();
+    jobs_pending = 0;
+    session_active = false;
+}
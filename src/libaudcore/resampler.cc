@@ -0,0 +1,250 @@
+/*
+ * resampler.cc
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "internal.h"
+
+#include <math.h>
+
+#include "runtime.h"
+
+/*
+ * The resampler converts from the rate of the effects chain to the rate at
+ * which the output device was opened, if they differ.  It is a polyphase FIR
+ * filter: the ratio of the two rates is reduced to L/M, and a windowed-sinc
+ * lowpass filter is designed once with L phases.  Each output frame is then
+ * computed from <taps> input frames with the coefficients of a single phase,
+ * so there is no interpolation error and no drift.  The filter is only
+ * redesigned when the rates or the quality setting change.
+ */
+
+/* rates whose reduced ratio needs more phases than this are not supported
+ * (2048 phases x 64 taps = 512 KiB of coefficients) */
+#define MAX_PHASES 2048
+
+struct QualityLevel {
+    int taps;        // per phase; must be even
+    float rolloff;   // cutoff, as a fraction of the lower Nyquist frequency
+    float beta;      // Kaiser window parameter
+};
+
+static const QualityLevel quality_levels[] = {
+    {16, 0.85f, 5.0f},   // low
+    {32, 0.91f, 7.0f},   // medium
+    {64, 0.95f, 9.0f}    // high
+};
+
+static int r_channels, r_in_rate, r_out_rate, r_quality;
+static int r_phases, r_step, r_taps;  // L, M, taps
+static Index<float> coeffs;   // r_phases * r_taps
+static Index<float> history;  // interleaved input frames not yet consumed
+static Index<float> output;
+static int r_pos, r_phase;    // next output is at frame r_pos + r_phase / r_phases
+
+static int gcd (int a, int b)
+{
+    while (b)
+    {
+        int t = a % b;
+        a = b;
+        b = t;
+    }
+
+    return a;
+}
+
+/* modified Bessel function of the first kind, order 0 */
+static double bessel_i0 (double x)
+{
+    double sum = 1, term = 1;
+
+    for (int k = 1; k < 50; k ++)
+    {
+        term *= (x / (2 * k)) * (x / (2 * k));
+        sum += term;
+
+        if (term < sum * 1e-12)
+            break;
+    }
+
+    return sum;
+}
+
+static void design_filter (const QualityLevel & level)
+{
+    double cutoff = level.rolloff * aud::min (1.0, (double) r_out_rate / r_in_rate);
+    double half = r_taps / 2;
+    double norm = bessel_i0 (level.beta);
+
+    coeffs.resize (r_phases * r_taps);
+
+    for (int p = 0; p < r_phases; p ++)
+    {
+        float * h = & coeffs[p * r_taps];
+        double sum = 0;
+
+        for (int k = 0; k < r_taps; k ++)
+        {
+            /* distance (in input frames) from the output point to this tap */
+            double d = (double) p / r_phases + half - 1 - k;
+            double x = d / half;
+            double sinc = d ? sin (M_PI * cutoff * d) / (M_PI * d) : cutoff;
+            double window = (fabs (x) < 1) ? bessel_i0 (level.beta * sqrt (1 - x * x)) / norm : 0;
+
+            h[k] = sinc * window;
+            sum += h[k];
+        }
+
+        /* unity gain at DC for every phase */
+        for (int k = 0; k < r_taps; k ++)
+            h[k] /= sum;
+    }
+}
+
+static void clear_filter ()
+{
+    coeffs.clear ();
+    history.clear ();
+    output.clear ();
+}
+
+/* discards buffered audio but keeps the filter */
+void resampler_flush ()
+{
+    if (! coeffs.len ())
+        return;
+
+    /* prime with silence so that the first output lines up with the first
+     * input frame */
+    history.resize (0);
+    history.insert (0, (r_taps / 2 - 1) * r_channels);
+
+    r_pos = r_taps / 2 - 1;
+    r_phase = 0;
+}
+
+/* returns false if this conversion is not supported */
+bool resampler_set_format (int channels, int in_rate, int out_rate)
+{
+    int quality = aud::clamp (aud_get_int (0, "resample_quality"), 0,
+     (int) aud::n_elems (quality_levels) - 1);
+
+    if (channels == r_channels && in_rate == r_in_rate &&
+     out_rate == r_out_rate && quality == r_quality)
+        return true;
+
+    r_channels = channels;
+    r_in_rate = in_rate;
+    r_out_rate = out_rate;
+    r_quality = quality;
+
+    clear_filter ();
+
+    if (in_rate == out_rate)
+        return true;
+
+    int div = gcd (in_rate, out_rate);
+    if (out_rate / div > MAX_PHASES)
+    {
+        AUDWARN ("Cannot resample from %d to %d Hz.\n", in_rate, out_rate);
+        return false;
+    }
+
+    r_phases = out_rate / div;
+    r_step = in_rate / div;
+    r_taps = quality_levels[quality].taps;
+
+    AUDINFO ("Resampling from %d to %d Hz (%d phases, %d taps).\n", in_rate,
+     out_rate, r_phases, r_taps);
+
+    design_filter (quality_levels[quality]);
+    resampler_flush ();
+
+    return true;
+}
+
+bool resampler_active ()
+{
+    return coeffs.len ();
+}
+
+/* latency of the filter, in milliseconds */
+int resampler_get_delay ()
+{
+    if (! coeffs.len ())
+        return 0;
+
+    return aud::rescale (r_taps / 2, r_in_rate, 1000);
+}
+
+Index<float> & resampler_process (Index<float> & data, bool finish)
+{
+    history.insert (data.begin (), -1, data.len ());
+
+    /* push the last input frames through the filter */
+    if (finish)
+        history.insert (-1, (r_taps / 2) * r_channels);
+
+    int n_frames = history.len () / r_channels;
+    int half = r_taps / 2;
+
+    /* count the output frames first, so the buffer is only resized once */
+    int n_out = 0;
+    for (int pos = r_pos, phase = r_phase; pos + half < n_frames; n_out ++)
+    {
+        phase += r_step;
+        pos += phase / r_phases;
+        phase %= r_phases;
+    }
+
+    output.resize (0);
+    output.insert (0, n_out * r_channels);
+
+    for (int i = 0; i < n_out; i ++)
+    {
+        const float * h = & coeffs[r_phase * r_taps];
+        const float * in = & history[(r_pos - half + 1) * r_channels];
+        float * out = & output[i * r_channels];
+
+        for (int k = 0; k < r_taps; k ++)
+        {
+            for (int c = 0; c < r_channels; c ++)
+                out[c] += h[k] * in[k * r_channels + c];
+        }
+
+        r_phase += r_step;
+        r_pos += r_phase / r_phases;
+        r_phase %= r_phases;
+    }
+
+    /* keep only the frames still needed for the next output */
+    int drop = aud::clamp (r_pos - half + 1, 0, n_frames);
+    history.remove (0, drop * r_channels);
+    r_pos -= drop;
+
+    if (finish)
+        resampler_flush ();
+
+    return output;
+}
+
+void resampler_cleanup ()
+{
+    clear_filter ();
+    r_channels = r_in_rate = r_out_rate = r_quality = 0;
+}
@@ -21,6 +21,8 @@
 
 #include <errno.h>
 #include <locale.h>
+#include <pthread.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -65,6 +67,8 @@
 size_t misc_bytes_allocated;
 
 static bool headless_mode;
+static bool startup_profile;
+static int64_t startup_time;
 static int instance_number = 1;
 
 #if defined(USE_QT) && ! defined(USE_GTK)
@@ -80,6 +84,9 @@ EXPORT void aud_set_headless_mode (bool headless)
 EXPORT bool aud_get_headless_mode ()
     { return headless_mode; }
 
+EXPORT void aud_set_startup_profile (bool enable)
+    { startup_profile = enable; }
+
 EXPORT void aud_set_instance (int instance)
     { instance_number = instance; }
 EXPORT int aud_get_instance ()
@@ -281,24 +288,117 @@ EXPORT void aud_init_i18n ()
     textdomain (PACKAGE);
 }
 
+void startup_profile_report (const char * phase, int64_t start)
+{
+    if (! startup_profile)
+        return;
+
+    int64_t now = g_get_monotonic_time ();
+
+    /* written directly to stderr so as not to depend on the log level */
+    fprintf (stderr, "startup: %-24s %8.1f ms  (done at %8.1f ms)\n", phase,
+     (now - start) / 1000.0, (now - startup_time) / 1000.0);
+}
+
+static void * plugin_scan_worker (void *)
+{
+    int64_t start = g_get_monotonic_time ();
+    plugin_system_init ();
+    startup_profile_report ("plugin registry", start);
+    return nullptr;
+}
+
+/*
+ * Scanning the plugin registry (which may involve loading new or changed
+ * plugin modules) is mostly I/O and is independent of the configuration, so
+ * it is done in a separate thread while the configuration is loaded.  The
+ * plugins can only be started once both are done.  Playlists are parsed last,
+ * since playlist plugins are needed to read them; only the active and resume
+ * playlists are loaded before returning (see load_playlists()).
+ */
 EXPORT void aud_init ()
 {
+    startup_time = g_get_monotonic_time ();
+
     g_thread_pool_set_max_idle_time (100);
 
+    /* the paths are computed on first use, which is not thread-safe */
+    aud_get_path (AudPath::PluginDir);
+    aud_get_path (AudPath::UserDir);
+
+    pthread_t scan_thread;
+    bool scan_threaded = ! pthread_create (& scan_thread, nullptr, plugin_scan_worker, nullptr);
+
+    int64_t start = g_get_monotonic_time ();
     config_load ();
+    startup_profile_report ("config", start);
 
+    start = g_get_monotonic_time ();
     chardet_init ();
     eq_init ();
     output_init ();
     playlist_init ();
+    startup_profile_report ("core", start);
 
+    if (scan_threaded)
+        pthread_join (scan_thread, nullptr);
+    else
+        plugin_scan_worker (nullptr);
+
+    start = g_get_monotonic_time ();
     start_plugins_one ();
+    startup_profile_report ("plugin start", start);
 
     record_init ();
     scanner_init ();
+
+    start = g_get_monotonic_time ();
     load_playlists ();
+    startup_profile_report ("playlists (foreground)", start);
+
+    startup_profile_report ("total", startup_time);
+}
+
+/* Settings and playlists are written to disk by a single background thread,
+ * so that a slow disk never stalls the main loop.  Each subsystem keeps track
+ * of whether its data has changed, takes a snapshot of it from the main
+ * thread, and queues a job to write the snapshot out.  Since there is only one
+ * thread, jobs run in the order they were queued, and no two jobs ever write
+ * the same file at once. */
+struct PersistJob
+{
+    void (* func) (void * data);
+    void * data;
+};
+
+static GThreadPool * persist_pool;
+
+static void persist_worker (void * data, void *)
+{
+    auto job = (PersistJob *) data;
+    job->func (job->data);
+    delete job;
+}
+
+void persist_queue (void (* func) (void * data), void * data)
+{
+    if (! persist_pool)
+        persist_pool = g_thread_pool_new (persist_worker, nullptr, 1, false, nullptr);
+
+    g_thread_pool_push (persist_pool, new PersistJob {func, data}, nullptr);
+}
+
+void persist_wait ()
+{
+    if (persist_pool)
+    {
+        g_thread_pool_free (persist_pool, false, true);
+        persist_pool = nullptr;
+    }
 }
 
+/* only the "config save" hook (in which plugins store their settings) and the
+ * snapshots are done here; the writing is done in the background */
 static void do_autosave (void *)
 {
     hook_call ("config save", nullptr);
@@ -336,14 +436,19 @@ EXPORT void aud_cleanup ()
     playback_stop (true);
 
     adder_cleanup ();
+    replaygain_cleanup ();
+    playlist_availability_cleanup ();
+    playlist_duplicates_cleanup ();
     scanner_cleanup ();
     record_cleanup ();
 
     stop_plugins_one ();
 
     art_cleanup ();
+    vfs_async_cleanup ();
     chardet_cleanup ();
     eq_cleanup ();
+    mixer_cleanup ();
     output_cleanup ();
     playlist_end ();
 
@@ -352,6 +457,7 @@ EXPORT void aud_cleanup ()
     timer_cleanup ();
 
     config_save ();
+    persist_wait ();
     config_cleanup ();
 }
 
@@ -52,6 +52,14 @@ enum class OutputStream {
     AfterEqualizer
 };
 
+/* when to keep the output device open between songs of different formats,
+ * converting the audio instead of reopening the device */
+enum class OutputKeepOpen {
+    Never,         // reopen whenever the rate or channels change
+    ConvertRate,   // resample to the rate already open
+    ConvertAll     // also remap to the channels already open
+};
+
 enum class ReplayGainMode {
     Track,
     Album,
@@ -95,6 +103,10 @@ const char * aud_get_path (AudPath id);
 void aud_set_headless_mode (bool headless);
 bool aud_get_headless_mode ();
 
+// If enabled, the wall time taken by each phase of aud_init() is printed to
+// stderr, including playlists which finish loading in the background.
+void aud_set_startup_profile (bool enable);
+
 // Note that the UserDir and PlaylistDir paths vary depending on the instance
 // number.  Therefore, calling aud_set_instance() after these paths have been
 // referenced, or after aud_init(), is an error.
@@ -0,0 +1,138 @@
+/*
+ * bench-vfs-async.cc - Throughput benchmark for asynchronous file reads
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+#include "audstrings.h"
+#include "internal.h"
+#include "mainloop.h"
+#include "plugins-internal.h"
+#include "runtime.h"
+#include "vfs.h"
+#include "vfs_async.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* only local files are read, so no plugins are needed */
+static const Index<PluginHandle *> no_plugins;
+
+const Index<PluginHandle *> & aud_plugin_list (PluginType) { return no_plugins; }
+bool aud_plugin_get_enabled (PluginHandle *) { return false; }
+const void * aud_plugin_get_header (PluginHandle *) { return nullptr; }
+bool transport_plugin_has_scheme (PluginHandle *, const char *) { return false; }
+bool input_plugin_has_key (PluginHandle *, InputKey, const char *) { return false; }
+
+MainloopType aud_get_mainloop_type () { return MainloopType::GLib; }
+
+extern "C" const char * libguess_determine_encoding (const char *, int, const char *)
+    { return nullptr; }
+
+bool aud_get_bool (const char *, const char *) { return false; }
+String aud_get_str (const char *, const char *) { return String (""); }
+
+size_t misc_bytes_allocated;
+
+static int n_requests, n_done, n_failed;
+static int64_t bytes_read;
+
+static double now_ms ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+static void consume (const char * filename, const Index<char> & buf, void * user)
+{
+    if (! buf.len ())
+        n_failed ++;
+
+    bytes_read += buf.len ();
+
+    if (++ n_done == n_requests)
+        mainloop_quit ();
+}
+
+static void never_called (const char * filename, const Index<char> & buf, void * user)
+{
+    abort ();
+}
+
+static void start (void * files0)
+{
+    auto & files = * (Index<String> *) files0;
+
+    for (int i = 0; i < n_requests; i ++)
+    {
+        /* every tenth request is interactive */
+        auto priority = (i % 10) ? VFSPriority::Background : VFSPriority::Interactive;
+        vfs_async_file_get_contents (files[i % files.len ()], consume, nullptr, priority);
+
+        /* these are cancelled at once and must never be delivered */
+        vfs_async_file_get_contents (files[i % files.len ()], never_called, & files);
+    }
+
+    vfs_async_cancel (never_called, & files);
+}
+
+int main (int argc, char * * argv)
+{
+    n_requests = (argc > 1) ? atoi (argv[1]) : 5000;
+    int n_files = 200, file_size = 65536;
+
+    char dir[] = "/tmp/bench-vfs-async-XXXXXX";
+    if (! mkdtemp (dir))
+        return 1;
+
+    Index<String> files;
+    Index<char> data;
+    data.insert (0, file_size);
+
+    for (int i = 0; i < n_files; i ++)
+    {
+        StringBuf path = str_printf ("%s/%d", dir, i);
+        if (! VFSFile::write_file (path, data.begin (), data.len ()))
+            return 1;
+
+        files.append (String (filename_to_uri (path)));
+    }
+
+    double start_time = now_ms ();
+
+    QueuedFunc queued;
+    queued.queue (start, & files);
+    mainloop_run ();
+
+    double time = now_ms () - start_time;
+
+    vfs_async_cleanup ();
+
+    printf ("requests: %d (%d failed)\n", n_requests, n_failed);
+    printf ("total: %.1f ms (%.1f us per request, %.1f MB/s)\n", time,
+     time * 1000 / n_requests, bytes_read / (time * 1000));
+
+    for (auto & file : files)
+        unlink (uri_to_filename (file));
+
+    rmdir (dir);
+
+    return 0;
+}
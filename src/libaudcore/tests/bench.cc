@@ -0,0 +1,551 @@
+/*
+ * bench.cc - Microbenchmarks for libaudcore primitives
+ * Copyright 2026 Audacious developers
+ *
+ * Redistribution and use in source and binary forms, with or without
+ * modification, are permitted provided that the following conditions are met:
+ *
+ * 1. Redistributions of source code must retain the above copyright notice,
+ *    this list of conditions, and the following disclaimer.
+ *
+ * 2. Redistributions in binary form must reproduce the above copyright notice,
+ *    this list of conditions, and the following disclaimer in the documentation
+ *    provided with the distribution.
+ *
+ * This software is provided "as is" and without any warranty, express or
+ * implied. In no event shall the authors be liable for any damages arising from
+ * the use of this software.
+ */
+
+/*
+ * Usage: bench [--quick] [--rounds N] [--filter TEXT]
+ *
+ * Each benchmark is run for several rounds and the best and median times per
+ * operation are reported.  The output is JSON, with one benchmark per line in
+ * a fixed order, so that results can be compared across releases with plain
+ * text tools as well as JSON-aware ones.  Benchmark names are stable; a
+ * benchmark that changes meaning gets a new name.
+ */
+
+#include "audio.h"
+#include "audstrings.h"
+#include "internal.h"
+#include "multihash.h"
+#include "playlist-data.h"
+#include "ringbuf.h"
+#include "runtime.h"
+#include "tuple.h"
+#include "tuple-compiler.h"
+#include "vfs.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_FORMAT_VERSION 1
+
+/* libaudcore is normally linked against the rest of the program */
+extern "C" const char * libguess_determine_encoding (const char *, int, const char *)
+    { return nullptr; }
+
+bool aud_get_bool (const char *, const char * name)
+    { return ! strcmp (name, "equalizer_active"); }
+int aud_get_int (const char *, const char *)
+    { return 0; }
+double aud_get_double (const char *, const char *)
+    { return 0; }
+
+String aud_get_str (const char *, const char * name)
+{
+    if (! strcmp (name, "generic_title_format"))
+        return String ("${?artist:${artist} - }${?album:${album} - }${title}");
+    if (! strcmp (name, "equalizer_bands"))
+        return String ("6,4,2,0,-2,-4,-2,0,2,4");
+
+    return String ("");
+}
+
+void aud_set_str (const char *, const char *, const char *) {}
+void aud_set_double (const char *, const char *, double) {}
+
+String VFSFile::get_metadata (const char *)
+    { return String (); }
+
+size_t misc_bytes_allocated;
+
+/* PlaylistData is normally driven by playlist.cc; these stand in for it */
+void pl_signal_entry_deleted (PlaylistEntry *) {}
+void pl_signal_position_changed (Playlist::ID *) {}
+void pl_signal_update_queued (Playlist::ID *, Playlist::UpdateLevel, int) {}
+void pl_signal_rescan_needed (Playlist::ID *) {}
+void pl_signal_playlist_deleted (Playlist::ID *) {}
+
+ScanRequest::ScanRequest (const String & filename, int flags, Callback callback,
+ PluginHandle * decoder, Tuple && tuple) :
+    filename (filename), flags (flags), callback (callback) { abort (); }
+
+/* ---- harness ---- */
+
+struct Benchmark
+{
+    const char * name;
+    const char * unit;   // what one operation is
+    int size;            // number of operations per round
+    double (* run) (int size);  // returns the measured time of one round in ns
+};
+
+static int n_rounds = 7;
+static bool first_result = true;
+
+/* keeps the compiler from optimizing away unused results */
+static volatile int64_t sink;
+
+static double now_ns ()
+{
+    timespec ts;
+    clock_gettime (CLOCK_MONOTONIC, & ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static void run_benchmark (const Benchmark & bench, int rounds)
+{
+    Index<double> times;
+
+    for (int round = 0; round < rounds; round ++)
+        times.append (bench.run (bench.size) / bench.size);
+
+    times.sort ([] (const double & a, const double & b)
+        { return (a > b) - (a < b); });
+
+    printf ("%s\n    {\"name\": \"%s\", \"size\": %d, \"unit\": \"%s\", "
+     "\"rounds\": %d, \"best_ns\": %.3f, \"median_ns\": %.3f}",
+     first_result ? "" : ",", bench.name, bench.size, bench.unit, rounds,
+     times[0], times[times.len () / 2]);
+
+    fflush (stdout);
+    first_result = false;
+}
+
+/* ---- audio ---- */
+
+#define AUDIO_SAMPLES 65536
+#define AUDIO_CHANNELS 2
+
+static Index<float> make_samples (int samples)
+{
+    Index<float> data;
+    data.resize (samples);
+
+    /* a full-scale signal, so that conversion back to integer clips */
+    for (int i = 0; i < samples; i ++)
+        data[i] = ((i * 7919) % 2001 - 1000) / 900.0f;
+
+    return data;
+}
+
+template<int format, int bytes>
+static double bench_from_int (int samples)
+{
+    Index<char> in;
+    in.insert (0, samples * bytes);
+    for (int i = 0; i < in.len (); i ++)
+        in[i] = i * 31;
+
+    Index<float> out;
+    out.resize (samples);
+
+    double start = now_ns ();
+    audio_from_int (in.begin (), format, out.begin (), samples);
+    double time = now_ns () - start;
+
+    sink += out[samples / 2];
+    return time;
+}
+
+template<int format, int bytes>
+static double bench_to_int (int samples)
+{
+    Index<float> in = make_samples (samples);
+    Index<char> out;
+    out.insert (0, samples * bytes);
+
+    double start = now_ns ();
+    audio_to_int (in.begin (), out.begin (), format, samples);
+    double time = now_ns () - start;
+
+    sink += out[samples / 2];
+    return time;
+}
+
+static double bench_amplify (int samples)
+{
+    Index<float> data = make_samples (samples);
+    float factors[AUDIO_CHANNELS] = {0.5f, 0.75f};
+
+    double start = now_ns ();
+    audio_amplify (data.begin (), AUDIO_CHANNELS, samples / AUDIO_CHANNELS, factors);
+    double time = now_ns () - start;
+
+    sink += data[samples / 2];
+    return time;
+}
+
+static double bench_eq_filter (int samples)
+{
+    Index<float> data = make_samples (samples);
+
+    double start = now_ns ();
+    eq_filter (data.begin (), samples);
+    double time = now_ns () - start;
+
+    sink += data[samples / 2];
+    return time;
+}
+
+static double bench_calc_freq (int blocks)
+{
+    Index<float> data = make_samples (512);
+    float freq[256];
+
+    double start = now_ns ();
+
+    for (int i = 0; i < blocks; i ++)
+    {
+        calc_freq (data.begin (), freq);
+        sink += freq[i & 255];
+    }
+
+    return now_ns () - start;
+}
+
+/* moves audio through a ring buffer in output-sized chunks, wrapping around */
+static double bench_ringbuf (int samples)
+{
+    const int chunk = 1000;
+
+    RingBuf<float> ring;
+    ring.alloc (4096);
+
+    Index<float> in = make_samples (chunk);
+    Index<float> out;
+    out.resize (chunk);
+
+    double start = now_ns ();
+
+    for (int done = 0; done < samples; done += chunk)
+    {
+        ring.copy_in (in.begin (), chunk);
+        ring.move_out (out.begin (), chunk);
+    }
+
+    double time = now_ns () - start;
+
+    sink += out[chunk / 2];
+    return time;
+}
+
+/* ---- strings and hashing ---- */
+
+/* plain C strings, so that creating a String is measured separately */
+struct KeySet
+{
+    Index<char> text;
+    Index<int> offsets;
+
+    const char * operator[] (int i) const
+        { return text.begin () + offsets[i]; }
+};
+
+static KeySet make_keys (int n, const char * prefix)
+{
+    KeySet keys;
+
+    for (int i = 0; i < n; i ++)
+    {
+        StringBuf key = str_printf ("%s/Artist %d/Album %d/%02d Title %d.flac",
+         prefix, i % 97, i % 13, i % 20, i);
+
+        keys.offsets.append (keys.text.len ());
+        keys.text.insert (key, -1, key.len () + 1);
+    }
+
+    return keys;
+}
+
+/* every string is new, so each call adds a node to the string pool */
+static double bench_string_new (int n)
+{
+    static int serial;
+    KeySet keys = make_keys (n, int_to_str (serial ++));
+    Index<String> strings;
+    strings.insert (0, n);
+
+    double start = now_ns ();
+
+    for (int i = 0; i < n; i ++)
+        strings[i] = String (keys[i]);
+
+    return now_ns () - start;
+}
+
+/* every string is already pooled, so each call is a MultiHash lookup */
+static double bench_string_existing (int n)
+{
+    KeySet keys = make_keys (n, "existing");
+    Index<String> pooled, strings;
+    pooled.insert (0, n);
+    strings.insert (0, n);
+
+    for (int i = 0; i < n; i ++)
+        pooled[i] = String (keys[i]);
+
+    double start = now_ns ();
+
+    for (int i = 0; i < n; i ++)
+        strings[i] = String (keys[i]);
+
+    return now_ns () - start;
+}
+
+static double bench_simplehash_lookup (int n)
+{
+    KeySet keys = make_keys (n, "hash");
+    Index<String> strings;
+    SimpleHash<String, int> hash;
+
+    for (int i = 0; i < n; i ++)
+    {
+        strings.append (keys[i]);
+        hash.add (strings[i], (int) i);
+    }
+
+    int64_t total = 0;
+    double start = now_ns ();
+
+    for (int i = 0; i < n; i ++)
+        total += * hash.lookup (strings[(int) (((int64_t) i * 7919) % n)]);
+
+    double time = now_ns () - start;
+
+    sink += total;
+    return time;
+}
+
+static double bench_compare_encoded (int n)
+{
+    KeySet keys = make_keys (n + 1, "file:///music/some%20folder");
+
+    int64_t total = 0;
+    double start = now_ns ();
+
+    for (int i = 0; i < n; i ++)
+        total += str_compare_encoded (keys[i], keys[i + 1]);
+
+    double time = now_ns () - start;
+
+    sink += total;
+    return time;
+}
+
+static double bench_tuple_format (int n)
+{
+    TupleCompiler compiler;
+    compiler.compile ("${?artist:${artist} - }${?album:${album} - }${title}");
+
+    Tuple tuple;
+    tuple.set_filename ("file:///music/Artist/Album/01%20Title.flac");
+    tuple.set_str (Tuple::Artist, "Artist");
+    tuple.set_str (Tuple::Album, "Album");
+    tuple.set_str (Tuple::Title, "Title");
+    tuple.set_int (Tuple::Track, 1);
+
+    double start = now_ns ();
+
+    for (int i = 0; i < n; i ++)
+        compiler.format (tuple);
+
+    double time = now_ns () - start;
+
+    sink += tuple.get_str (Tuple::FormattedTitle)[0];
+    return time;
+}
+
+/* ---- playlists ---- */
+
+/* a library-like playlist: 20 artists, 10 albums each, 12 tracks per album,
+ * added in shuffled order so that sorting has real work to do */
+static Index<PlaylistAddItem> make_items (int n_entries)
+{
+    Index<PlaylistAddItem> items;
+
+    for (int i = 0; i < n_entries; i ++)
+    {
+        int k = (int) (((int64_t) i * 7919) % n_entries);
+        int artist = (k / 120) % 20, album = (k / 12) % 10, track = k % 12 + 1;
+
+        StringBuf artist_name = str_printf ("Artist %d", artist);
+        StringBuf album_name = str_printf ("Album %d", album);
+        StringBuf title = str_printf ("Track %d of %d", track, k);
+
+        StringBuf filename = str_printf ("file:///music/%s/%s/%02d%%20%s.flac",
+         (const char *) artist_name, (const char *) album_name, track,
+         (const char *) title);
+
+        Tuple tuple;
+        tuple.set_filename (filename);
+        tuple.set_str (Tuple::Artist, artist_name);
+        tuple.set_str (Tuple::Album, album_name);
+        tuple.set_str (Tuple::Title, title);
+        tuple.set_int (Tuple::Track, track);
+        tuple.set_int (Tuple::Length, 180000 + k % 60000);
+        tuple.set_state (Tuple::Valid);
+
+        items.append (String (filename), std::move (tuple), nullptr);
+    }
+
+    return items;
+}
+
+static double bench_playlist_insert (int n)
+{
+    auto data = new PlaylistData (nullptr, "Benchmark");
+    auto items = make_items (n);
+
+    double start = now_ns ();
+    data->insert_items (0, std::move (items));
+    double time = now_ns () - start;
+
+    delete data;
+    return time;
+}
+
+static double bench_playlist_sort (int n)
+{
+    auto data = new PlaylistData (nullptr, "Benchmark");
+    data->insert_items (0, make_items (n));
+
+    double start = now_ns ();
+
+    Index<PlaylistData::SortItem> items;
+    Index<int> positions;
+    data->get_sort_items (false, items, positions);
+
+    auto order = PlaylistData::sort_items (Playlist::Title, items);
+    data->apply_sort (positions, order);
+
+    double time = now_ns () - start;
+
+    delete data;
+    return time;
+}
+
+static double bench_playlist_shuffle (int n)
+{
+    auto data = new PlaylistData (nullptr, "Benchmark");
+    data->insert_items (0, make_items (n));
+
+    double start = now_ns ();
+    data->randomize_order ();
+    double time = now_ns () - start;
+
+    delete data;
+    return time;
+}
+
+static const Benchmark audio_benchmarks[] = {
+    {"audio_from_int/s16", "sample", AUDIO_SAMPLES, bench_from_int<FMT_S16_NE, 2>},
+    {"audio_from_int/s24", "sample", AUDIO_SAMPLES, bench_from_int<FMT_S24_NE, 4>},
+    {"audio_from_int/s32", "sample", AUDIO_SAMPLES, bench_from_int<FMT_S32_NE, 4>},
+    {"audio_to_int/s16", "sample", AUDIO_SAMPLES, bench_to_int<FMT_S16_NE, 2>},
+    {"audio_to_int/s24", "sample", AUDIO_SAMPLES, bench_to_int<FMT_S24_NE, 4>},
+    {"audio_to_int/s32", "sample", AUDIO_SAMPLES, bench_to_int<FMT_S32_NE, 4>},
+    {"audio_amplify/stereo", "sample", AUDIO_SAMPLES, bench_amplify},
+    {"eq_filter/stereo-44100", "sample", AUDIO_SAMPLES, bench_eq_filter},
+    {"calc_freq/512", "block", 1000, bench_calc_freq},
+    {"ringbuf/copy-in-move-out", "sample", AUDIO_SAMPLES * 4, bench_ringbuf}
+};
+
+static const Benchmark string_benchmarks[] = {
+    {"string_pool/new", "string", 100000, bench_string_new},
+    {"string_pool/existing", "string", 100000, bench_string_existing},
+    {"simplehash/lookup", "lookup", 100000, bench_simplehash_lookup},
+    {"str_compare_encoded/uri", "compare", 100000, bench_compare_encoded},
+    {"tuple_compiler/format", "format", 100000, bench_tuple_format}
+};
+
+struct PlaylistBenchmark
+{
+    const char * name;
+    double (* run) (int size);
+};
+
+static const PlaylistBenchmark playlist_benchmarks[] = {
+    {"playlist/insert", bench_playlist_insert},
+    {"playlist/sort-title", bench_playlist_sort},
+    {"playlist/shuffle", bench_playlist_shuffle}
+};
+
+int main (int argc, char * * argv)
+{
+    bool quick = false;
+    const char * filter = nullptr;
+
+    for (int i = 1; i < argc; i ++)
+    {
+        if (! strcmp (argv[i], "--quick"))
+            quick = true;
+        else if (! strcmp (argv[i], "--rounds") && i + 1 < argc)
+            n_rounds = aud::max (atoi (argv[++ i]), 1);
+        else if (! strcmp (argv[i], "--filter") && i + 1 < argc)
+            filter = argv[++ i];
+        else
+        {
+            fprintf (stderr, "usage: %s [--quick] [--rounds N] [--filter TEXT]\n", argv[0]);
+            return 1;
+        }
+    }
+
+    /* large playlists take a while to build, so fewer rounds are run */
+    static const int full_sizes[] = {10000, 100000, 1000000};
+    static const int quick_sizes[] = {10000};
+
+    auto playlist_sizes = quick ? ArrayRef<int> (quick_sizes) : ArrayRef<int> (full_sizes);
+
+    eq_set_format (AUDIO_CHANNELS, 44100);
+    eq_init ();
+    PlaylistData::update_formatter ();
+
+    printf ("{\n  \"format\": %d,\n  \"benchmarks\": [", BENCH_FORMAT_VERSION);
+
+    for (auto & bench : audio_benchmarks)
+    {
+        if (! filter || strstr (bench.name, filter))
+            run_benchmark (bench, n_rounds);
+    }
+
+    for (auto & bench : string_benchmarks)
+    {
+        if (! filter || strstr (bench.name, filter))
+            run_benchmark (bench, n_rounds);
+    }
+
+    for (auto & bench : playlist_benchmarks)
+    {
+        if (filter && ! strstr (bench.name, filter))
+            continue;
+
+        for (int size : playlist_sizes)
+        {
+            StringBuf name = str_printf ("%s/%d", bench.name, size);
+            run_benchmark ({name, "entry", size, bench.run}, aud::min (n_rounds, 3));
+        }
+    }
+
+    printf ("\n  ]\n}\n");
+
+    PlaylistData::cleanup_formatter ();
+    eq_cleanup ();
+
+    return 0;
+}
@@ -6,6 +6,8 @@ extern "C" const char * libguess_determine_encoding (const char *, int, const ch
 
 bool aud_get_bool (const char *, const char *)
     { return false; }
+int aud_get_int (const char *, const char *)
+    { return 0; }
 String aud_get_str (const char *, const char *)
     { return String (""); }
 String VFSFile::get_metadata (const char *)
@@ -20,12 +20,14 @@
 #include "audio.h"
 #include "audstrings.h"
 #include "internal.h"
+#include "mixer.h"
 #include "ringbuf.h"
 #include "tuple.h"
 #include "tuple-compiler.h"
 #include "vfs.h"
 
 #include <assert.h>
+#include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -516,6 +518,267 @@ static void test_str_printf ()
     assert (! strcmp (problem, "6 * 7 = 42"));
 }
 
+/* resamples <in> in chunks of <chunk> frames, finishing with the last one */
+static Index<float> resample (const Index<float> & in, int channels, int chunk)
+{
+    Index<float> out, data;
+    int frames = in.len () / channels;
+
+    for (int f = 0; f < frames; f += chunk)
+    {
+        int n = aud::min (chunk, frames - f);
+
+        data.resize (0);
+        data.insert (& in[f * channels], 0, n * channels);
+
+        auto & got = resampler_process (data, f + n == frames);
+        out.insert (got.begin (), -1, got.len ());
+    }
+
+    return out;
+}
+
+static void test_resampler_rates (int in_rate, int out_rate)
+{
+    const int channels = 2, frames = in_rate / 2;
+
+    assert (resampler_set_format (channels, in_rate, out_rate));
+    assert (resampler_active ());
+
+    /* constant input: left at 0.5, right at -0.25 */
+    Index<float> in;
+    in.insert (0, frames * channels);
+    for (int f = 0; f < frames; f ++)
+    {
+        in[f * channels] = 0.5f;
+        in[f * channels + 1] = -0.25f;
+    }
+
+    Index<float> out = resample (in, channels, 1000);
+    int out_frames = out.len () / channels;
+
+    /* the finish flush pushes the last input frames out of the filter, so
+     * the length matches the rate ratio */
+    int expect = (int64_t) frames * out_rate / in_rate;
+    assert (abs (out_frames - expect) <= 1);
+
+    /* unity gain at DC, once past the start and end of the signal */
+    for (int f = 64; f < out_frames - 64; f ++)
+    {
+        assert (fabsf (out[f * channels] - 0.5f) < 0.0001f);
+        assert (fabsf (out[f * channels + 1] + 0.25f) < 0.0001f);
+    }
+
+    /* a sine wave, so that every output depends on its neighbors */
+    for (int i = 0; i < in.len (); i ++)
+        in[i] = sinf (i * 0.01f);
+
+    Index<float> whole = resample (in, channels, frames);
+
+    /* the same signal in small pieces must give the same output, which it
+     * does only if the history is kept between calls; after the finish flush
+     * of the previous run, this also checks that the filter starts over */
+    for (int chunk : {1, 7, 441, 1024})
+    {
+        Index<float> pieces = resample (in, channels, chunk);
+        assert (pieces.len () == whole.len ());
+
+        for (int i = 0; i < whole.len (); i ++)
+            assert (fabsf (pieces[i] - whole[i]) < 0.00001f);
+    }
+
+    resampler_cleanup ();
+}
+
+static void test_resampler ()
+{
+    test_resampler_rates (44100, 48000);
+    test_resampler_rates (48000, 44100);
+
+    /* no conversion at the same rate */
+    assert (resampler_set_format (2, 44100, 44100));
+    assert (! resampler_active ());
+    resampler_cleanup ();
+}
+
+static void test_remap_channels ()
+{
+    const float FRONT = 0.4142f, CENTER = 0.7071f * 0.4142f;
+
+    /* 5.1 to stereo: FL, FR, FC, LFE, RL, RR */
+    Index<float> in, out;
+    in.insert (0, 6 * 4);
+    in[0] = 1;            // frame 0: front left only
+    in[6 + 2] = 1;        // frame 1: center only
+    in[12 + 3] = 1;       // frame 2: LFE only
+    in[18 + 5] = 1;       // frame 3: rear right only
+
+    audio_remap_channels (in, 6, out, 2);
+    assert (out.len () == 2 * 4);
+
+    assert (fabsf (out[0] - FRONT) < 0.0001f && out[1] == 0);
+    assert (fabsf (out[2] - CENTER) < 0.0001f && fabsf (out[3] - CENTER) < 0.0001f);
+    assert (out[4] == 0 && out[5] == 0);
+    assert (out[6] == 0 && fabsf (out[7] - CENTER) < 0.0001f);
+
+    /* mono goes to the front left and right */
+    in.resize (0);
+    in.insert (0, 2);
+    in[0] = 0.5f;
+    in[1] = -1;
+
+    audio_remap_channels (in, 1, out, 2);
+    assert (out.len () == 4);
+    assert (out[0] == 0.5f && out[1] == 0.5f && out[2] == -1 && out[3] == -1);
+
+    audio_remap_channels (in, 1, out, 6);
+    assert (out.len () == 12);
+    assert (out[0] == 0.5f && out[1] == 0.5f);
+    for (int c = 2; c < 6; c ++)
+        assert (out[c] == 0 && out[6 + c] == 0);
+
+    /* anything to mono is averaged */
+    in.resize (0);
+    in.insert (0, 6);
+    for (int c = 0; c < 6; c ++)
+        in[c] = c;
+
+    audio_remap_channels (in, 6, out, 1);
+    assert (out.len () == 1 && out[0] == 2.5f);
+
+    /* otherwise channels are matched by position */
+    audio_remap_channels (in, 6, out, 4);
+    assert (out.len () == 4);
+    for (int c = 0; c < 4; c ++)
+        assert (out[c] == c);
+
+    audio_remap_channels (in, 2, out, 3);
+    assert (out.len () == 9);
+    assert (out[0] == 0 && out[1] == 1 && out[2] == 0);
+}
+
+/* runs the mixer over <frames> frames of a song at the given level */
+static Index<float> mix (int frames, int channels, int rate, float level = 0)
+{
+    Index<float> data;
+    data.insert (0, frames * channels);
+
+    for (float & sample : data)
+        sample = level;
+
+    mixer_mix (data, channels, rate);
+    return data;
+}
+
+static void write_ramp (MixStream * stream, int first, int count)
+{
+    Index<float> data;
+    data.insert (0, count);
+
+    for (int i = 0; i < count; i ++)
+        data[i] = first + i;
+
+    assert (aud_mix_write (stream, data.begin (), count * sizeof (float)) ==
+     (int) (count * sizeof (float)));
+}
+
+static void test_mixer ()
+{
+    /* same format as the song: mixed straight from the buffer, which holds
+     * 20 samples at 10 Hz; the second write wraps around the end of it */
+    MixStream * stream = aud_mix_open (FMT_FLOAT, 10, 1);
+    assert (stream);
+
+    write_ramp (stream, 1, 15);
+    Index<float> out = mix (10, 1, 10);
+    for (int i = 0; i < 10; i ++)
+        assert (out[i] == 1 + i);
+
+    write_ramp (stream, 16, 10);
+    assert (aud_mix_get_delay (stream) == 1500);
+
+    out = mix (20, 1, 10);
+    for (int i = 0; i < 15; i ++)
+        assert (out[i] == 11 + i);
+    for (int i = 15; i < 20; i ++)
+        assert (out[i] == 0);
+
+    assert (aud_mix_get_delay (stream) == 0);
+    aud_mix_close (stream, false);
+
+    /* upsampled 10 Hz to 20 Hz: interpolation stops one frame short of the
+     * end of the buffer, and goes on from there after the next write */
+    stream = aud_mix_open (FMT_FLOAT, 10, 1);
+
+    write_ramp (stream, 0, 5);
+    out = mix (20, 1, 20);
+    for (int i = 0; i < 8; i ++)
+        assert (out[i] == i * 0.5f);
+    for (int i = 8; i < 20; i ++)
+        assert (out[i] == 0);
+
+    assert (aud_mix_get_delay (stream) == 100);
+
+    write_ramp (stream, 5, 2);
+    out = mix (6, 1, 20);
+    for (int i = 0; i < 4; i ++)
+        assert (out[i] == 4 + i * 0.5f);
+    assert (out[4] == 0 && out[5] == 0);
+
+    aud_mix_close (stream, false);
+
+    /* stereo mixed down to a mono song at the same rate */
+    stream = aud_mix_open (FMT_FLOAT, 10, 2);
+    write_ramp (stream, 1, 4);
+    out = mix (3, 1, 10);
+    assert (out[0] == 1.5f && out[1] == 0 && out[2] == 0);
+    aud_mix_close (stream, false);
+
+    mixer_cleanup ();
+
+    /* while a stream with a <duck> of 0.5 has audio buffered, the song is
+     * faded at a rate of 1 per 50 ms (0.02 per frame at 1000 Hz), down to
+     * half, and back up once the stream is closed; the stream itself is
+     * silent here (a gain of 0) */
+    stream = aud_mix_open (FMT_FLOAT, 1000, 1, 0, 0.5f);
+    write_ramp (stream, 0, 100);
+
+    out = mix (40, 1, 1000, 1);
+    for (int i = 0; i < 40; i ++)
+        assert (fabsf (out[i] - aud::max (1 - 0.02f * (i + 1), 0.5f)) < 0.0001f);
+
+    aud_mix_close (stream, false);
+
+    out = mix (30, 1, 1000, 1);
+    for (int i = 0; i < 30; i ++)
+        assert (fabsf (out[i] - aud::min (0.5f + 0.02f * (i + 1), 1.0f)) < 0.0001f);
+
+    /* a draining stream that is resampled holds back its last frame, but is
+     * still freed (ending the ducking) once the other frames are played */
+    stream = aud_mix_open (FMT_FLOAT, 500, 1, 0, 0.5f);
+    write_ramp (stream, 0, 10);
+    aud_mix_close (stream, true);
+
+    out = mix (10, 1, 1000, 1);  // plays 5 of the 10 frames
+    assert (out[9] < 0.9f);
+    out = mix (30, 1, 1000, 1);  // plays the rest and frees the stream
+    assert (out[29] < 0.6f);
+    out = mix (30, 1, 1000, 1);
+    assert (fabsf (out[29] - 1) < 0.0001f);
+
+    /* likewise for a stream mixed directly, which holds nothing back */
+    stream = aud_mix_open (FMT_FLOAT, 1000, 1, 0, 0.5f);
+    write_ramp (stream, 0, 10);
+    aud_mix_close (stream, true);
+
+    out = mix (10, 1, 1000, 1);
+    assert (out[9] < 0.9f);
+    out = mix (30, 1, 1000, 1);
+    assert (fabsf (out[29] - 1) < 0.0001f);
+
+    mixer_cleanup ();
+}
+
 int main ()
 {
     test_audio_conversion ();
@@ -526,6 +789,9 @@ int main ()
     test_ringbuf ();
     test_stringbuf ();
     test_str_printf ();
+    test_resampler ();
+    test_remap_channels ();
+    test_mixer ();
 
     return 0;
 }
@@ -24,12 +24,20 @@
 #include <inttypes.h>
 #include <string.h>
 
+#if defined(__linux__)
+#include <sys/vfs.h>
+#elif defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+#include <sys/param.h>
+#include <sys/mount.h>
+#endif
+
 #include "audstrings.h"
 #include "i18n.h"
 #include "internal.h"
 #include "plugin.h"
 #include "plugins-internal.h"
 #include "probe-buffer.h"
+#include "read-ahead.h"
 #include "runtime.h"
 #include "vfs_local.h"
 
@@ -80,6 +88,47 @@ static TransportPlugin * lookup_transport (const char * filename,
     return nullptr;
 }
 
+/* true if a local file is on a network (or FUSE) file system, where reads may
+ * stall just like those from a transport plugin */
+static bool is_network_file (const char * filename)
+{
+#if defined(__linux__) || defined(__APPLE__) || defined(__FreeBSD__) || defined(__OpenBSD__)
+    StringBuf path = uri_to_filename (filename);
+    struct statfs info;
+
+    if (! path || statfs (path, & info) < 0)
+        return false;
+
+#ifdef __linux__
+    switch ((uint32_t) info.f_type)
+    {
+    case 0x6969:      /* NFS */
+    case 0x517b:      /* SMB */
+    case 0xff534d42:  /* CIFS */
+    case 0xfe534d42:  /* SMB2 */
+    case 0x65735546:  /* FUSE (sshfs, etc.) */
+    case 0x01021997:  /* 9P */
+    case 0x00c36400:  /* Ceph */
+    case 0x5346414f:  /* AFS */
+    case 0x73757245:  /* Coda */
+        return true;
+    default:
+        return false;
+    }
+#else
+    for (const char * type : {"nfs", "smbfs", "afpfs", "webdav", "fusefs", "macfuse"})
+    {
+        if (! strcmp (info.f_fstypename, type))
+            return true;
+    }
+
+    return false;
+#endif
+#else
+    return false;
+#endif
+}
+
 /**
  * Opens a stream from a VFS transport using one of the registered
  * #VFSConstructor handlers.
@@ -98,9 +147,19 @@ EXPORT VFSFile::VFSFile (const char * filename, const char * mode)
     if (! impl)
         return;
 
-    /* enable buffering for read-only handles */
+    /* enable buffering for read-only handles, and read-ahead for those from
+     * transport plugins or network file systems (a file on a local disk, or
+     * stdin, would gain nothing from it but an extra thread and copy) */
     if (mode[0] == 'r' && ! strchr (mode, '+'))
+    {
+        bool read_ahead = (tp == & local_transport) ?
+         is_network_file (strip_subtune (filename)) : (tp != & stdin_transport);
+
+        if (read_ahead)
+            impl = new ReadAhead (filename, impl);
+
         impl = new ProbeBuffer (filename, impl);
+    }
 
     AUDINFO ("<%p> open (mode %s) %s\n", impl, mode, filename);
     m_filename = String (filename);
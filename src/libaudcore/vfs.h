@@ -140,7 +140,10 @@ public:
     int ftruncate (int64_t length) __attribute__ ((warn_unused_result));
     int fflush () __attribute__ ((warn_unused_result));
 
-    /* used to read e.g. ICY metadata */
+    /* used to read e.g. ICY metadata; for read-only files, read-ahead
+     * statistics are available as "read-ahead-hit-rate" (percentage of reads
+     * that did not wait for data), "read-ahead-stall-ms", and
+     * "read-ahead-window" (in bytes) once read-ahead has started */
     String get_metadata (const char * field);
 
     /* the VFS layer buffers up to 256 KB of data at the beginning of files
@@ -19,29 +19,47 @@
 
 #include <pthread.h>
 
+#include <glib.h>
+
+#include "internal.h"
 #include "list.h"
 #include "mainloop.h"
+#include "runtime.h"
 #include "vfs.h"
 #include "vfs_async.h"
 
+/* Requests are served by a shared pool of at most this many threads.
+ * Waiting requests are started in order of priority, then in the order made.
+ * One thread is always kept free for interactive requests, so that a slow
+ * background request cannot hold them up. */
+#define IO_THREADS 4
+#define BACKGROUND_THREADS (IO_THREADS - 1)
+
 struct QueuedData : public ListNode
 {
     const String filename;
     const VFSConsumer cons_f;
     void * const user;
+    const VFSPriority priority;
 
-    pthread_t thread;
-
+    bool cancelled = false;
     Index<char> buf;
 
-    QueuedData (const char * filename, VFSConsumer cons_f, void * user) :
+    QueuedData (const char * filename, VFSConsumer cons_f, void * user,
+     VFSPriority priority) :
         filename (filename),
         cons_f (cons_f),
-        user (user) {}
+        user (user),
+        priority (priority) {}
 };
 
+static GThreadPool * pool;
+static int n_background;  // background requests being read
+
 static QueuedFunc queued_func;
-static List<QueuedData> queue;
+static List<QueuedData> waiting[2];  // not yet started, by priority
+static List<QueuedData> active;      // being read
+static List<QueuedData> finished;    // waiting to be delivered
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
 
 static void send_data (void *)
@@ -49,13 +67,12 @@ static void send_data (void *)
     pthread_mutex_lock (& mutex);
 
     QueuedData * data;
-    while ((data = queue.head ()))
+    while ((data = finished.head ()))
     {
-        queue.remove (data);
+        finished.remove (data);
 
         pthread_mutex_unlock (& mutex);
 
-        pthread_join (data->thread, nullptr);
         data->cons_f (data->filename, data->buf, data->user);
         delete data;
 
@@ -65,7 +82,32 @@ static void send_data (void *)
     pthread_mutex_unlock (& mutex);
 }
 
-static void * read_worker (void * data0)
+/* starts as many waiting requests as the thread limits allow; assumes mutex */
+static void start_waiting ()
+{
+    while (1)
+    {
+        auto & queue = waiting[(int) VFSPriority::Interactive].head () ?
+         waiting[(int) VFSPriority::Interactive] : waiting[(int) VFSPriority::Background];
+
+        QueuedData * data = queue.head ();
+        if (! data)
+            return;
+
+        if (data->priority == VFSPriority::Background && n_background >= BACKGROUND_THREADS)
+            return;
+
+        queue.remove (data);
+        active.append (data);
+
+        if (data->priority == VFSPriority::Background)
+            n_background ++;
+
+        g_thread_pool_push (pool, data, nullptr);
+    }
+}
+
+static void read_worker (void * data0, void *)
 {
     auto data = (QueuedData *) data0;
 
@@ -75,17 +117,108 @@ static void * read_worker (void * data0)
 
     pthread_mutex_lock (& mutex);
 
-    if (! queue.head ())
-        queued_func.queue (send_data, nullptr);
+    active.remove (data);
+
+    if (data->priority == VFSPriority::Background)
+        n_background --;
+
+    if (data->cancelled)
+        delete data;
+    else
+    {
+        if (! finished.head ())
+            queued_func.queue (send_data, nullptr);
+
+        finished.append (data);
+    }
 
-    queue.append (data);
+    start_waiting ();
+
+    pthread_mutex_unlock (& mutex);
+}
+
+EXPORT void vfs_async_file_get_contents (const char * filename,
+ VFSConsumer cons_f, void * user, VFSPriority priority)
+{
+    pthread_mutex_lock (& mutex);
+
+    if (! pool)
+        pool = g_thread_pool_new (read_worker, nullptr, IO_THREADS, false, nullptr);
+
+    waiting[(int) priority].append (new QueuedData (filename, cons_f, user, priority));
+    start_waiting ();
 
     pthread_mutex_unlock (& mutex);
-    return nullptr;
 }
 
 EXPORT void vfs_async_file_get_contents (const char * filename, VFSConsumer cons_f, void * user)
 {
-    auto data = new QueuedData (filename, cons_f, user);
-    pthread_create (& data->thread, nullptr, read_worker, data);
+    vfs_async_file_get_contents (filename, cons_f, user, VFSPriority::Interactive);
+}
+
+EXPORT void vfs_async_cancel (VFSConsumer cons_f, void * user)
+{
+    pthread_mutex_lock (& mutex);
+
+    auto remove_matching = [cons_f, user] (List<QueuedData> & list)
+    {
+        QueuedData * next;
+        for (QueuedData * data = list.head (); data; data = next)
+        {
+            next = list.next (data);
+
+            if (data->cons_f == cons_f && data->user == user)
+            {
+                list.remove (data);
+                delete data;
+            }
+        }
+    };
+
+    remove_matching (waiting[(int) VFSPriority::Interactive]);
+    remove_matching (waiting[(int) VFSPriority::Background]);
+    remove_matching (finished);
+
+    /* requests being read are deleted by the worker once it is done */
+    for (QueuedData * data = active.head (); data; data = active.next (data))
+    {
+        if (data->cons_f == cons_f && data->user == user)
+            data->cancelled = true;
+    }
+
+    pthread_mutex_unlock (& mutex);
+}
+
+void vfs_async_cleanup ()
+{
+    pthread_mutex_lock (& mutex);
+
+    /* requests should have been cancelled by whoever made them */
+    bool pending = waiting[0].head () || waiting[1].head () || finished.head ();
+
+    for (QueuedData * data = active.head (); data; data = active.next (data))
+    {
+        if (! data->cancelled)
+            pending = true;
+
+        data->cancelled = true;
+    }
+
+    if (pending)
+        AUDWARN ("Asynchronous file reads still pending at exit!\n");
+
+    /* nothing more will be started or delivered */
+    waiting[0].clear ();
+    waiting[1].clear ();
+
+    pthread_mutex_unlock (& mutex);
+
+    if (pool)
+    {
+        g_thread_pool_free (pool, false, true);
+        pool = nullptr;
+    }
+
+    finished.clear ();
+    queued_func.stop ();
 }
@@ -24,6 +24,26 @@
 
 typedef void (* VFSConsumer) (const char * filename, const Index<char> & buf, void * user);
 
+/* Requests of higher priority are served first, and one thread is kept free
+ * for interactive requests.  Interactive requests are for things the user is
+ * waiting for right now; background requests (e.g. album art and other data
+ * loaded ahead of time) are for everything else. */
+enum class VFSPriority {
+    Interactive,
+    Background
+};
+
+/* Reads the contents of a file in a background thread, then passes them to
+ * <cons_f> in the main thread.  If the file cannot be read, <buf> is empty.
+ * The number of threads used is limited, so any number of requests can be
+ * made at once. */
 void vfs_async_file_get_contents (const char * filename, VFSConsumer cons_f, void * user);
+void vfs_async_file_get_contents (const char * filename, VFSConsumer cons_f,
+ void * user, VFSPriority priority);
+
+/* Cancels all requests made with the given <cons_f> and <user> whose data
+ * has not yet been passed on.  <cons_f> will not be called for them.  Should
+ * be called from the main thread, e.g. before <user> is freed. */
+void vfs_async_cancel (VFSConsumer cons_f, void * user);
 
 #endif
@@ -19,85 +19,89 @@
 
 #include "internal.h"
 
-#include <assert.h>
 #include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 
-#include "hook.h"
-#include "list.h"
 #include "mainloop.h"
 #include "output.h"
+#include "runtime.h"
+#include "visualizer.h"
 
-#define INTERVAL 33 /* milliseconds */
 #define FRAMES_PER_NODE 512
+#define N_NODES 256 /* must be a power of two */
+#define NODE_MASK (N_NODES - 1)
 
-struct VisNode : public ListNode
-{
-    VisNode (int channels, int time) :
-        channels (channels),
-        time (time),
-        data (new float[channels * FRAMES_PER_NODE]) {}
-
-    ~VisNode ()
-        { delete[] data; }
+/* Audio data is handed from the output thread (the writer) to the main thread
+ * (the reader) through a fixed ring of nodes.  Nodes from node_tail up to
+ * node_head belong to the reader; the node at node_head is being built by the
+ * writer.  Neither side takes a lock to pass data.  To discard queued nodes
+ * (on a flush), the serial number is bumped, and the reader skips any nodes
+ * stamped with an older serial number. */
 
-    const int channels;
+struct VisNode
+{
+    int serial;
+    int channels;
     int time;
-    float * data;
+    Index<float> data;
 };
 
+static VisNode nodes[N_NODES];
+static unsigned node_head, node_tail;
+static int serial;
+
+/* writer state, changed only from the output thread */
+static int writer_serial = -1;
+static bool building, have_last;
+static int current_frames, last_time;
+
+/* control state, changed only with the mutex held */
 static pthread_mutex_t mutex = PTHREAD_MUTEX_INITIALIZER;
-static bool enabled = false;
+static int enabled_types = 0;
 static bool playing = false, paused = false;
-static VisNode * current_node = nullptr;
-static int current_frames;
-static List<VisNode> vis_list;
-static List<VisNode> vis_pool;
+static int interval = 33; /* milliseconds */
+static QueuedFunc queued_send;
 static QueuedFunc queued_clear;
 
 static void send_audio (void *)
 {
-    /* call before locking mutex to avoid deadlock */
+    /* read the time first; any node added after this is not yet due */
     int outputted = output_get_raw_time ();
 
-    pthread_mutex_lock (& mutex);
-
-    if (! enabled || ! playing || paused)
-    {
-        pthread_mutex_unlock (& mutex);
+    if (! enabled_types || ! playing || paused)
         return;
-    }
+
+    int cur_serial = __sync_fetch_and_add (& serial, 0);
+    unsigned tail = node_tail;
+    unsigned head = __sync_fetch_and_add (& node_head, 0);
 
     VisNode * node = nullptr;
-    VisNode * next;
 
-    while ((next = vis_list.head ()))
+    for (; tail != head; tail ++)
     {
+        VisNode * next = & nodes[tail & NODE_MASK];
+
+        /* discard nodes queued before a flush */
+        if (next->serial != cur_serial)
+            continue;
+
         /* If we are considering a node, stop searching and use it if it is the
          * most recent (that is, the next one is in the future).  Otherwise,
          * consider the next node if it is not in the future by more than the
          * length of an interval. */
-        if (next->time > outputted + (node ? 0 : INTERVAL))
+        if (next->time > outputted + (node ? 0 : interval))
             break;
 
-        if (node)
-            vis_pool.prepend (node);
-
         node = next;
-        vis_list.remove (node);
     }
 
-    pthread_mutex_unlock (& mutex);
-
-    if (! node)
-        return;
-
-    vis_send_audio (node->data, node->channels);
+    /* the node is read in place and handed back to the writer afterward */
+    if (node)
+        vis_send_audio (node->data.begin (), node->channels);
 
-    pthread_mutex_lock (& mutex);
-    vis_pool.prepend (node);
-    pthread_mutex_unlock (& mutex);
+    __sync_synchronize ();
+    node_tail = tail;
 }
 
 static void send_clear (void *)
@@ -107,13 +111,9 @@ static void send_clear (void *)
 
 static void flush_locked ()
 {
-    delete current_node;
-    current_node = nullptr;
-
-    vis_list.clear ();
-    vis_pool.clear ();
+    __sync_fetch_and_add (& serial, 1);
 
-    if (enabled)
+    if (enabled_types)
         queued_clear.queue (send_clear, nullptr);
 }
 
@@ -131,13 +131,17 @@ static void start_stop_locked (bool new_playing, bool new_paused)
 
     queued_clear.stop ();
 
-    if (! enabled || ! playing)
+    if (! enabled_types || ! playing)
         flush_locked ();
 
-    if (enabled && playing && ! paused)
-        timer_add (TimerRate::Hz30, send_audio);
+    if (enabled_types && playing && ! paused)
+    {
+        int rate = aud::clamp (aud_get_int (0, "vis_update_rate"), 10, 200);
+        interval = 1000 / rate;
+        queued_send.start (interval, send_audio, nullptr);
+    }
     else
-        timer_remove (TimerRate::Hz30, send_audio);
+        queued_send.stop ();
 }
 
 void vis_runner_start_stop (bool new_playing, bool new_paused)
@@ -147,59 +151,90 @@ void vis_runner_start_stop (bool new_playing, bool new_paused)
     pthread_mutex_unlock (& mutex);
 }
 
+static void copy_frames (const float * from, int from_channels, float * to,
+ int to_channels, int frames)
+{
+    if (from_channels == to_channels)
+        memcpy (to, from, sizeof (float) * to_channels * frames);
+    else
+    {
+        /* mix down to mono, the same way as visualization.cc does */
+        for (int i = 0; i < frames; i ++)
+        {
+            to[i] = (from_channels > 1) ? (from[0] + from[1]) / 2 : from[0];
+            from += from_channels;
+        }
+    }
+}
+
+/* called from the output thread only */
 void vis_runner_pass_audio (int time, const Index<float> & data, int channels, int rate)
 {
-    pthread_mutex_lock (& mutex);
+    int types = enabled_types;
+    if (! types || ! playing)
+        return;
+
+    int cur_serial = __sync_fetch_and_add (& serial, 0);
 
-    if (! enabled || ! playing)
+    if (cur_serial != writer_serial)
     {
-        pthread_mutex_unlock (& mutex);
-        return;
+        writer_serial = cur_serial;
+        building = false;
+        have_last = false;
     }
 
+    /* If no visualizer wants the full multi-channel data, store only a mono
+     * mix; the reader can then pass it to visualizers without another copy. */
+    int node_channels = (types & Visualizer::MultiPCM) ? channels : 1;
+
     /* We can build a single node from multiple calls; we can also build
-     * multiple nodes from the same call.  If current_node is present, it was
+     * multiple nodes from the same call.  If building is set, a node was
      * partly built in the last call and needs to be finished. */
 
+    int frames = data.len () / channels;
     int at = 0;
 
     while (1)
     {
-        if (current_node)
-            assert (current_node->channels == channels);
-        else
+        VisNode & node = nodes[node_head & NODE_MASK];
+
+        if (building && node.channels != node_channels)
+            building = false;
+
+        if (! building)
         {
             int node_time = time;
 
             /* There is no partly-built node, so start a new one.  Normally
              * there will be nodes in the queue already; if so, we want to copy
-             * audio data from the signal starting at 30 milliseconds after the
+             * audio data from the signal starting one interval after the
              * beginning of the most recent node.  If there are no nodes in the
              * queue, we are at the beginning of the song or had an underrun,
              * and we want to copy the earliest audio data we have. */
 
-            VisNode * tail = vis_list.tail ();
-            if (tail)
-                node_time = tail->time + INTERVAL;
+            if (have_last)
+                node_time = last_time + interval;
 
-            at = channels * (int) ((int64_t) (node_time - time) * rate / 1000);
+            at = (int) ((int64_t) (node_time - time) * rate / 1000);
 
             if (at < 0)
                 at = 0;
-            if (at >= data.len ())
+            if (at >= frames)
+                break;
+
+            /* if the reader has fallen behind, drop the data for now */
+            if (node_head - __sync_fetch_and_add (& node_tail, 0) >= N_NODES - 1)
                 break;
 
-            current_node = vis_pool.head ();
+            node.serial = cur_serial;
+            node.channels = node_channels;
+            node.time = node_time;
 
-            if (current_node)
-            {
-                assert (current_node->channels == channels);
-                vis_pool.remove (current_node);
-                current_node->time = node_time;
-            }
-            else
-                current_node = new VisNode (channels, node_time);
+            /* allocates only the first time a node is used (or if the channel
+             * count grows), not for every buffer */
+            node.data.resize (node_channels * FRAMES_PER_NODE);
 
+            building = true;
             current_frames = 0;
         }
 
@@ -208,24 +243,29 @@ void vis_runner_pass_audio (int time, const Index<float> & data, int channels, i
          * wait for more data to be passed in the next call.  If we do fill the
          * node, we loop and start building a new one. */
 
-        int copy = aud::min (data.len () - at, channels * (FRAMES_PER_NODE - current_frames));
-        memcpy (current_node->data + channels * current_frames, & data[at], sizeof (float) * copy);
-        current_frames += copy / channels;
+        int copy = aud::min (frames - at, FRAMES_PER_NODE - current_frames);
+        copy_frames (& data[channels * at], channels,
+         & node.data[node_channels * current_frames], node_channels, copy);
+
+        current_frames += copy;
 
         if (current_frames < FRAMES_PER_NODE)
             break;
 
-        vis_list.append (current_node);
-        current_node = nullptr;
-    }
+        last_time = node.time;
+        have_last = true;
+        building = false;
 
-    pthread_mutex_unlock (& mutex);
+        /* publish the node only after it is completely written */
+        __sync_synchronize ();
+        node_head ++;
+    }
 }
 
-void vis_runner_enable (bool enable)
+void vis_runner_enable (int type_mask)
 {
     pthread_mutex_lock (& mutex);
-    enabled = enable;
+    enabled_types = type_mask;
     start_stop_locked (playing, paused);
     pthread_mutex_unlock (& mutex);
 }
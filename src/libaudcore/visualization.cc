@@ -20,8 +20,6 @@
 #include "interface.h"
 #include "internal.h"
 
-#include <string.h>
-
 #include "plugin.h"
 #include "plugins.h"
 #include "runtime.h"
@@ -29,35 +27,34 @@
 static Index<Visualizer *> visualizers;
 
 static int running = false;
-static int num_enabled = 0;
+static int enabled_types = 0;
+
+static void update_enabled_types ()
+{
+    int types = 0;
+    for (Visualizer * vis : visualizers)
+        types |= vis->type_mask;
+
+    if (types != enabled_types)
+    {
+        enabled_types = types;
+        vis_runner_enable (types);
+    }
+}
 
 EXPORT void aud_visualizer_add (Visualizer * vis)
 {
     visualizers.append (vis);
-
-    num_enabled ++;
-    if (num_enabled == 1)
-        vis_runner_enable (true);
+    update_enabled_types ();
 }
 
 EXPORT void aud_visualizer_remove (Visualizer * vis)
 {
-    int num_disabled = 0;
-
     auto is_match = [&] (Visualizer * vis2)
-    {
-        if (vis2 != vis)
-            return false;
-
-        num_disabled ++;
-        return true;
-    };
+        { return vis2 == vis; };
 
     visualizers.remove_if (is_match, true);
-
-    num_enabled -= num_disabled;
-    if (! num_enabled)
-        vis_runner_enable (false);
+    update_enabled_types ();
 }
 
 void vis_send_clear ()
@@ -68,37 +65,31 @@ void vis_send_clear ()
 
 static void pcm_to_mono (const float * data, float * mono, int channels)
 {
-    if (channels == 1)
-        memcpy (mono, data, sizeof (float) * 512);
-    else
+    float * set = mono;
+    while (set < & mono[512])
     {
-        float * set = mono;
-        while (set < & mono[512])
-        {
-            * set ++ = (data[0] + data[1]) / 2;
-            data += channels;
-        }
+        * set ++ = (data[0] + data[1]) / 2;
+        data += channels;
     }
 }
 
 void vis_send_audio (const float * data, int channels)
 {
     auto is_active = [] (int type_mask)
-    {
-        for (Visualizer * vis : visualizers)
-        {
-            if ((vis->type_mask & type_mask))
-                return true;
-        }
-
-        return false;
-    };
+        { return (bool) (enabled_types & type_mask); };
 
-    float mono[512];
+    float mono_buf[512];
     float freq[256];
 
-    if (is_active (Visualizer::MonoPCM | Visualizer::Freq))
-        pcm_to_mono (data, mono, channels);
+    /* mono data is passed through without copying */
+    const float * mono = data;
+
+    if (channels > 1 && is_active (Visualizer::MonoPCM | Visualizer::Freq))
+    {
+        pcm_to_mono (data, mono_buf, channels);
+        mono = mono_buf;
+    }
+
     if (is_active (Visualizer::Freq))
         calc_freq (mono, freq);
 
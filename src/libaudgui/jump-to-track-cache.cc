@@ -118,21 +118,20 @@ const KeywordMatches * JumpToTrackCache::search_within
  */
 void JumpToTrackCache::init ()
 {
-    auto playlist = Playlist::active_playlist ();
-    int entries = playlist.n_entries ();
+    auto rows = Playlist::active_playlist ().snapshot ();
 
     // the empty string will match all playlist entries
     KeywordMatches & k = * add (String (""), KeywordMatches ());
 
-    k.insert (0, entries);
+    k.insert (0, rows.len ());
 
-    for (int entry = 0; entry < entries; entry ++)
+    for (int entry = 0; entry < rows.len (); entry ++)
     {
         KeywordMatch & item = k[entry];
         item.entry = entry;
-        item.path = String (uri_to_display (playlist.entry_filename (entry)));
+        item.path = String (uri_to_display (rows[entry].filename));
 
-        Tuple tuple = playlist.entry_tuple (entry, Playlist::NoWait);
+        const Tuple & tuple = rows[entry].tuple;
         item.title = tuple.get_str (Tuple::Title);
         item.artist = tuple.get_str (Tuple::Artist);
         item.album = tuple.get_str (Tuple::Album);
@@ -136,6 +136,28 @@ static const ComboItem bitdepth_elements[] = {
     ComboItem (N_("Floating point"), 0)
 };
 
+static const ComboItem samplerate_elements[] = {
+    ComboItem (N_("Automatic"), 0),
+    ComboItem ("44100", 44100),
+    ComboItem ("48000", 48000),
+    ComboItem ("88200", 88200),
+    ComboItem ("96000", 96000),
+    ComboItem ("176400", 176400),
+    ComboItem ("192000", 192000)
+};
+
+static const ComboItem keep_open_elements[] = {
+    ComboItem (N_("Never"), (int) OutputKeepOpen::Never),
+    ComboItem (N_("If only the sample rate changes"), (int) OutputKeepOpen::ConvertRate),
+    ComboItem (N_("Always"), (int) OutputKeepOpen::ConvertAll)
+};
+
+static const ComboItem resample_quality_elements[] = {
+    ComboItem (N_("Low"), 0),
+    ComboItem (N_("Medium"), 1),
+    ComboItem (N_("High"), 2)
+};
+
 static const ComboItem record_elements[] = {
     ComboItem (N_("As decoded"), (int) OutputStream::AsDecoded),
     ComboItem (N_("After applying ReplayGain"), (int) OutputStream::AfterReplayGain),
@@ -174,7 +196,7 @@ static ArrayRef<ComboItem> output_combo_fill ();
 static void output_combo_changed ();
 static void * output_create_config_button ();
 static void * output_create_about_button ();
-static void output_bit_depth_changed ();
+static void output_format_changed ();
 
 static const PreferencesWidget output_combo_widgets[] = {
     WidgetCombo (N_("Output plugin:"),
@@ -210,8 +232,18 @@ static const PreferencesWidget audio_page_widgets[] = {
     WidgetLabel (N_("<b>Output Settings</b>")),
     WidgetBox ({{output_combo_widgets}, true}),
     WidgetCombo (N_("Bit depth:"),
-        WidgetInt (0, "output_bit_depth", output_bit_depth_changed),
+        WidgetInt (0, "output_bit_depth", output_format_changed),
         {{bitdepth_elements}}),
+    WidgetCombo (N_("Sample rate:"),
+        WidgetInt (0, "output_sample_rate", output_format_changed),
+        {{samplerate_elements}}),
+    WidgetCombo (N_("Resampling quality:"),
+        WidgetInt (0, "resample_quality", output_format_changed),
+        {{resample_quality_elements}},
+        WIDGET_CHILD),
+    WidgetCombo (N_("Keep device open between songs:"),
+        WidgetInt (0, "output_keep_open"),
+        {{keep_open_elements}}),
     WidgetSpin (N_("Buffer size:"),
         WidgetInt (0, "output_buffer_size"),
         {100, 10000, 1000, N_("ms")}),
@@ -675,7 +707,7 @@ static ArrayRef<ComboItem> output_combo_fill ()
     return {output_combo_elements.begin (), output_combo_elements.len ()};
 }
 
-static void output_bit_depth_changed ()
+static void output_format_changed ()
 {
     aud_output_reset (OutputReset::ReopenStream);
 }
@@ -70,17 +70,15 @@ EXPORT Index<char> audgui_urilist_create_from_selected (Playlist playlist)
     playlist.cache_selected ();
 
     Index<char> buf;
-    int entries = playlist.n_entries ();
 
-    for (int i = 0; i < entries; i ++)
+    for (auto & row : playlist.snapshot ())
     {
-        if (playlist.entry_selected (i))
+        if (row.selected)
         {
             if (buf.len ())
                 buf.append ('\n');
 
-            String filename = playlist.entry_filename (i);
-            buf.insert (filename, -1, strlen (filename));
+            buf.insert (row.filename, -1, strlen (row.filename));
         }
     }
 
@@ -53,9 +53,10 @@ struct ValuePair {
 
 namespace audtag {
 
-static bool ape_read_header (VFSFile & handle, APEHeader * header)
+static bool ape_read_header (VFSFile & handle, const TagBlocks & blocks,
+ int64_t offset, APEHeader * header)
 {
-    if (handle.fread (header, 1, sizeof (APEHeader)) != sizeof (APEHeader))
+    if (blocks.read_at (handle, offset, header, sizeof (APEHeader)) != sizeof (APEHeader))
         return false;
 
     if (strncmp (header->magic, "APETAGEX", 8))
@@ -72,15 +73,12 @@ static bool ape_read_header (VFSFile & handle, APEHeader * header)
     return true;
 }
 
-static bool ape_find_header (VFSFile & handle, APEHeader * header,
- int * start, int * length, int * data_start, int * data_length)
+static bool ape_find_header (VFSFile & handle, const TagBlocks & blocks,
+ APEHeader * header, int * start, int * length, int * data_start, int * data_length)
 {
     APEHeader secondary;
 
-    if (handle.fseek (0, VFS_SEEK_SET))
-        return false;
-
-    if (ape_read_header (handle, header))
+    if (ape_read_header (handle, blocks, 0, header))
     {
         AUDDBG ("Found header at 0, length = %d, version = %d.\n",
          (int) header->length, (int) header->version);
@@ -98,10 +96,7 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
 
         if (! (header->flags & APE_FLAG_HAS_NO_FOOTER))
         {
-            if (handle.fseek (header->length, VFS_SEEK_CUR))
-                return false;
-
-            if (! ape_read_header (handle, & secondary))
+            if (! ape_read_header (handle, blocks, sizeof (APEHeader) + header->length, & secondary))
             {
                 AUDWARN ("Expected footer, but found none.\n");
                 return false;
@@ -113,16 +108,18 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
         return true;
     }
 
-    if (handle.fseek (-(int) sizeof (APEHeader), VFS_SEEK_END))
+    if (blocks.file_size < 0)
         return false;
 
-    if (! ape_read_header (handle, header))
+    /* position just after the footer */
+    int64_t end = blocks.file_size;
+
+    if (! ape_read_header (handle, blocks, end - sizeof (APEHeader), header))
     {
         /* APE tag may be followed by an ID3v1 tag */
-        if (handle.fseek (-128 - (int) sizeof (APEHeader), VFS_SEEK_END))
-            return false;
+        end -= 128;
 
-        if (! ape_read_header (handle, header))
+        if (! ape_read_header (handle, blocks, end - sizeof (APEHeader), header))
         {
             AUDDBG ("No header found.\n");
             return false;
@@ -130,12 +127,12 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
     }
 
     AUDDBG ("Found footer at %d, length = %d, version = %d.\n",
-     (int) handle.ftell () - (int) sizeof (APEHeader), (int) header->length,
+     (int) end - (int) sizeof (APEHeader), (int) header->length,
      (int) header->version);
 
-    * start = handle.ftell () - header->length;
+    * start = end - header->length;
     * length = header->length;
-    * data_start = handle.ftell () - header->length;
+    * data_start = end - header->length;
     * data_length = header->length - sizeof (APEHeader);
 
     if ((header->flags & APE_FLAG_HAS_NO_FOOTER) || (header->flags & APE_FLAG_IS_HEADER))
@@ -146,10 +143,7 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
 
     if (header->flags & APE_FLAG_HAS_HEADER)
     {
-        if (handle.fseek (-(int) header->length - sizeof (APEHeader), VFS_SEEK_CUR))
-            return false;
-
-        if (! ape_read_header (handle, & secondary))
+        if (! ape_read_header (handle, blocks, end - header->length - sizeof (APEHeader), & secondary))
         {
             AUDDBG ("Expected header, but found none.\n");
             return false;
@@ -162,13 +156,13 @@ static bool ape_find_header (VFSFile & handle, APEHeader * header,
     return true;
 }
 
-bool APETagModule::can_handle_file (VFSFile & handle)
+bool APETagModule::can_handle_file (VFSFile & handle, const TagBlocks & blocks)
 {
     APEHeader header;
     int start, length, data_start, data_length;
 
-    return ape_find_header (handle, & header, & start, & length, & data_start,
-     & data_length);
+    return ape_find_header (handle, blocks, & header, & start, & length,
+     & data_start, & data_length);
 }
 
 /* returns start of next item or nullptr */
@@ -206,22 +200,20 @@ static const char * ape_read_item (const char * data, int length, ValuePair & pa
     return value + header[0];
 }
 
-static Index<ValuePair> ape_read_items (VFSFile & handle)
+static Index<ValuePair> ape_read_items (VFSFile & handle, const TagBlocks & blocks)
 {
     Index<ValuePair> list;
     APEHeader header;
     int start, length, data_start, data_length;
 
-    if (! ape_find_header (handle, & header, & start, & length, & data_start, & data_length))
-        return list;
-
-    if (handle.fseek (data_start, VFS_SEEK_SET))
+    if (! ape_find_header (handle, blocks, & header, & start, & length,
+     & data_start, & data_length))
         return list;
 
     Index<char> data;
     data.insert (0, data_length);
 
-    if (handle.fread (data.begin (), 1, data_length) != data_length)
+    if (blocks.read_at (handle, data_start, data.begin (), data_length) != data_length)
         return list;
 
     AUDDBG ("Reading %d items:\n", header.items);
@@ -240,9 +232,10 @@ static Index<ValuePair> ape_read_items (VFSFile & handle)
     return list;
 }
 
-bool APETagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * image)
+bool APETagModule::read_tag (VFSFile & handle, const TagBlocks & blocks,
+ Tuple & tuple, Index<char> * image)
 {
-    Index<ValuePair> list = ape_read_items (handle);
+    Index<ValuePair> list = ape_read_items (handle, blocks);
 
     for (const ValuePair & pair : list)
     {
@@ -345,13 +338,15 @@ static bool write_header (int data_length, int items, bool is_header,
     return handle.fwrite (& header, 1, sizeof (APEHeader)) == sizeof (APEHeader);
 }
 
-bool APETagModule::write_tag (VFSFile & handle, const Tuple & tuple)
+bool APETagModule::write_tag (VFSFile & handle, const TagBlocks & blocks,
+ const Tuple & tuple)
 {
-    Index<ValuePair> list = ape_read_items (handle);
+    Index<ValuePair> list = ape_read_items (handle, blocks);
     APEHeader header;
     int start, length, data_start, data_length, items;
 
-    if (ape_find_header (handle, & header, & start, & length, & data_start, & data_length))
+    if (ape_find_header (handle, blocks, & header, & start, & length,
+     & data_start, & data_length))
     {
         if (start + length != handle.fsize ())
         {
@@ -114,15 +114,12 @@ static bool validate_header (ID3v2Header * header)
     return true;
 }
 
-static bool read_header (VFSFile & handle, int * version, bool *
- syncsafe, int64_t * offset, int * header_size, int * data_size)
+static bool read_header (VFSFile & handle, const TagBlocks & blocks, int *
+ version, bool * syncsafe, int64_t * offset, int * header_size, int * data_size)
 {
     ID3v2Header header;
 
-    if (handle.fseek (0, VFS_SEEK_SET))
-        return false;
-
-    if (handle.fread (& header, 1, sizeof (ID3v2Header)) != sizeof
+    if (blocks.read_at (handle, 0, & header, sizeof (ID3v2Header)) != sizeof
      (ID3v2Header))
         return false;
 
@@ -144,8 +141,8 @@ static bool read_header (VFSFile & handle, int * version, bool *
     return true;
 }
 
-static bool read_frame (VFSFile & handle, int max_size, int version,
- bool syncsafe, int * frame_size, GenericFrame & frame)
+static bool read_frame (const char * data, int max_size, int * frame_size,
+ GenericFrame & frame)
 {
     ID3v2FrameHeader header;
     uint32_t hdrsz = 0;
@@ -153,9 +150,8 @@ static bool read_frame (VFSFile & handle, int max_size, int version,
     if ((max_size -= sizeof (ID3v2FrameHeader)) < 0)
         return false;
 
-    if (handle.fread (& header, 1, sizeof (ID3v2FrameHeader)) != sizeof
-     (ID3v2FrameHeader))
-        return false;
+    memcpy (& header, data, sizeof (ID3v2FrameHeader));
+    data += sizeof (ID3v2FrameHeader);
 
     if (! header.key[0]) /* padding */
         return false;
@@ -177,16 +173,12 @@ static bool read_frame (VFSFile & handle, int max_size, int version,
 
     frame.key = String (str_copy (header.key, 3));
     frame.clear ();
-    frame.insert (0, hdrsz);
-
-    if (handle.fread (& frame[0], 1, frame.len ()) != frame.len ())
-        return false;
+    frame.insert (data, 0, hdrsz);
 
     AUDDBG ("Data size = %d.\n", frame.len ());
     return true;
 }
 
-
 static int get_frame_id (const char * key)
 {
     int id;
@@ -200,36 +192,42 @@ static int get_frame_id (const char * key)
     return -1;
 }
 
-bool ID3v22TagModule::can_handle_file (VFSFile & handle)
+bool ID3v22TagModule::can_handle_file (VFSFile & handle, const TagBlocks & blocks)
 {
     int version, header_size, data_size;
     bool syncsafe;
     int64_t offset;
 
-    return read_header (handle, & version, & syncsafe, & offset, & header_size,
-     & data_size);
+    return read_header (handle, blocks, & version, & syncsafe, & offset,
+     & header_size, & data_size);
 }
 
-bool ID3v22TagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * image)
+bool ID3v22TagModule::read_tag (VFSFile & handle, const TagBlocks & blocks,
+ Tuple & tuple, Index<char> * image)
 {
     int version, header_size, data_size;
     bool syncsafe;
     int64_t offset;
     int pos;
 
-    if (! read_header (handle, & version, & syncsafe, & offset, & header_size,
-     & data_size))
+    if (! read_header (handle, blocks, & version, & syncsafe, & offset,
+     & header_size, & data_size))
         return false;
 
     AUDDBG ("Reading tags from %i bytes of ID3 data in %s\n", data_size,
      handle.filename ());
 
-    for (pos = 0; pos < data_size; )
+    /* usually served from the head block without another read */
+    Index<char> data;
+    data.resize (data_size);
+    data.resize (blocks.read_at (handle, offset + header_size, data.begin (), data_size));
+
+    for (pos = 0; pos < data.len (); )
     {
         int frame_size;
         GenericFrame frame;
 
-        if (! read_frame (handle, data_size - pos, version, syncsafe, & frame_size, frame))
+        if (! read_frame (data.begin () + pos, data.len () - pos, & frame_size, frame))
         {
             AUDDBG("read_frame failed at pos %i\n", pos);
             break;
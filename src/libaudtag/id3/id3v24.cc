@@ -114,38 +114,34 @@ typedef SimpleHash<String, FrameList> FrameDict;
 
 namespace audtag {
 
-static bool skip_extended_header_3 (VFSFile & handle, int * _size)
+static bool skip_extended_header_3 (VFSFile & handle, const TagBlocks & blocks,
+ int64_t at, int * _size)
 {
     uint32_t size;
 
-    if (handle.fread (& size, 1, 4) != 4)
+    if (blocks.read_at (handle, at, & size, 4) != 4)
         return false;
 
     size = FROM_BE32 (size);
 
     AUDDBG ("Found v2.3 extended header, size = %d.\n", (int) size);
 
-    if (handle.fseek (size, VFS_SEEK_CUR))
-        return false;
-
     * _size = 4 + size;
     return true;
 }
 
-static bool skip_extended_header_4 (VFSFile & handle, int * _size)
+static bool skip_extended_header_4 (VFSFile & handle, const TagBlocks & blocks,
+ int64_t at, int * _size)
 {
     uint32_t size;
 
-    if (handle.fread (& size, 1, 4) != 4)
+    if (blocks.read_at (handle, at, & size, 4) != 4)
         return false;
 
     size = unsyncsafe32 (FROM_BE32 (size));
 
     AUDDBG ("Found v2.4 extended header, size = %d.\n", (int) size);
 
-    if (handle.fseek (size - 4, VFS_SEEK_CUR))
-        return false;
-
     * _size = size;
     return true;
 }
@@ -171,16 +167,13 @@ static bool validate_header (ID3v2Header * header, bool is_footer)
     return true;
 }
 
-static bool read_header (VFSFile & handle, int * version, bool *
- syncsafe, int64_t * offset, int * header_size, int * data_size, int *
- footer_size)
+static bool read_header (VFSFile & handle, const TagBlocks & blocks, int *
+ version, bool * syncsafe, int64_t * offset, int * header_size, int *
+ data_size, int * footer_size)
 {
     ID3v2Header header, footer;
 
-    if (handle.fseek (0, VFS_SEEK_SET))
-        return false;
-
-    if (handle.fread (& header, 1, sizeof (ID3v2Header)) != sizeof (ID3v2Header))
+    if (blocks.read_at (handle, 0, & header, sizeof (ID3v2Header)) != sizeof (ID3v2Header))
         return false;
 
     if (validate_header (& header, false))
@@ -192,18 +185,13 @@ static bool read_header (VFSFile & handle, int * version, bool *
 
         if (header.flags & ID3_HEADER_HAS_FOOTER)
         {
-            if (handle.fseek (header.size, VFS_SEEK_CUR))
-                return false;
-
-            if (handle.fread (& footer, 1, sizeof (ID3v2Header)) != sizeof (ID3v2Header))
+            if (blocks.read_at (handle, sizeof (ID3v2Header) + header.size,
+             & footer, sizeof (ID3v2Header)) != sizeof (ID3v2Header))
                 return false;
 
             if (! validate_header (& footer, true))
                 return false;
 
-            if (handle.fseek (sizeof (ID3v2Header), VFS_SEEK_SET))
-                return false;
-
             * footer_size = sizeof (ID3v2Header);
         }
         else
@@ -211,15 +199,13 @@ static bool read_header (VFSFile & handle, int * version, bool *
     }
     else
     {
-        int64_t end = handle.fsize ();
-
-        if (end < 0)
-            return false;
+        int64_t end = blocks.file_size;
 
-        if (handle.fseek (end - sizeof (ID3v2Header), VFS_SEEK_SET))
+        if (end < (int64_t) sizeof (ID3v2Header))
             return false;
 
-        if (handle.fread (& footer, 1, sizeof (ID3v2Header)) != sizeof (ID3v2Header))
+        if (blocks.read_at (handle, end - sizeof (ID3v2Header), & footer,
+         sizeof (ID3v2Header)) != sizeof (ID3v2Header))
             return false;
 
         if (! validate_header (& footer, true))
@@ -231,11 +217,8 @@ static bool read_header (VFSFile & handle, int * version, bool *
         * data_size = footer.size;
         * footer_size = sizeof (ID3v2Header);
 
-        if (handle.fseek (* offset, VFS_SEEK_SET))
-            return false;
-
-        if (handle.fread (& header, 1, sizeof (ID3v2Header)) != sizeof
-         (ID3v2Header))
+        if (blocks.read_at (handle, * offset, & header, sizeof (ID3v2Header))
+         != sizeof (ID3v2Header))
             return false;
 
         if (! validate_header (& header, false))
@@ -252,12 +235,12 @@ static bool read_header (VFSFile & handle, int * version, bool *
 
         if (header.version == 3)
         {
-            if (! skip_extended_header_3 (handle, & extended_size))
+            if (! skip_extended_header_3 (handle, blocks, * offset + * header_size, & extended_size))
                 return false;
         }
         else if (header.version == 4)
         {
-            if (! skip_extended_header_4 (handle, & extended_size))
+            if (! skip_extended_header_4 (handle, blocks, * offset + * header_size, & extended_size))
                 return false;
         }
 
@@ -297,11 +280,12 @@ static void unsyncsafe (Index<char> & data)
     data.remove (set - data.begin (), -1);
 }
 
-static Index<char> read_tag_data (VFSFile & handle, int size, bool syncsafe)
+static Index<char> read_tag_data (VFSFile & handle, const TagBlocks & blocks,
+ int64_t offset, int size, bool syncsafe)
 {
     Index<char> data;
     data.resize (size);
-    data.resize (handle.fread (data.begin (), 1, size));
+    data.resize (blocks.read_at (handle, offset, data.begin (), size));
 
     if (syncsafe)
         unsyncsafe (data);
@@ -309,17 +293,14 @@ static Index<char> read_tag_data (VFSFile & handle, int size, bool syncsafe)
     return data;
 }
 
-static bool read_frame (const char * data, int max_size, int version,
- int * frame_size, GenericFrame & frame)
+/* <max_size> includes the frame header */
+static bool read_frame_header (const char * data, int max_size, int version,
+ ID3v2FrameHeader & header)
 {
-    ID3v2FrameHeader header;
-    unsigned skip = 0;
-
     if ((max_size -= sizeof (ID3v2FrameHeader)) < 0)
         return false;
 
     memcpy (& header, data, sizeof (ID3v2FrameHeader));
-    data += sizeof (ID3v2FrameHeader);
 
     if (! header.key[0]) /* padding */
         return false;
@@ -330,6 +311,20 @@ static bool read_frame (const char * data, int max_size, int version,
     if (header.size > (unsigned) max_size || header.size == 0)
         return false;
 
+    return true;
+}
+
+static bool read_frame (const char * data, int max_size, int version,
+ int * frame_size, GenericFrame & frame)
+{
+    ID3v2FrameHeader header;
+    unsigned skip = 0;
+
+    if (! read_frame_header (data, max_size, version, header))
+        return false;
+
+    data += sizeof (ID3v2FrameHeader);
+
     AUDDBG ("Found frame:\n");
     AUDDBG (" key = %.4s\n", header.key);
     AUDDBG (" size = %d\n", (int) header.size);
@@ -532,93 +527,155 @@ static void add_frameFromTupleInt (const Tuple & tuple, Tuple::Field field,
         remove_frame (id3_field, dict);
 }
 
-bool ID3v24TagModule::can_handle_file (VFSFile & handle)
+static void decode_frame (GenericFrame & frame, Tuple & tuple,
+ Index<char> * image, FrameList & rva_frames)
+{
+    switch (get_frame_id (frame.key))
+    {
+      case ID3_ALBUM:
+        id3_associate_string (tuple, Tuple::Album, & frame[0], frame.len ());
+        break;
+      case ID3_TITLE:
+        id3_associate_string (tuple, Tuple::Title, & frame[0], frame.len ());
+        break;
+      case ID3_COMPOSER:
+        id3_associate_string (tuple, Tuple::Composer, & frame[0], frame.len ());
+        break;
+      case ID3_COPYRIGHT:
+        id3_associate_string (tuple, Tuple::Copyright, & frame[0], frame.len ());
+        break;
+      case ID3_DATE:
+        id3_associate_string (tuple, Tuple::Date, & frame[0], frame.len ());
+        break;
+      case ID3_LENGTH:
+        id3_associate_length (tuple, & frame[0], frame.len ());
+        break;
+      case ID3_ARTIST:
+        id3_associate_string (tuple, Tuple::Artist, & frame[0], frame.len ());
+        break;
+      case ID3_ALBUM_ARTIST:
+        id3_associate_string (tuple, Tuple::AlbumArtist, & frame[0], frame.len ());
+        break;
+      case ID3_TRACKNR:
+        id3_associate_int (tuple, Tuple::Track, & frame[0], frame.len ());
+        break;
+      case ID3_YEAR:
+      case ID3_RECORDING_TIME:
+        id3_associate_int (tuple, Tuple::Year, & frame[0], frame.len ());
+        break;
+      case ID3_GENRE:
+        id3_decode_genre (tuple, & frame[0], frame.len ());
+        break;
+      case ID3_COMMENT:
+        id3_decode_comment (tuple, & frame[0], frame.len ());
+        break;
+      case ID3_TXXX:
+        id3_decode_txxx (tuple, & frame[0], frame.len ());
+        break;
+      case ID3_RVA2:
+        rva_frames.append (std::move (frame));
+        break;
+      case ID3_APIC:
+        if (image)
+            * image = id3_decode_picture (& frame[0], frame.len ());
+        break;
+      default:
+        AUDDBG ("Ignoring unsupported ID3 frame %s.\n", (const char *) frame.key);
+        break;
+    }
+}
+
+/* Picture frames can be several megabytes, and are not needed at all when
+ * scanning for metadata.  Unsupported frames are not needed either. */
+static bool frame_wanted (const char * key, Index<char> * image)
+{
+    int id = get_frame_id (str_copy (key, 4));
+    return id >= 0 && (id != ID3_APIC || image);
+}
+
+/* Walks the frames in the file, reading only the headers of frames that are
+ * not wanted.  This is not possible with tag-level unsynchronisation, since
+ * the frame boundaries are then not known until the whole tag is decoded. */
+static void read_wanted_frames (VFSFile & handle, const TagBlocks & blocks,
+ int64_t start, int size, int version, Tuple & tuple, Index<char> * image,
+ FrameList & rva_frames)
+{
+    Index<char> buf;
+
+    for (int pos = 0; pos < size; )
+    {
+        char raw[sizeof (ID3v2FrameHeader)];
+        ID3v2FrameHeader header;
+
+        if (blocks.read_at (handle, start + pos, raw, sizeof raw) != sizeof raw ||
+         ! read_frame_header (raw, size - pos, version, header))
+            break;
+
+        int frame_size = sizeof (ID3v2FrameHeader) + header.size;
+
+        if (! frame_wanted (header.key, image))
+        {
+            AUDDBG ("Skipping %d bytes of ID3 frame %.4s.\n", frame_size, header.key);
+            pos += frame_size;
+            continue;
+        }
+
+        buf.resize (frame_size);
+        if (blocks.read_at (handle, start + pos, buf.begin (), frame_size) != frame_size)
+            break;
+
+        GenericFrame frame;
+        if (! read_frame (buf.begin (), frame_size, version, & frame_size, frame))
+            break;
+
+        decode_frame (frame, tuple, image, rva_frames);
+        pos += frame_size;
+    }
+}
+
+bool ID3v24TagModule::can_handle_file (VFSFile & handle, const TagBlocks & blocks)
 {
     int version, header_size, data_size, footer_size;
     bool syncsafe;
     int64_t offset;
 
-    return read_header (handle, & version, & syncsafe, & offset, & header_size,
-     & data_size, & footer_size);
+    return read_header (handle, blocks, & version, & syncsafe, & offset,
+     & header_size, & data_size, & footer_size);
 }
 
-bool ID3v24TagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * image)
+bool ID3v24TagModule::read_tag (VFSFile & handle, const TagBlocks & blocks,
+ Tuple & tuple, Index<char> * image)
 {
     int version, header_size, data_size, footer_size;
     bool syncsafe;
     int64_t offset;
 
-    if (! read_header (handle, & version, & syncsafe, & offset, & header_size,
-     & data_size, & footer_size))
+    if (! read_header (handle, blocks, & version, & syncsafe, & offset,
+     & header_size, & data_size, & footer_size))
         return false;
 
-    Index<char> data = read_tag_data (handle, data_size, syncsafe);
     FrameList rva_frames;
 
-    for (const char * pos = data.begin (); pos < data.end (); )
+    if (syncsafe)
     {
-        int frame_size;
-        GenericFrame frame;
-
-        if (! read_frame (pos, data.end () - pos, version, & frame_size, frame))
-            break;
+        Index<char> data = read_tag_data (handle, blocks, offset + header_size,
+         data_size, syncsafe);
 
-        switch (get_frame_id (frame.key))
+        for (const char * pos = data.begin (); pos < data.end (); )
         {
-          case ID3_ALBUM:
-            id3_associate_string (tuple, Tuple::Album, & frame[0], frame.len ());
-            break;
-          case ID3_TITLE:
-            id3_associate_string (tuple, Tuple::Title, & frame[0], frame.len ());
-            break;
-          case ID3_COMPOSER:
-            id3_associate_string (tuple, Tuple::Composer, & frame[0], frame.len ());
-            break;
-          case ID3_COPYRIGHT:
-            id3_associate_string (tuple, Tuple::Copyright, & frame[0], frame.len ());
-            break;
-          case ID3_DATE:
-            id3_associate_string (tuple, Tuple::Date, & frame[0], frame.len ());
-            break;
-          case ID3_LENGTH:
-            id3_associate_length (tuple, & frame[0], frame.len ());
-            break;
-          case ID3_ARTIST:
-            id3_associate_string (tuple, Tuple::Artist, & frame[0], frame.len ());
-            break;
-          case ID3_ALBUM_ARTIST:
-            id3_associate_string (tuple, Tuple::AlbumArtist, & frame[0], frame.len ());
-            break;
-          case ID3_TRACKNR:
-            id3_associate_int (tuple, Tuple::Track, & frame[0], frame.len ());
-            break;
-          case ID3_YEAR:
-          case ID3_RECORDING_TIME:
-            id3_associate_int (tuple, Tuple::Year, & frame[0], frame.len ());
-            break;
-          case ID3_GENRE:
-            id3_decode_genre (tuple, & frame[0], frame.len ());
-            break;
-          case ID3_COMMENT:
-            id3_decode_comment (tuple, & frame[0], frame.len ());
-            break;
-          case ID3_TXXX:
-            id3_decode_txxx (tuple, & frame[0], frame.len ());
-            break;
-          case ID3_RVA2:
-            rva_frames.append (std::move (frame));
-            break;
-          case ID3_APIC:
-            if (image)
-                * image = id3_decode_picture (& frame[0], frame.len ());
-            break;
-          default:
-            AUDDBG ("Ignoring unsupported ID3 frame %s.\n", (const char *) frame.key);
-            break;
-        }
+            int frame_size;
+            GenericFrame frame;
 
-        pos += frame_size;
+            if (! read_frame (pos, data.end () - pos, version, & frame_size, frame))
+                break;
+
+            decode_frame (frame, tuple, image, rva_frames);
+            pos += frame_size;
+        }
     }
+    else
+        read_wanted_frames (handle, blocks, offset + header_size, data_size,
+         version, tuple, image, rva_frames);
 
     /* only decode RVA2 frames if Replay Gain was not found in TXXX frames */
     if (! tuple.is_set (Tuple::GainDivisor) && ! tuple.is_set (Tuple::PeakDivisor))
@@ -630,7 +687,8 @@ bool ID3v24TagModule::read_tag (VFSFile & handle, Tuple & tuple, Index<char> * i
     return true;
 }
 
-bool ID3v24TagModule::write_tag (VFSFile & f, const Tuple & tuple)
+bool ID3v24TagModule::write_tag (VFSFile & f, const TagBlocks & blocks,
+ const Tuple & tuple)
 {
     int version = 3;
     int header_size, data_size, footer_size;
@@ -640,8 +698,10 @@ bool ID3v24TagModule::write_tag (VFSFile & f, const Tuple & tuple)
     //read all frames into generic frames;
     FrameDict dict;
 
-    if (read_header (f, & version, & syncsafe, & offset, & header_size, & data_size, & footer_size))
-        read_all_frames (read_tag_data (f, data_size, syncsafe), version, dict);
+    if (read_header (f, blocks, & version, & syncsafe, & offset, & header_size,
+     & data_size, & footer_size))
+        read_all_frames (read_tag_data (f, blocks, offset + header_size,
+         data_size, syncsafe), version, dict);
 
     //make the new frames from tuple and replace in the dictionary the old frames with the new ones
     add_frameFromTupleStr (tuple, Tuple::Title, ID3_TITLE, dict);
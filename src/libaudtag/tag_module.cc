@@ -17,6 +17,8 @@
  * the use of this software.
  */
 
+#include <string.h>
+
 #include <libaudcore/index.h>
 #include <libaudcore/runtime.h>
 #include <libaudcore/tuple.h>
@@ -27,6 +29,13 @@
 #include "tag_module.h"
 #include "builtin.h"
 
+/* ID3v2 and APE headers are at the start of the file; ID3v1 tags, APE footers,
+ * and ID3v2 footers are at the end.  The head block is large enough to hold a
+ * typical ID3v2 tag without pictures, the tail block an ID3v1 tag with the
+ * extended block and a typical APE tag. */
+#define HEAD_BLOCK_SIZE 16384
+#define TAIL_BLOCK_SIZE 4096
+
 namespace audtag {
 
 static APETagModule ape;
@@ -36,17 +45,67 @@ static ID3v24TagModule id3v24;
 
 static TagModule * const modules[] = {& id3v24, & id3v22, & ape, & id3v1};
 
-TagModule * find_tag_module (VFSFile & fd, TagType new_type)
+bool TagBlocks::read (VFSFile & file)
 {
-    for (TagModule * module : modules)
+    if (file.fseek (0, VFS_SEEK_SET))
+        return false;
+
+    head.resize (HEAD_BLOCK_SIZE);
+    head.resize (aud::max (file.fread (head.begin (), 1, HEAD_BLOCK_SIZE), (int64_t) 0));
+
+    file_size = file.fsize ();
+
+    int64_t tail_start = aud::max (file_size - TAIL_BLOCK_SIZE, (int64_t) head.len ());
+
+    if (file_size > tail_start)
     {
-        if (fd.fseek (0, VFS_SEEK_SET))
-        {
-            AUDDBG("not a seekable file\n");
-            return nullptr;
-        }
+        if (file.fseek (tail_start, VFS_SEEK_SET))
+            return false;
+
+        tail.resize (file_size - tail_start);
+        if (file.fread (tail.begin (), 1, tail.len ()) != tail.len ())
+            tail.clear ();
+    }
+
+    return true;
+}
+
+int64_t TagBlocks::read_at (VFSFile & file, int64_t offset, void * buf, int64_t len) const
+{
+    if (offset < 0 || len < 0)
+        return 0;
 
-        if (module->can_handle_file (fd))
+    if (offset + len <= head.len ())
+    {
+        memcpy (buf, head.begin () + offset, len);
+        return len;
+    }
+
+    int64_t tail_start = file_size - tail.len ();
+
+    if (tail.len () && offset >= tail_start && offset + len <= file_size)
+    {
+        memcpy (buf, tail.begin () + (offset - tail_start), len);
+        return len;
+    }
+
+    if (file.fseek (offset, VFS_SEEK_SET))
+        return 0;
+
+    return aud::max (file.fread (buf, 1, len), (int64_t) 0);
+}
+
+TagModule * find_tag_module (VFSFile & fd, TagType new_type, TagBlocks & blocks)
+{
+    if (! blocks.read (fd))
+    {
+        AUDDBG("not a seekable file\n");
+        return nullptr;
+    }
+
+    for (TagModule * module : modules)
+    {
+        if (module->can_handle_file (fd, blocks))
         {
             AUDDBG ("Module %s accepted file.\n", module->m_name);
             return module;
@@ -70,20 +129,22 @@ TagModule * find_tag_module (VFSFile & fd, TagType new_type)
 /**************************************************************************************************************
  * tag module object management                                                                               *
  **************************************************************************************************************/
-bool TagModule::can_handle_file (VFSFile & file)
+bool TagModule::can_handle_file (VFSFile & file, const TagBlocks & blocks)
 {
     AUDDBG("Module %s does not support %s (no probing function implemented).\n", m_name,
            file.filename ());
     return false;
 }
 
-bool TagModule::read_tag (VFSFile & file, Tuple & tuple, Index<char> * image)
+bool TagModule::read_tag (VFSFile & file, const TagBlocks & blocks,
+ Tuple & tuple, Index<char> * image)
 {
     AUDDBG ("%s: read_tag() not implemented.\n", m_name);
     return false;
 }
 
-bool TagModule::write_tag (VFSFile & file, Tuple const & tuple)
+bool TagModule::write_tag (VFSFile & file, const TagBlocks & blocks,
+ Tuple const & tuple)
 {
     AUDDBG ("%s: write_tag() not implemented.\n", m_name);
     return false;
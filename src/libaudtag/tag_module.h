@@ -24,14 +24,35 @@
 
 namespace audtag {
 
+/* The first and last few kilobytes of a file, where all the supported tags
+ * have their headers and footers.  These are read once, with one seek each,
+ * and shared by all the tag modules, so that probing for several tag types
+ * does not cost several round trips on a network file system. */
+struct TagBlocks
+{
+    int64_t file_size = -1;  /* -1 if unknown, in which case tail is empty */
+    Index<char> head;        /* starts at offset 0 */
+    Index<char> tail;        /* ends at file_size, does not overlap head */
+
+    bool read (VFSFile & file);
+
+    /* Copies <len> bytes at <offset> from the blocks if they are there, or
+     * else reads them from the file.  Like fread(), returns the number of
+     * bytes read, which is less than <len> at the end of the file. */
+    int64_t read_at (VFSFile & file, int64_t offset, void * buf, int64_t len) const;
+};
+
+/* The blocks passed to a module are only valid until the file is modified. */
 struct TagModule
 {
     const char * m_name;
     TagType m_type; /* set to None if the module cannot create new tags */
 
-    virtual bool can_handle_file (VFSFile & file);
-    virtual bool read_tag (VFSFile & file, Tuple & tuple, Index<char> * image);
-    virtual bool write_tag (VFSFile & file, const Tuple & tuple);
+    virtual bool can_handle_file (VFSFile & file, const TagBlocks & blocks);
+    virtual bool read_tag (VFSFile & file, const TagBlocks & blocks,
+     Tuple & tuple, Index<char> * image);
+    virtual bool write_tag (VFSFile & file, const TagBlocks & blocks,
+     const Tuple & tuple);
 
 protected:
     constexpr TagModule (const char * name, TagType type) :
@@ -39,7 +60,7 @@ protected:
         m_type (type) {}
 };
 
-TagModule * find_tag_module (VFSFile & handle, TagType new_type);
+TagModule * find_tag_module (VFSFile & handle, TagType new_type, TagBlocks & blocks);
 
 }
 